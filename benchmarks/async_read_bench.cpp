@@ -0,0 +1,119 @@
+/*
+ * async_read_bench - Many simulated reads in flight: coroutines vs threads
+ * Usage: async_read_bench coro|threads [sensors] [fail_rate]
+ *
+ * "coro" reads every sensor concurrently on one thread through the C++20
+ * API in src/dht11.hpp. "threads" wraps a blocking read in one thread per
+ * sensor, which is what the collector does with the C entry points today.
+ * Both use the simulated backend's timing and failure rate, so the wall
+ * time is the same; the point of comparison is peak RSS and thread count.
+ * Run each mode as its own process so peak RSS is not shared.
+ *
+ * Build: gcc -O2 -std=c99 -I../src -I/usr/include/ws \
+ *        -c ../src/dht11_core.c ../src/pulse_classifier.c \
+ *            ../src/simulator.c
+ *        g++ -O2 -std=c++20 -I../src -I/usr/include/ws -o async_read_bench async_read_bench.cpp \
+ *            dht11_core.o pulse_classifier.o simulator.o -lgpiod -lpthread
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "dht11.hpp"
+
+using sim_sensor = dht11::sensor<dht11::dht11_model, dht11::sim_backend>;
+
+/*
+ * Read every sensor concurrently on this thread
+ */
+static int run_coroutines(int count, double fail_rate) {
+    dht11::event_loop loop;
+    std::vector<std::unique_ptr<sim_sensor>> sensors;
+    int valid = 0;
+    
+    for (int i = 0; i < count; i++) {
+        sensors.push_back(std::make_unique<sim_sensor>(loop, i, fail_rate, (uint64_t)i + 1));
+    }
+    for (auto &s : sensors) {
+        loop.spawn([](sim_sensor &sensor, int &valid) -> dht11::task<void> {
+            sensor_reading_t reading = co_await sensor.read();
+            valid += reading.valid;
+        }(*s, valid));
+    }
+    loop.run();
+    return valid;
+}
+
+/*
+ * Blocking read with the same timing, for one thread per sensor
+ */
+static bool blocking_read(int pin, double fail_rate) {
+    const std::span<const uint32_t> delays = dht11::dht11_model::retry_delays();
+    simulator_t sim;
+    uint8_t raw[5];
+    std::size_t attempt;
+    
+    simulator_init(&sim, (uint64_t)pin + 1, fail_rate);
+    for (attempt = 0; attempt <= delays.size(); attempt++) {
+        std::this_thread::sleep_for(dht11::dht11_model::start_low + dht11::dht11_model::start_high +
+                                    dht11::dht11_model::frame);
+        if (simulator_attempt(&sim, pin, raw) == 0) {
+            return true;
+        }
+        if (attempt < delays.size()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(delays[attempt]));
+        }
+    }
+    return false;
+}
+
+static int run_threads(int count, double fail_rate) {
+    std::vector<std::thread> threads;
+    std::vector<char> results(count, 0);
+    int valid = 0;
+    
+    for (int i = 0; i < count; i++) {
+        threads.emplace_back([&results, i, fail_rate] { results[i] = blocking_read(i, fail_rate); });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    for (char r : results) {
+        valid += r;
+    }
+    return valid;
+}
+
+int main(int argc, char *argv[]) {
+    const char *mode = argc > 1 ? argv[1] : "coro";
+    int count = argc > 2 ? std::atoi(argv[2]) : 500;
+    double fail_rate = argc > 3 ? std::atof(argv[3]) : SIM_DEFAULT_FAIL_RATE;
+    struct rusage usage;
+    int valid;
+    
+    auto start = std::chrono::steady_clock::now();
+    if (std::strcmp(mode, "threads") == 0) {
+        valid = run_threads(count, fail_rate);
+    } else if (std::strcmp(mode, "coro") == 0) {
+        valid = run_coroutines(count, fail_rate);
+    } else {
+        std::fprintf(stderr, "Usage: %s coro|threads [sensors] [fail_rate]\n", argv[0]);
+        return 1;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    getrusage(RUSAGE_SELF, &usage);
+    std::printf("%-8s %6d sensors %6d valid %8.3f s wall %8ld KB max RSS %8.3f s CPU\n", mode, count,
+                valid, wall, usage.ru_maxrss,
+                usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+    return 0;
+}
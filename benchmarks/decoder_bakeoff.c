@@ -0,0 +1,608 @@
+/*
+ * decoder_bakeoff - Score every DHT11 bit decoder on a corpus of labelled frames
+ * Usage: decoder_bakeoff CORPUS...             score each decoder on the frames
+ *        decoder_bakeoff --generate [frames]   write a modelled corpus to stdout
+ *
+ * A corpus is a frame log (src/frame_log.h): one measured frame per line,
+ * labelled with the data its read returned. Record one on a node with
+ *
+ *   SENSOR_DHT11_FRAME_LOG=/var/tmp/frames.log sensor-dht11 watch --interval 2
+ *
+ * Frames from failed attempts carry the label of the attempt that succeeded.
+ * That label is the baseline's own decoding of the succeeding frame, which
+ * the log marks; it is never scored, as the baseline would be marking its
+ * own work. A read's label also stands only if the next logged read of the
+ * same pin returned the same data, so one baseline false accept does not
+ * label a whole read wrongly. What is scored is then the frames the
+ * baseline failed, and on a recorded corpus its own row is n/a.
+ *
+ * Bias that remains: reads that failed outright are not logged, so the
+ * hardest conditions are missing; reads across a change in the reading
+ * are left out with the false accepts; and frames the baseline decodes
+ * are never scored, so another decoder's false accepts on them go unseen.
+ * --generate models the GPIO polling loop instead (see
+ * pulse_classifier_bench.c), one pin per combination of oscillator drift,
+ * poll period and preemption rate, with the true data as every label. It
+ * marks no frames, so every frame is scored.
+ *
+ * Decoders:
+ *   midpoint   high vs the frame's min/max midpoint
+ *   clusters   2-means over the frame's highs, seeded from the centroids of
+ *              the same pin's last good frames
+ *   ratio      high vs the interquartile mean of the frame's lows, as
+ *              dht11_decode() decodes today (the baseline)
+ *   recovery   ratio, then on a checksum failure flip the least certain one
+ *              or two bits and take the closest plausible frame that passes
+ *
+ * Columns:
+ *   accuracy       frames decoded to their label
+ *   recovered      frames the baseline failed that this decoder got right,
+ *                  as a share of the frames the baseline failed
+ *   false-accept   frames that passed the checksum with the wrong data
+ *   frames/s/core  decode throughput on one thread, over the whole corpus
+ *
+ * Build: gcc -O2 -std=c99 -I../src -I/usr/include/ws -o decoder_bakeoff decoder_bakeoff.c \
+ *        ../src/pulse_classifier.c ../src/frame_log.c ../src/simulator.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "dht11.h"
+#include "pulse_classifier.h"
+#include "frame_log.h"
+#include "simulator.h"
+
+/* Definitions normally provided by dht11.c and dht11_core.c */
+volatile sig_atomic_t g_running = 1;
+const uint32_t retry_delays_us[] = { 50000 };
+const int num_retries = 0;
+
+uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+void log_error(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+#define DATA_BITS           40
+#define MAX_PINS            64
+
+/* Least certain bits recovery tries flipping, singly and in pairs */
+#define RECOVERY_CANDIDATES 8
+
+/* Weight of each good frame in a pin's calibrated cluster centroids */
+#define CALIBRATION_WEIGHT  0.25
+
+/* Decode each corpus at least this long to time it */
+#define MIN_TIMING_SEC      0.5
+
+/* Per-pin state carried from frame to frame, reset for each pass */
+typedef struct {
+    double centroid[MAX_PINS][2];   /* 0 and 1 high widths in us, 0 if uncalibrated */
+} decoder_state_t;
+
+typedef int (*decode_fn)(decoder_state_t *state, const logged_frame_t *frame, uint8_t data[5]);
+
+typedef struct {
+    const char *name;
+    decode_fn decode;
+} decoder_t;
+
+typedef struct {
+    int correct;
+    int false_accept;
+    int recovered;
+} tally_t;
+
+/* Why frames of a corpus are left unscored */
+typedef struct {
+    int labelling;              /* The label is the baseline's decoding of the frame */
+    int unconfirmed;            /* The pin's next read returned other data, or none */
+} excluded_t;
+
+/*
+ * Pack the last count bits of a frame, missing leading bits as zeros.
+ * Returns 0 if the checksum matches, -1 otherwise.
+ */
+static int pack_bits(const uint8_t *bits, int count, uint8_t data[5]) {
+    int missing = DATA_BITS - count;
+    int i;
+    
+    memset(data, 0, 5);
+    for (i = 0; i < count; i++) {
+        int bit = missing + i;
+        data[bit / 8] |= (uint8_t)(bits[i] << (7 - bit % 8));
+    }
+    return (uint8_t)(data[0] + data[1] + data[2] + data[3]) == data[4] ? 0 : -1;
+}
+
+/*
+ * The frame's data-bit pulses: the last 40 at most
+ */
+static const dht11_pulse_t *data_pulses(const logged_frame_t *frame, int *count) {
+    *count = frame->count > DATA_BITS ? DATA_BITS : frame->count;
+    return frame->pulses + (frame->count - *count);
+}
+
+static int decode_midpoint(decoder_state_t *state, const logged_frame_t *frame, uint8_t data[5]) {
+    (void)state;
+    return classify_pulses(frame->pulses, frame->count, CLASSIFY_THRESHOLD, data);
+}
+
+static int decode_ratio(decoder_state_t *state, const logged_frame_t *frame, uint8_t data[5]) {
+    (void)state;
+    return classify_pulses(frame->pulses, frame->count, CLASSIFY_RATIO, data);
+}
+
+/*
+ * Split the highs into two clusters, starting from the pin's calibrated
+ * centroids, and decide each bit by the nearer one
+ */
+static int decode_clusters(decoder_state_t *state, const logged_frame_t *frame, uint8_t data[5]) {
+    double *calibrated = state->centroid[frame->pin & (MAX_PINS - 1)];
+    double c[2];
+    uint8_t bits[DATA_BITS];
+    int count;
+    const dht11_pulse_t *pulses = data_pulses(frame, &count);
+    int iter, i, k;
+    
+    if (count <= 0) {
+        return -1;
+    }
+    if (calibrated[1] > 0.0) {
+        c[0] = calibrated[0];
+        c[1] = calibrated[1];
+    } else {
+        c[0] = c[1] = pulses[0].high_us;
+        for (i = 1; i < count; i++) {
+            if (pulses[i].high_us < c[0]) c[0] = pulses[i].high_us;
+            if (pulses[i].high_us > c[1]) c[1] = pulses[i].high_us;
+        }
+    }
+    
+    for (iter = 0; iter < 8; iter++) {
+        double sum[2] = { 0.0, 0.0 };
+        int n[2] = { 0, 0 };
+        double threshold = (c[0] + c[1]) / 2.0;
+        
+        for (i = 0; i < count; i++) {
+            bits[i] = pulses[i].high_us > threshold;
+            sum[bits[i]] += pulses[i].high_us;
+            n[bits[i]]++;
+        }
+        for (k = 0; k < 2; k++) {
+            if (n[k] > 0) {
+                c[k] = sum[k] / n[k];
+            }
+        }
+        if ((c[0] + c[1]) / 2.0 == threshold) {
+            break;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        bits[i] = pulses[i].high_us > (c[0] + c[1]) / 2.0;
+    }
+    
+    if (pack_bits(bits, count, data) < 0) {
+        return -1;
+    }
+    for (k = 0; k < 2; k++) {
+        calibrated[k] = calibrated[1] > 0.0 ?
+                        calibrated[k] + CALIBRATION_WEIGHT * (c[k] - calibrated[k]) : c[k];
+    }
+    return 0;
+}
+
+/*
+ * Whether decoded data is a reading a DHT11 can give
+ */
+static int plausible(const uint8_t data[5]) {
+    return data[0] <= 100 && data[1] <= 9 && data[2] <= 60 && (data[3] & 0x7f) <= 9;
+}
+
+/*
+ * Ratio decode; on a checksum failure, flip the least certain bits
+ */
+static int decode_recovery(decoder_state_t *state, const logged_frame_t *frame, uint8_t data[5]) {
+    uint8_t bits[DATA_BITS];
+    uint32_t margin[DATA_BITS];
+    int order[DATA_BITS];
+    uint16_t lows[DATA_BITS];
+    uint32_t sum = 0, reference, best_margin;
+    uint8_t trial[5];
+    int count, num_order;
+    const dht11_pulse_t *pulses = data_pulses(frame, &count);
+    int i, j, k;
+    
+    (void)state;
+    if (count <= 0) {
+        memset(data, 0, 5);
+        return -1;
+    }
+    
+    /* Same reference as classify_pulses(): interquartile mean of the lows */
+    for (i = 0; i < count; i++) {
+        uint16_t v = pulses[i].low_us;
+        for (j = i; j > 0 && lows[j - 1] > v; j--) {
+            lows[j] = lows[j - 1];
+        }
+        lows[j] = v;
+    }
+    for (i = count / 4; i < count - count / 4; i++) {
+        sum += lows[i];
+    }
+    reference = sum * 256 / (uint32_t)(count - 2 * (count / 4)) * PULSE_RATIO_THRESHOLD_PCT / 100;
+    
+    for (i = 0; i < count; i++) {
+        uint32_t scaled = (uint32_t)pulses[i].high_us * 256;
+        bits[i] = scaled > reference;
+        margin[i] = scaled > reference ? scaled - reference : reference - scaled;
+    }
+    if (pack_bits(bits, count, data) == 0) {
+        return 0;
+    }
+    
+    /* The least certain bits, nearest the threshold first */
+    for (i = 0; i < count; i++) {
+        for (k = i; k > 0 && margin[order[k - 1]] > margin[i]; k--) {
+            order[k] = order[k - 1];
+        }
+        order[k] = i;
+    }
+    num_order = count < RECOVERY_CANDIDATES ? count : RECOVERY_CANDIDATES;
+    
+    /* One flip if any will do, else two; the smallest total margin wins */
+    best_margin = UINT32_MAX;
+    for (i = 0; i < num_order; i++) {
+        bits[order[i]] ^= 1;
+        if (pack_bits(bits, count, trial) == 0 && plausible(trial) &&
+            margin[order[i]] < best_margin) {
+            best_margin = margin[order[i]];
+            memcpy(data, trial, 5);
+        }
+        bits[order[i]] ^= 1;
+    }
+    for (i = 0; best_margin == UINT32_MAX && i < num_order; i++) {
+        for (j = i + 1; j < num_order; j++) {
+            bits[order[i]] ^= 1;
+            bits[order[j]] ^= 1;
+            if (pack_bits(bits, count, trial) == 0 && plausible(trial) &&
+                margin[order[i]] + margin[order[j]] < best_margin) {
+                best_margin = margin[order[i]] + margin[order[j]];
+                memcpy(data, trial, 5);
+            }
+            bits[order[i]] ^= 1;
+            bits[order[j]] ^= 1;
+        }
+    }
+    return best_margin == UINT32_MAX ? -1 : 0;
+}
+
+static const decoder_t DECODERS[] = {
+    { "midpoint", decode_midpoint },
+    { "clusters", decode_clusters },
+    { "ratio", decode_ratio },
+    { "recovery", decode_recovery },
+};
+#define NUM_DECODERS    (int)(sizeof(DECODERS) / sizeof(DECODERS[0]))
+#define BASELINE        2
+
+/* dht11_decode() gives up on frames shorter than this */
+#define MIN_PULSES      38
+
+static int decode(int d, decoder_state_t *state, const logged_frame_t *frame, uint8_t data[5]) {
+    if (frame->count < MIN_PULSES) {
+        memset(data, 0, 5);
+        return -1;
+    }
+    return DECODERS[d].decode(state, frame, data);
+}
+
+/*
+ * Append every frame in path to the corpus.
+ * Returns 0 on success, -1 on error.
+ */
+static int load_corpus(const char *path, logged_frame_t **frames, int *count, int *cap) {
+    FILE *fp = fopen(path, "r");
+    char line[1024];
+    int line_no = 0;
+    
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        int parsed;
+        
+        line_no++;
+        if (*count == *cap) {
+            int grown_cap = *cap ? *cap * 2 : 1024;
+            logged_frame_t *grown = realloc(*frames, (size_t)grown_cap * sizeof(**frames));
+            if (!grown) {
+                fclose(fp);
+                return -1;
+            }
+            *frames = grown;
+            *cap = grown_cap;
+        }
+        parsed = frame_log_parse(line, &(*frames)[*count]);
+        if (parsed < 0) {
+            fprintf(stderr, "%s:%d: not a frame\n", path, line_no);
+        } else if (parsed > 0) {
+            (*count)++;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static double thread_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Mark the frames to score: not labelling frames, and only from reads whose
+ * label the pin's next read confirmed. A read is its labelling frame and
+ * the unmarked frames just before it, as frame_log_commit() writes them.
+ */
+static void select_frames(const logged_frame_t *frames, int count, char *scored,
+                          excluded_t *excluded) {
+    uint8_t next_label[MAX_PINS][5];
+    char has_next[MAX_PINS];
+    int confirmed = 1;          /* Frames after the last marked one, or an unmarked corpus */
+    int i;
+    
+    memset(has_next, 0, sizeof(has_next));
+    memset(excluded, 0, sizeof(*excluded));
+    for (i = count - 1; i >= 0; i--) {
+        int pin = frames[i].pin & (MAX_PINS - 1);
+        
+        if (frames[i].labelling) {
+            confirmed = has_next[pin] && memcmp(next_label[pin], frames[i].label, 5) == 0;
+            memcpy(next_label[pin], frames[i].label, 5);
+            has_next[pin] = 1;
+            scored[i] = 0;
+            excluded->labelling++;
+            continue;
+        }
+        scored[i] = (char)confirmed;
+        excluded->unconfirmed += !confirmed;
+    }
+}
+
+/*
+ * Score each decoder on the corpus and time it
+ */
+static void bakeoff(const logged_frame_t *frames, int count, int num_files) {
+    uint8_t (*baseline)[5] = malloc((size_t)count * 5);
+    char *baseline_ok = malloc((size_t)count);
+    char *scored = malloc((size_t)count);
+    decoder_state_t *state = malloc(sizeof(*state));
+    excluded_t excluded;
+    int num_scored = 0;
+    int baseline_failed = 0;
+    int d, i;
+    
+    if (!baseline || !baseline_ok || !scored || !state) {
+        free(baseline);
+        free(baseline_ok);
+        free(scored);
+        free(state);
+        return;
+    }
+    
+    select_frames(frames, count, scored, &excluded);
+    memset(state, 0, sizeof(*state));
+    for (i = 0; i < count; i++) {
+        baseline_ok[i] = decode(BASELINE, state, &frames[i], baseline[i]) == 0 &&
+                         memcmp(baseline[i], frames[i].label, 5) == 0;
+        num_scored += scored[i];
+        baseline_failed += scored[i] && !baseline_ok[i];
+    }
+    
+    printf("%d frames from %d corpus file(s), baseline %s\n", count, num_files,
+           DECODERS[BASELINE].name);
+    if (excluded.labelling > 0) {
+        printf("%d labelling frames and %d frames of unconfirmed reads left out, %d scored\n",
+               excluded.labelling, excluded.unconfirmed, num_scored);
+    }
+    if (num_scored == 0) {
+        free(baseline);
+        free(baseline_ok);
+        free(scored);
+        free(state);
+        return;
+    }
+    printf("%-10s %10s %11s %14s %15s\n", "decoder", "accuracy%", "recovered%", "false-accept%",
+           "frames/s/core");
+    for (d = 0; d < NUM_DECODERS; d++) {
+        tally_t tally;
+        uint8_t data[5];
+        double start, elapsed;
+        long decoded = 0;
+        
+        memset(&tally, 0, sizeof(tally));
+        memset(state, 0, sizeof(*state));
+        /* Every frame is decoded, in order, so clusters calibrates as it would live */
+        for (i = 0; i < count; i++) {
+            if (decode(d, state, &frames[i], data) != 0 || !scored[i]) {
+                continue;
+            }
+            if (memcmp(data, frames[i].label, 5) != 0) {
+                tally.false_accept++;
+                continue;
+            }
+            tally.correct++;
+            tally.recovered += !baseline_ok[i];
+        }
+        
+        start = thread_seconds();
+        do {
+            memset(state, 0, sizeof(*state));
+            for (i = 0; i < count; i++) {
+                decode(d, state, &frames[i], data);
+            }
+            decoded += count;
+            elapsed = thread_seconds() - start;
+        } while (elapsed < MIN_TIMING_SEC);
+        
+        /* On a recorded corpus the baseline failed every scored frame by construction */
+        if (d == BASELINE && excluded.labelling > 0) {
+            printf("%-10s %10s %11s %14s", DECODERS[d].name, "n/a", "-", "n/a");
+        } else {
+            printf("%-10s %10.2f", DECODERS[d].name, 100.0 * tally.correct / num_scored);
+            if (d == BASELINE || baseline_failed == 0) {
+                printf(" %11s", "-");
+            } else {
+                printf(" %11.1f", 100.0 * tally.recovered / baseline_failed);
+            }
+            printf(" %14.3f", 100.0 * tally.false_accept / num_scored);
+        }
+        printf(" %15.0f\n", decoded / elapsed);
+    }
+    
+    free(baseline);
+    free(baseline_ok);
+    free(scored);
+    free(state);
+}
+
+/*
+ * Modelled polling loop, as in pulse_classifier_bench.c
+ */
+static const double DRIFTS[] = { 0.75, 1.0, 1.25 };
+static const double POLL_US[] = { 2.0, 8.0, 16.0 };
+static const double PREEMPT_RATES[] = { 0.0, 0.02 };
+
+#define PULSE_JITTER    0.1
+#define PREEMPT_MIN_US  20.0
+#define PREEMPT_MAX_US  120.0
+
+/* Share of frames whose first bit is lost to a late start */
+#define LATE_START_RATE 0.03
+
+static double sensor_us(simulator_t *sim, double nominal, double drift) {
+    return nominal * drift * (1.0 + PULSE_JITTER * (2.0 * simulator_uniform(sim) - 1.0));
+}
+
+static double detect(simulator_t *sim, double t_us, double poll_us, double preempt_rate,
+                     double *last) {
+    double seen = t_us + poll_us * simulator_uniform(sim);
+    
+    if (simulator_uniform(sim) < preempt_rate) {
+        seen += PREEMPT_MIN_US + (PREEMPT_MAX_US - PREEMPT_MIN_US) * simulator_uniform(sim);
+    }
+    if (seen < *last) {
+        seen = *last;
+    }
+    *last = seen;
+    return seen;
+}
+
+static void model_frame(simulator_t *sim, double drift, double poll_us, double preempt_rate,
+                        logged_frame_t *frame) {
+    double t = 0.0, last = 0.0;
+    double fall = detect(sim, t, poll_us, preempt_rate, &last);
+    int first = simulator_uniform(sim) < LATE_START_RATE;
+    int b;
+    
+    frame->count = 0;
+    for (b = 0; b < DATA_BITS; b++) {
+        int one = (frame->label[b / 8] >> (7 - b % 8)) & 1;
+        double rise, next_fall;
+        
+        t += sensor_us(sim, 50.0, drift);
+        rise = detect(sim, t, poll_us, preempt_rate, &last);
+        t += sensor_us(sim, one ? 70.0 : 27.0, drift);
+        next_fall = detect(sim, t, poll_us, preempt_rate, &last);
+        
+        if (b >= first) {
+            frame->pulses[frame->count].low_us = (uint16_t)(rise - fall + 0.5);
+            frame->pulses[frame->count].high_us = (uint16_t)(next_fall - rise + 0.5);
+            frame->count++;
+        }
+        fall = next_fall;
+    }
+}
+
+/*
+ * Write a modelled corpus, one pin per polling condition
+ */
+static void generate(int frames) {
+    int conditions = (int)(sizeof(DRIFTS) / sizeof(DRIFTS[0]) *
+                           sizeof(POLL_US) / sizeof(POLL_US[0]) *
+                           sizeof(PREEMPT_RATES) / sizeof(PREEMPT_RATES[0]));
+    size_t d, p, q;
+    int pin = 2;
+    int i;
+    
+    for (d = 0; d < sizeof(DRIFTS) / sizeof(DRIFTS[0]); d++) {
+        for (p = 0; p < sizeof(POLL_US) / sizeof(POLL_US[0]); p++) {
+            for (q = 0; q < sizeof(PREEMPT_RATES) / sizeof(PREEMPT_RATES[0]); q++) {
+                simulator_t sim;
+                
+                simulator_init(&sim, (uint64_t)pin, 0.0);
+                printf("# pin %d: drift %.2f, poll %.0f us, preempt %.2f\n", pin, DRIFTS[d],
+                       POLL_US[p], PREEMPT_RATES[q]);
+                for (i = 0; i < frames / conditions; i++) {
+                    sensor_reading_t reading;
+                    sim_cost_t cost;
+                    logged_frame_t frame;
+                    
+                    simulator_read(&sim, pin, &reading, &cost);
+                    memcpy(frame.label, reading.raw, sizeof(frame.label));
+                    frame.labelling = false;
+                    frame.pin = pin;
+                    model_frame(&sim, DRIFTS[d], POLL_US[p], PREEMPT_RATES[q], &frame);
+                    frame_log_write(stdout, &frame);
+                }
+                pin++;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    logged_frame_t *frames = NULL;
+    int count = 0, cap = 0;
+    int i;
+    
+    if (argc > 1 && strcmp(argv[1], "--generate") == 0) {
+        generate(argc > 2 ? atoi(argv[2]) : 18000);
+        return 0;
+    }
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s CORPUS... | --generate [frames]\n", argv[0]);
+        return 1;
+    }
+    
+    for (i = 1; i < argc; i++) {
+        if (load_corpus(argv[i], &frames, &count, &cap) < 0) {
+            free(frames);
+            return 1;
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "No frames in corpus\n");
+        free(frames);
+        return 1;
+    }
+    bakeoff(frames, count, argc - 1);
+    free(frames);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * mcu_emulator - Emulate a DHT11 offload microcontroller on a pseudo-terminal
+ * Answers MCU_MSG_READ requests the way the firmware would, including the
+ * bus time of the read and its own retries, so the serial backend can be
+ * developed and benchmarked without hardware.
+ * Usage: mcu_emulator [fail_rate] [temperature] [humidity]
+ * Prints the pty path to use as the sensor's "device", then serves until killed.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+
+#include "../src/mcu_protocol.h"
+
+/* Emulated sensor timing (microseconds), matching read_dht11() */
+#define START_SIGNAL_US     20000   /* Host pulls the line low for 20ms */
+#define FRAME_US            4200    /* Response and 40 data bits */
+#define RETRY_DELAY_US      100000  /* Firmware waits between attempts */
+#define MAX_ATTEMPTS        4
+
+static volatile sig_atomic_t g_running = 1;
+
+static void stop_handler(int sig) {
+    (void)sig;
+    g_running = 0;
+}
+
+/*
+ * Emulated MCU clock: microseconds since boot, wrapping at 32 bits
+ */
+static uint32_t mcu_clock_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL);
+}
+
+static void sleep_us(uint32_t us) {
+    struct timespec ts = { us / 1000000, (long)(us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR && g_running) {
+    }
+}
+
+/*
+ * Perform one emulated read, filling resp as the firmware would
+ */
+static uint8_t emulate_read(uint8_t pin, double fail_rate, double temperature, double humidity,
+                            mcu_response_t *resp) {
+    int attempt;
+    
+    memset(resp, 0, sizeof(*resp));
+    resp->pin = pin;
+    
+    for (attempt = 1; attempt <= MAX_ATTEMPTS; attempt++) {
+        resp->mcu_time_us = mcu_clock_us();
+        resp->attempts = (uint8_t)attempt;
+        sleep_us(START_SIGNAL_US + FRAME_US);
+        
+        if ((double)rand() / RAND_MAX >= fail_rate) {
+            int t10 = (int)(temperature * 10.0 + (temperature < 0 ? -0.5 : 0.5));
+            int h10 = (int)(humidity * 10.0 + 0.5);
+            int magnitude = t10 < 0 ? -t10 : t10;
+            
+            /* As a DHT11 sends it: magnitude, with the sign in bit 7 of the tenths */
+            resp->frame[0] = (uint8_t)(h10 / 10);
+            resp->frame[1] = (uint8_t)(h10 % 10);
+            resp->frame[2] = (uint8_t)(magnitude / 10);
+            resp->frame[3] = (uint8_t)(magnitude % 10 | (t10 < 0 ? 0x80 : 0));
+            resp->frame[4] = (uint8_t)(resp->frame[0] + resp->frame[1] + resp->frame[2] + resp->frame[3]);
+            resp->temperature_x10 = (int16_t)t10;
+            resp->humidity_x10 = (uint16_t)h10;
+            return 0;
+        }
+        if (attempt < MAX_ATTEMPTS) {
+            sleep_us(RETRY_DELAY_US);
+        }
+    }
+    resp->error = MCU_ERR_TIMEOUT;
+    return MCU_ERR_TIMEOUT;
+}
+
+int main(int argc, char *argv[]) {
+    double fail_rate = argc > 1 ? atof(argv[1]) : 0.2;
+    double temperature = argc > 2 ? atof(argv[2]) : 21.5;
+    double humidity = argc > 3 ? atof(argv[3]) : 45.0;
+    struct termios tio;
+    struct sigaction sa;
+    mcu_parser_t parser;
+    mcu_msg_t msg;
+    uint8_t buf[64];
+    uint8_t out[MCU_FRAME_MAX];
+    unsigned long requests = 0;
+    int master;
+    
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    
+    /* Raw mode on the master side too, so frames pass through untouched */
+    if (tcgetattr(master, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(master, TCSANOW, &tio);
+    }
+    
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    srand((unsigned)time(NULL));
+    printf("%s\n", ptsname(master));
+    fflush(stdout);
+    
+    mcu_parser_init(&parser);
+    while (g_running) {
+        ssize_t n = read(master, buf, sizeof(buf));
+        ssize_t i;
+        
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            /* EIO until a host opens the slave side */
+            sleep_us(10000);
+            continue;
+        }
+        
+        for (i = 0; i < n; i++) {
+            mcu_response_t resp;
+            uint8_t type;
+            
+            if (mcu_parse_byte(&parser, buf[i], &msg) != 1 || msg.type != MCU_MSG_READ || msg.len < 2) {
+                continue;
+            }
+            requests++;
+            if (emulate_read(msg.payload[0], fail_rate, temperature, humidity, &resp) != 0) {
+                type = MCU_MSG_ERROR;
+            } else {
+                type = msg.payload[1] == MCU_MODE_DECODED ? MCU_MSG_READING : MCU_MSG_RAW;
+            }
+            mcu_build_response(&msg, type, msg.seq, &resp);
+            if (write(master, out, mcu_encode(&msg, out)) < 0) {
+                perror("write");
+            }
+        }
+    }
+    
+    fprintf(stderr, "mcu_emulator: served %lu requests\n", requests);
+    close(master);
+    return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * pulse_classifier_bench - Compare DHT11 bit classifiers on modelled and captured frames
+ * Usage: pulse_classifier_bench [frames]      modelled sweep, default 5000 frames per row
+ *        pulse_classifier_bench FILE...       classify recorded SPI captures
+ *
+ * The sweep models the GPIO polling loop in dht11_exchange(): each edge is
+ * seen up to one poll period late, and now and then much later when the
+ * reader is preempted. The sensor's oscillator runs fast or slow (drift)
+ * and every pulse varies a little on its own. A second table renders the
+ * same frames as SPI sample buffers and decodes them at a rate that is off
+ * by the drift factor, which is what a drifting sensor looks like to a
+ * fixed-rate capture. Each method is scored by frames decoded correctly
+ * and by frames that passed the checksum with wrong data.
+ *
+ * Methods: threshold  high vs the frame's min/max midpoint (the original decoder)
+ *          ratio      high vs the interquartile mean of the frame's lows
+ *          fixed48    high vs a fixed 48us
+ *          spi        fixed48, then ratio if the checksum fails (decode_samples())
+ *
+ * Build: gcc -O2 -std=c99 -I../src -I/usr/include/ws \
+ *        -o pulse_classifier_bench pulse_classifier_bench.c \
+ *        ../src/pulse_classifier.c ../src/sample_decoder.c ../src/spi_backend.c \
+ *        ../src/simulator.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdarg.h>
+
+#include "dht11.h"
+#include "pulse_classifier.h"
+#include "sample_decoder.h"
+#include "spi_backend.h"
+#include "simulator.h"
+
+/* Definitions normally provided by dht11.c and dht11_core.c */
+volatile sig_atomic_t g_running = 1;
+const uint32_t retry_delays_us[] = { 50000 };
+const int num_retries = 0;
+
+uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+float dht11_temperature(const uint8_t raw[5]) {
+    float temperature = (float)raw[2] + (float)(raw[3] & 0x7F) / 10.0f;
+    return (raw[3] & 0x80) ? -temperature : temperature;
+}
+
+void log_error(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+#define NUM_METHODS 4
+
+static const char *METHOD_NAMES[NUM_METHODS] = { "threshold", "ratio", "fixed48", "spi" };
+
+static const double DRIFTS[] = { 0.75, 1.0, 1.25 };
+static const double POLL_US[] = { 2.0, 8.0, 16.0 };
+static const double PREEMPT_RATES[] = { 0.0, 0.02 };
+static const uint32_t RATES_HZ[] = { 125000, 500000 };
+static const double SPI_JITTERS[] = { 0.2, 0.3 };
+
+/* Per-pulse variation of the sensor's own timing */
+#define PULSE_JITTER    0.1
+
+/* Preempted edge detection is late by this range */
+#define PREEMPT_MIN_US  20.0
+#define PREEMPT_MAX_US  120.0
+
+typedef struct {
+    int correct;
+    int false_accept;
+} score_t;
+
+static int classify(int method, const dht11_pulse_t *pulses, int count, uint8_t data[5]) {
+    if (method == 3) {
+        return classify_samples(pulses, count, data);
+    }
+    return classify_pulses(pulses, count, (classify_method_t)method, data);
+}
+
+static void score(score_t *s, int result, const uint8_t data[5], const uint8_t truth[5]) {
+    if (result != 0) {
+        return;
+    }
+    if (memcmp(data, truth, 5) == 0) {
+        s->correct++;
+    } else {
+        s->false_accept++;
+    }
+}
+
+/*
+ * One pulse width with the sensor's drift and its own variation
+ */
+static double sensor_us(simulator_t *sim, double nominal, double drift) {
+    return nominal * drift * (1.0 + PULSE_JITTER * (2.0 * simulator_uniform(sim) - 1.0));
+}
+
+/*
+ * When the polling loop notices an edge at t_us
+ */
+static double detect(simulator_t *sim, double t_us, double poll_us, double preempt_rate,
+                     double *last) {
+    double seen = t_us + poll_us * simulator_uniform(sim);
+    
+    if (simulator_uniform(sim) < preempt_rate) {
+        seen += PREEMPT_MIN_US + (PREEMPT_MAX_US - PREEMPT_MIN_US) * simulator_uniform(sim);
+    }
+    if (seen < *last) {
+        seen = *last;
+    }
+    *last = seen;
+    return seen;
+}
+
+/*
+ * Measure a frame the way the polling loop does
+ */
+static void model_gpio(simulator_t *sim, const uint8_t frame[5], double drift, double poll_us,
+                       double preempt_rate, dht11_pulse_t pulses[40]) {
+    double t = 0.0, last = 0.0;
+    double fall = detect(sim, t, poll_us, preempt_rate, &last);
+    int b;
+    
+    for (b = 0; b < 40; b++) {
+        int one = (frame[b / 8] >> (7 - b % 8)) & 1;
+        double rise, next_fall;
+        
+        t += sensor_us(sim, 50.0, drift);
+        rise = detect(sim, t, poll_us, preempt_rate, &last);
+        t += sensor_us(sim, one ? 70.0 : 27.0, drift);
+        next_fall = detect(sim, t, poll_us, preempt_rate, &last);
+        
+        pulses[b].low_us = (uint16_t)(rise - fall + 0.5);
+        pulses[b].high_us = (uint16_t)(next_fall - rise + 0.5);
+        fall = next_fall;
+    }
+}
+
+/*
+ * Modelled GPIO polling and drifted SPI captures
+ */
+static void sweep(int frames) {
+    size_t d, p, q, r, j;
+    int i, m;
+    
+    printf("GPIO polling model, %d frames per row (correct%% / false-accept%%)\n", frames);
+    printf("%6s %8s %8s", "drift", "poll_us", "preempt");
+    for (m = 0; m < NUM_METHODS; m++) {
+        printf(" %16s", METHOD_NAMES[m]);
+    }
+    printf("\n");
+    
+    for (d = 0; d < sizeof(DRIFTS) / sizeof(DRIFTS[0]); d++) {
+        for (p = 0; p < sizeof(POLL_US) / sizeof(POLL_US[0]); p++) {
+            for (q = 0; q < sizeof(PREEMPT_RATES) / sizeof(PREEMPT_RATES[0]); q++) {
+                score_t scores[NUM_METHODS];
+                simulator_t sim;
+                
+                memset(scores, 0, sizeof(scores));
+                simulator_init(&sim, 1 + d * 64 + p * 8 + q, 0.0);
+                for (i = 0; i < frames; i++) {
+                    sensor_reading_t reading;
+                    sim_cost_t cost;
+                    dht11_pulse_t pulses[40];
+                    uint8_t data[5];
+                    
+                    simulator_read(&sim, i % 28, &reading, &cost);
+                    model_gpio(&sim, reading.raw, DRIFTS[d], POLL_US[p], PREEMPT_RATES[q], pulses);
+                    for (m = 0; m < NUM_METHODS; m++) {
+                        score(&scores[m], classify(m, pulses, 40, data), data, reading.raw);
+                    }
+                }
+                printf("%6.2f %8.0f %8.2f", DRIFTS[d], POLL_US[p], PREEMPT_RATES[q]);
+                for (m = 0; m < NUM_METHODS; m++) {
+                    printf("     %5.1f / %4.2f", 100.0 * scores[m].correct / frames,
+                           100.0 * scores[m].false_accept / frames);
+                }
+                printf("\n");
+            }
+        }
+    }
+    
+    for (j = 0; j < sizeof(SPI_JITTERS) / sizeof(SPI_JITTERS[0]); j++) {
+        printf("\nSPI captures, %.0f%% pulse jitter, %d frames per row\n",
+               SPI_JITTERS[j] * 100, frames);
+        printf("%6s %8s", "drift", "rate_hz");
+        for (m = 0; m < NUM_METHODS; m++) {
+            printf(" %16s", METHOD_NAMES[m]);
+        }
+        printf("\n");
+        
+        for (d = 0; d < sizeof(DRIFTS) / sizeof(DRIFTS[0]); d++) {
+            for (r = 0; r < sizeof(RATES_HZ) / sizeof(RATES_HZ[0]); r++) {
+                size_t len = sample_capture_bytes(DHT11_START_LOW_US, RATES_HZ[r]);
+                uint8_t *buf = malloc(len);
+                uint32_t seen_rate = (uint32_t)(RATES_HZ[r] * DRIFTS[d]);
+                score_t scores[NUM_METHODS];
+                simulator_t sim;
+                
+                if (!buf) {
+                    return;
+                }
+                memset(scores, 0, sizeof(scores));
+                simulator_init(&sim, 7 + d * 16 + r, 0.0);
+                for (i = 0; i < frames; i++) {
+                    sensor_reading_t reading;
+                    sim_cost_t cost;
+                    dht11_pulse_t pulses[SAMPLE_MAX_PULSES];
+                    uint8_t data[5];
+                    int count;
+                    
+                    simulator_read(&sim, i % 28, &reading, &cost);
+                    synthesize_samples(reading.raw, RATES_HZ[r], SPI_JITTERS[j], &sim, buf, len);
+                    count = sample_pulses(buf, len, seen_rate, pulses, SAMPLE_MAX_PULSES);
+                    for (m = 0; m < NUM_METHODS; m++) {
+                        score(&scores[m], count < 40 ? -1 : classify(m, pulses, count, data),
+                              data, reading.raw);
+                    }
+                }
+                printf("%6.2f %8u", DRIFTS[d], RATES_HZ[r]);
+                for (m = 0; m < NUM_METHODS; m++) {
+                    printf("     %5.1f / %4.2f", 100.0 * scores[m].correct / frames,
+                           100.0 * scores[m].false_accept / frames);
+                }
+                printf("\n");
+                free(buf);
+            }
+        }
+    }
+}
+
+/*
+ * Classify each recorded capture with every method
+ */
+static int classify_files(int count, char *paths[]) {
+    int failures = 0;
+    int i, m;
+    
+    for (i = 0; i < count; i++) {
+        capture_source_t *src = capture_open_file(paths[i]);
+        dht11_pulse_t pulses[SAMPLE_MAX_PULSES];
+        char error_msg[128] = "";
+        uint8_t data[5];
+        uint8_t *buf;
+        size_t len;
+        int n;
+        
+        if (!src) {
+            failures++;
+            continue;
+        }
+        len = sample_capture_bytes(DHT11_START_LOW_US, src->rate_hz);
+        buf = malloc(len);
+        if (!buf || src->capture(src, buf, len, error_msg, sizeof(error_msg)) < 0) {
+            printf("%s: %s\n", paths[i], error_msg);
+            failures++;
+        } else {
+            n = sample_pulses(buf, len, src->rate_hz, pulses, SAMPLE_MAX_PULSES);
+            printf("%s: %u Hz, %d pulses", paths[i], src->rate_hz, n);
+            for (m = 0; m < NUM_METHODS; m++) {
+                if (n >= 40 && classify(m, pulses, n, data) == 0) {
+                    printf(", %s %02x%02x%02x%02x%02x", METHOD_NAMES[m],
+                           data[0], data[1], data[2], data[3], data[4]);
+                } else {
+                    printf(", %s failed", METHOD_NAMES[m]);
+                }
+            }
+            printf("\n");
+        }
+        free(buf);
+        capture_close(src);
+    }
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && atoi(argv[1]) <= 0) {
+        return classify_files(argc - 1, argv + 1);
+    }
+    sweep(argc > 1 ? atoi(argv[1]) : 5000);
+    return 0;
+}
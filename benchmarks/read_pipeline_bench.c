@@ -0,0 +1,194 @@
+/*
+ * read_pipeline_bench - Sweep many GPIO sensors: one at a time vs the sampler/decoder pipeline
+ * Usage: read_pipeline_bench [sensors] [fail_rate] [sweeps]
+ *
+ * The bus is modelled: each attempt sleeps through the 20ms start low, then
+ * busy-waits for the frame as the polling loop does, and fails at
+ * fail_rate. Three ways of sweeping are compared:
+ *
+ *   rt-whole   one sensor at a time, SCHED_FIFO held for the whole read
+ *              including backoff sleeps (read_dht11_until() before the split)
+ *   rt-bus     one sensor at a time, SCHED_FIFO held for the bus exchange only
+ *   pipeline   read_dht11_batch(): retries of one sensor overlap the others
+ *
+ * RT ms/read is the time a read would hold the real-time class, the figure
+ * that competes with everything else on the node.
+ *
+ * Build: gcc -O2 -std=c99 -I../src -I/usr/include/ws \
+ *        -o read_pipeline_bench read_pipeline_bench.c \
+ *        ../src/read_pipeline.c ../src/frame_log.c ../src/pressure.c \
+ *        ../src/pulse_classifier.c ../src/simulator.c -lpthread
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "dht11.h"
+#include "read_pipeline.h"
+#include "simulator.h"
+
+/* Definitions normally provided by dht11.c and dht11_core.c */
+volatile sig_atomic_t g_running = 1;
+const uint32_t retry_delays_us[] = {
+    50000, 50000,
+    100000, 100000, 100000,
+    200000, 400000, 800000, 1600000,
+    2000000, 2000000, 2000000
+};
+const int num_retries = sizeof(retry_delays_us) / sizeof(retry_delays_us[0]);
+
+uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+void log_error(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static simulator_t g_sim;
+static double g_fail_rate;
+static uint64_t g_rt_us;        /* Time spent in the modelled real-time class */
+static int g_rt_whole;          /* Charge whole reads rather than bus exchanges */
+
+/*
+ * Modelled dht11_sample(): a nominal frame after the start signal, or a
+ * frame with one bit's high squeezed to the wrong side of the threshold
+ */
+int dht11_sample(int gpio_pin, dht11_frame_t *frame, char *error_msg, size_t error_len) {
+    sensor_reading_t reading;
+    sim_cost_t cost;
+    uint64_t start;
+    int b;
+    
+    (void)error_msg;
+    (void)error_len;
+    usleep(DHT11_START_LOW_US);
+    
+    start = monotonic_us();
+    simulator_read(&g_sim, gpio_pin, &reading, &cost);
+    frame->count = 40;
+    for (b = 0; b < 40; b++) {
+        int one = (reading.raw[b / 8] >> (7 - b % 8)) & 1;
+        frame->pulses[b].low_us = 50;
+        frame->pulses[b].high_us = one ? 70 : 27;
+    }
+    if (simulator_uniform(&g_sim) < g_fail_rate) {
+        b = (int)(simulator_uniform(&g_sim) * 40);
+        frame->pulses[b].high_us = frame->pulses[b].high_us > 48 ? 27 : 70;
+    }
+    while (monotonic_us() - start < DHT11_FRAME_US) {
+    }
+    if (!g_rt_whole) {
+        g_rt_us += monotonic_us() - start;
+    }
+    return 0;
+}
+
+/* As in dht11.c */
+int dht11_decode(const dht11_frame_t *frame, sensor_reading_t *reading) {
+    uint8_t data[5];
+    
+    if (frame->count < DHT11_MIN_PULSES ||
+        classify_pulses(frame->pulses, frame->count, CLASSIFY_RATIO, data) < 0) {
+        return -1;
+    }
+    memcpy(reading->raw, data, sizeof(reading->raw));
+    reading->humidity = (float)data[0] + (float)data[1] / 10.0f;
+    reading->temperature = (float)data[2] + (float)data[3] / 10.0f;
+    reading->valid = true;
+    return 0;
+}
+
+/* The retry loop of read_dht11_until(), without pressure or busy lines */
+int read_dht11_until(int gpio_pin, sensor_reading_t *reading, uint64_t deadline_us, bool defer) {
+    uint64_t start = monotonic_us();
+    dht11_frame_t frame;
+    int attempt;
+    
+    (void)defer;
+    reading->valid = false;
+    for (attempt = 0; attempt <= num_retries; attempt++) {
+        if (dht11_sample(gpio_pin, &frame, NULL, 0) == 0 && dht11_decode(&frame, reading) == 0) {
+            break;
+        }
+        if (attempt == num_retries || monotonic_us() + retry_delays_us[attempt] >= deadline_us) {
+            break;
+        }
+        usleep(retry_delays_us[attempt]);
+    }
+    if (g_rt_whole) {
+        g_rt_us += monotonic_us() - start;
+    }
+    return reading->valid ? 0 : -1;
+}
+
+static void sweep(const char *mode, int sensors, int sweeps) {
+    sensor_config_t *configs = calloc((size_t)sensors, sizeof(*configs));
+    sensor_reading_t *readings = calloc((size_t)sensors, sizeof(*readings));
+    int *indices = calloc((size_t)sensors, sizeof(int));
+    uint64_t start, wall = 0;
+    int valid = 0;
+    int i, n;
+    
+    if (!configs || !readings || !indices) {
+        return;
+    }
+    for (i = 0; i < sensors; i++) {
+        configs[i].pin = i;
+        indices[i] = i;
+    }
+    simulator_init(&g_sim, 42, 0.0);
+    g_rt_us = 0;
+    g_rt_whole = strcmp(mode, "rt-whole") == 0;
+    
+    for (n = 0; n < sweeps; n++) {
+        start = monotonic_us();
+        if (strcmp(mode, "pipeline") == 0) {
+            read_dht11_batch(configs, indices, sensors, readings,
+                             start + DHT11_READ_DEADLINE_US, true);
+        } else {
+            for (i = 0; i < sensors; i++) {
+                read_dht11_until(i, &readings[i], start + DHT11_READ_DEADLINE_US, true);
+            }
+        }
+        wall += monotonic_us() - start;
+        for (i = 0; i < sensors; i++) {
+            valid += readings[i].valid;
+        }
+    }
+    
+    printf("%-9s %4d sensors %5.1f%% valid %9.1f ms/sweep %8.2f RT ms/read\n", mode, sensors,
+           100.0 * valid / (sensors * sweeps), wall / 1000.0 / sweeps,
+           g_rt_us / 1000.0 / (sensors * sweeps));
+    free(configs);
+    free(readings);
+    free(indices);
+}
+
+int main(int argc, char *argv[]) {
+    int sensors = argc > 1 ? atoi(argv[1]) : 8;
+    int sweeps = argc > 3 ? atoi(argv[3]) : 5;
+    
+    g_fail_rate = argc > 2 ? atof(argv[2]) : 0.3;
+    if (sensors < 1 || sweeps < 1) {
+        fprintf(stderr, "Usage: %s [sensors] [fail_rate] [sweeps]\n", argv[0]);
+        return 1;
+    }
+    sweep("rt-whole", sensors, sweeps);
+    sweep("rt-bus", sensors, sweeps);
+    sweep("pipeline", sensors, sweeps);
+    return 0;
+}
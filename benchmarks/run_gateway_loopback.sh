@@ -0,0 +1,59 @@
+#!/bin/bash
+# Run many node daemons on loopback and aggregate them with one gateway
+# Usage: ./run_gateway_loopback.sh [nodes] [seconds] [sensors_per_node]
+# Needs a built ../sensor-dht11; sensors use the simulated backend, so no
+# GPIO or root access is required
+
+set -e
+
+NODES=${1:-50}
+SECONDS_TO_RUN=${2:-20}
+SENSORS=${3:-2}
+BASE_PORT=${BASE_PORT:-17400}
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BINARY="$SCRIPT_DIR/../sensor-dht11"
+
+if [ ! -x "$BINARY" ]; then
+    echo "ERROR: $BINARY not found, run make first"
+    exit 1
+fi
+
+TMPDIR=$(mktemp -d)
+PIDS=()
+cleanup() {
+    [ ${#PIDS[@]} -gt 0 ] && kill "${PIDS[@]}" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$TMPDIR"
+}
+trap cleanup EXIT
+
+# Simulated sensors: each read takes as long as a real one, including retries
+{
+    echo "["
+    for i in $(seq 1 "$SENSORS"); do
+        [ "$i" -gt 1 ] && echo ","
+        echo "  {\"sensor_id\": \"sim$i\", \"backend\": \"sim\", \"pin\": $((i + 3))}"
+    done
+    echo "]"
+} > "$TMPDIR/dht11.json"
+
+echo "=============================================="
+echo "Gateway loopback: $NODES nodes x $SENSORS sensors, ${SECONDS_TO_RUN}s"
+echo "=============================================="
+
+for i in $(seq 0 $((NODES - 1))); do
+    SENSOR_DHT11_CONFIG="$TMPDIR/dht11.json" "$BINARY" serve --bind 127.0.0.1 \
+        --port $((BASE_PORT + i)) --interval 5 2>>"$TMPDIR/nodes.log" &
+    PIDS+=($!)
+    echo "127.0.0.1:$((BASE_PORT + i))" >> "$TMPDIR/nodes.txt"
+done
+
+# Node daemons take their first sweep before listening for long
+sleep 1
+
+"$BINARY" gateway --nodes "$TMPDIR/nodes.txt" --interval-ms 200 --depth 4 \
+    --duration "$SECONDS_TO_RUN" > "$TMPDIR/stream.jsonl" 2> "$TMPDIR/report.txt"
+
+cat "$TMPDIR/report.txt"
+echo ""
+echo "Merged stream: $(wc -l < "$TMPDIR/stream.jsonl") lines, $(wc -c < "$TMPDIR/stream.jsonl") bytes"
@@ -0,0 +1,66 @@
+#!/bin/bash
+# Benchmark the serial MCU backend against the pty MCU emulator
+# Usage: ./run_mcu_benchmark.sh [count] [fail_rate]
+# Needs a built ../sensor-dht11; no GPIO or root access is required
+
+set -e
+
+COUNT=${1:-100}
+FAIL_RATE=${2:-0.2}
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR"
+
+BINARY="$SCRIPT_DIR/../sensor-dht11"
+if [ ! -x "$BINARY" ]; then
+    echo "ERROR: $BINARY not found, run make first"
+    exit 1
+fi
+
+# Compile emulator if needed
+if [ ! -f "mcu_emulator" ] || [ "mcu_emulator.c" -nt "mcu_emulator" ] || \
+   [ "../src/mcu_protocol.c" -nt "mcu_emulator" ]; then
+    echo "Compiling MCU emulator..."
+    gcc -Wall -Wextra -O2 -std=c99 -o mcu_emulator mcu_emulator.c ../src/mcu_protocol.c
+fi
+
+TMPDIR=$(mktemp -d)
+trap 'kill $EMU_PID 2>/dev/null; rm -rf "$TMPDIR"' EXIT
+
+./mcu_emulator "$FAIL_RATE" > "$TMPDIR/pty" &
+EMU_PID=$!
+while [ ! -s "$TMPDIR/pty" ]; do
+    sleep 0.05
+done
+PTY=$(cat "$TMPDIR/pty")
+
+cat > "$TMPDIR/dht11.json" <<CONFIG
+[
+  {"sensor_id": "mcu_bench", "backend": "serial", "device": "$PTY", "pin": 4}
+]
+CONFIG
+
+echo "=============================================="
+echo "DHT11 Benchmark: serial MCU backend"
+echo "=============================================="
+echo "Reads: $COUNT, emulated attempt failure rate: $FAIL_RATE"
+echo "Emulator on: $PTY"
+echo ""
+
+FAILED=0
+TIMEFORMAT="%R %U %S"
+TIMES=$( { time for _ in $(seq "$COUNT"); do
+    SENSOR_DHT11_CONFIG="$TMPDIR/dht11.json" "$BINARY" > "$TMPDIR/out.json" || true
+    grep -q '"error":null' "$TMPDIR/out.json" || echo "fail" >> "$TMPDIR/failures"
+done; } 2>&1 )
+[ -f "$TMPDIR/failures" ] && FAILED=$(wc -l < "$TMPDIR/failures")
+
+read -r REAL USER SYS <<< "$TIMES"
+awk -v n="$COUNT" -v real="$REAL" -v user="$USER" -v sys="$SYS" -v failed="$FAILED" 'BEGIN {
+    printf "Successful reads:  %d/%d\n", n - failed, n
+    printf "Wall time per read: %.1f ms\n", real * 1000 / n
+    printf "Host CPU per read:  %.2f ms (user %.2f, sys %.2f)\n",
+           (user + sys) * 1000 / n, user * 1000 / n, sys * 1000 / n
+}'
+echo ""
+echo "Host CPU time includes process start-up; the GPIO backend spends the"
+echo "whole read busy-polling under SCHED_FIFO instead."
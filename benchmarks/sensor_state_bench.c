@@ -0,0 +1,136 @@
+/*
+ * sensor_state_bench - Scheduler tick cost: runtime state in the config structs
+ * versus the structure-of-arrays layout in src/sensor_state.c
+ * Usage: sensor_state_bench [max_sensors]
+ * Default is 100000 sensors; sizes grow by 10x from 100.
+ *
+ * Array-of-structs mode keeps next deadline, health and last reading beside
+ * each sensor_config_t, as adding them to the config struct would. A tick
+ * scans every sensor for the earliest deadline and for the sensors now due,
+ * with about 1% due per tick.
+ *
+ * Build: gcc -O2 -std=c99 -I../src -I/usr/include/ws -o sensor_state_bench sensor_state_bench.c \
+ *        ../src/sensor_state.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dht11.h"
+#include "sensor_state.h"
+
+/* Runtime state mixed into the per-sensor struct */
+typedef struct {
+    sensor_config_t config;
+    uint64_t next_due_us;
+    uint64_t read_us;
+    uint8_t failures;
+    sensor_reading_t last;
+} aos_sensor_t;
+
+/*
+ * Get current time in seconds (double precision)
+ */
+static double get_time_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int aos_due(const aos_sensor_t *sensors, int count, uint64_t now_us, int *due) {
+    int n = 0;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        due[n] = i;
+        n += sensors[i].next_due_us <= now_us;
+    }
+    return n;
+}
+
+static uint64_t aos_next_due(const aos_sensor_t *sensors, int count) {
+    uint64_t earliest = UINT64_MAX;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        earliest = sensors[i].next_due_us < earliest ? sensors[i].next_due_us : earliest;
+    }
+    return earliest;
+}
+
+/*
+ * Run ticks over count sensors in both layouts and print ns per sensor
+ */
+static void bench(int count) {
+    aos_sensor_t *aos = calloc(count, sizeof(aos_sensor_t));
+    sensor_config_t *configs = calloc(count, sizeof(sensor_config_t));
+    int *due = calloc(count, sizeof(int));
+    sensor_state_t soa;
+    uint64_t checksum = 0;
+    int ticks = (int)(20000000 / count) + 5;
+    double start, aos_sec, soa_sec;
+    int t, i;
+    
+    if (!aos || !configs || !due || sensor_state_init(&soa, configs, count, 0) < 0) {
+        fprintf(stderr, "Memory allocation failed for %d sensors\n", count);
+        free(aos);
+        free(configs);
+        free(due);
+        return;
+    }
+    
+    /* Deadlines spread over 100 ticks, so about 1% are due each tick */
+    for (i = 0; i < count; i++) {
+        uint64_t due_us = (uint64_t)(rand() % 100) * 1000;
+        aos[i].next_due_us = due_us;
+        soa.next_due_us[i] = due_us;
+    }
+    
+    start = get_time_sec();
+    for (t = 0; t < ticks; t++) {
+        uint64_t now_us = (uint64_t)(t % 100) * 1000;
+        checksum += aos_next_due(aos, count);
+        checksum += (uint64_t)aos_due(aos, count, now_us, due);
+    }
+    aos_sec = get_time_sec() - start;
+    
+    start = get_time_sec();
+    for (t = 0; t < ticks; t++) {
+        uint64_t now_us = (uint64_t)(t % 100) * 1000;
+        checksum -= sensor_state_next_due(&soa);
+        checksum -= (uint64_t)sensor_state_due(&soa, now_us, due);
+    }
+    soa_sec = get_time_sec() - start;
+    
+    printf("%10d %10zu %10zu %10.3f %10.3f %8.1fx%s\n", count,
+           sizeof(aos_sensor_t) * (size_t)count / 1024,
+           sizeof(uint64_t) * (size_t)count / 1024,
+           aos_sec * 1e9 / ticks / count, soa_sec * 1e9 / ticks / count,
+           aos_sec / soa_sec, checksum == 0 ? "" : "  (MISMATCH)");
+    
+    sensor_state_free(&soa);
+    free(aos);
+    free(configs);
+    free(due);
+}
+
+int main(int argc, char *argv[]) {
+    int max_sensors = argc > 1 ? atoi(argv[1]) : 100000;
+    int count;
+    
+    if (max_sensors < 100) {
+        fprintf(stderr, "Usage: %s [max_sensors]\n", argv[0]);
+        return 1;
+    }
+    
+    printf("%10s %10s %10s %10s %10s %9s\n", "sensors", "aos_KiB", "hot_KiB",
+           "aos_ns", "soa_ns", "speedup");
+    for (count = 100; count <= max_sensors; count *= 10) {
+        bench(count);
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * spi_decoder_bench - Exercise the SPI sample-buffer decoder without a spidev
+ * Usage: spi_decoder_bench [captures]             synthetic sweep, default 2000 per cell
+ *        spi_decoder_bench FILE...                decode recorded captures
+ *        spi_decoder_bench --record DEVICE FILE   capture once from spidev to FILE
+ *
+ * The sweep renders simulator frames as sample buffers at several SPI rates
+ * and pulse-width jitter levels, and reports how many decode to the frame
+ * they were rendered from and the decode time per capture.
+ *
+ * Build: gcc -O2 -std=c99 -I../src -I/usr/include/ws -o spi_decoder_bench spi_decoder_bench.c \
+ *        ../src/sample_decoder.c ../src/pulse_classifier.c ../src/spi_backend.c \
+ *        ../src/simulator.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "dht11.h"
+#include "sample_decoder.h"
+#include "spi_backend.h"
+#include "simulator.h"
+
+/* Definitions normally provided by dht11.c and dht11_core.c */
+volatile sig_atomic_t g_running = 1;
+const uint32_t retry_delays_us[] = { 50000 };
+const int num_retries = 0;
+
+uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+float dht11_temperature(const uint8_t raw[5]) {
+    float temperature = (float)raw[2] + (float)(raw[3] & 0x7F) / 10.0f;
+    return (raw[3] & 0x80) ? -temperature : temperature;
+}
+
+void log_error(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static const uint32_t RATES_HZ[] = { 125000, 250000, 500000, 1000000 };
+static const double JITTERS[] = { 0.0, 0.1, 0.2, 0.3, 0.4 };
+
+/*
+ * Get current time in seconds (double precision)
+ */
+static double get_time_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Decode each recorded capture and print the result
+ */
+static int decode_files(int count, char *paths[]) {
+    int failures = 0;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        capture_source_t *src = capture_open_file(paths[i]);
+        char error_msg[128] = "";
+        uint8_t data[5];
+        uint8_t *buf;
+        size_t len;
+        
+        if (!src) {
+            failures++;
+            continue;
+        }
+        len = sample_capture_bytes(DHT11_START_LOW_US, src->rate_hz);
+        buf = malloc(len);
+        if (buf && src->capture(src, buf, len, error_msg, sizeof(error_msg)) >= 0 &&
+            decode_samples(buf, len, src->rate_hz, data, error_msg, sizeof(error_msg)) == 0) {
+            printf("%s: %u Hz, humidity %d.%d%%, temperature %d.%dC\n", paths[i],
+                   src->rate_hz, data[0], data[1], data[2], data[3]);
+        } else {
+            printf("%s: %u Hz, %s\n", paths[i], src->rate_hz, error_msg);
+            failures++;
+        }
+        free(buf);
+        capture_close(src);
+    }
+    return failures ? 1 : 0;
+}
+
+/*
+ * Capture one buffer from a spidev device into a file
+ */
+static int record(const char *device, const char *path) {
+    capture_source_t *src = capture_open_spidev(device, SPI_DEFAULT_RATE_HZ);
+    char error_msg[128] = "";
+    size_t len;
+    uint8_t *buf;
+    int result = 1;
+    
+    if (!src) {
+        return 1;
+    }
+    len = sample_capture_bytes(DHT11_START_LOW_US, src->rate_hz);
+    buf = malloc(len);
+    if (buf && src->capture(src, buf, len, error_msg, sizeof(error_msg)) >= 0) {
+        result = capture_write_file(path, src->rate_hz, buf, len) == 0 ? 0 : 1;
+    } else {
+        fprintf(stderr, "%s\n", error_msg);
+    }
+    free(buf);
+    capture_close(src);
+    return result;
+}
+
+/*
+ * Decode synthetic captures across rates and jitter levels
+ */
+static void sweep(int captures) {
+    size_t r, j;
+    int i;
+    
+    printf("%10s %7s %7s %9s %10s\n", "rate_hz", "jitter", "bytes", "decoded%", "ns/decode");
+    for (r = 0; r < sizeof(RATES_HZ) / sizeof(RATES_HZ[0]); r++) {
+        size_t len = sample_capture_bytes(DHT11_START_LOW_US, RATES_HZ[r]);
+        uint8_t *buf = malloc(len);
+        
+        if (!buf) {
+            return;
+        }
+        for (j = 0; j < sizeof(JITTERS) / sizeof(JITTERS[0]); j++) {
+            simulator_t sim;
+            double decode_sec = 0.0;
+            int decoded = 0;
+            
+            simulator_init(&sim, 1 + r * 16 + j, 0.0);
+            for (i = 0; i < captures; i++) {
+                sensor_reading_t reading;
+                sim_cost_t cost;
+                char error_msg[128];
+                uint8_t data[5];
+                double start;
+                
+                simulator_read(&sim, i % 28, &reading, &cost);
+                synthesize_samples(reading.raw, RATES_HZ[r], JITTERS[j], &sim, buf, len);
+                
+                start = get_time_sec();
+                if (decode_samples(buf, len, RATES_HZ[r], data, error_msg, sizeof(error_msg)) == 0 &&
+                    memcmp(data, reading.raw, 5) == 0) {
+                    decoded++;
+                }
+                decode_sec += get_time_sec() - start;
+            }
+            printf("%10u %7.2f %7zu %9.1f %10.0f\n", RATES_HZ[r], JITTERS[j], len,
+                   100.0 * decoded / captures, decode_sec * 1e9 / captures);
+        }
+        free(buf);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 4 && strcmp(argv[1], "--record") == 0) {
+        return record(argv[2], argv[3]);
+    }
+    if (argc > 1 && atoi(argv[1]) <= 0) {
+        return decode_files(argc - 1, argv + 1);
+    }
+    sweep(argc > 1 ? atoi(argv[1]) : 2000);
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * sqlite_sink_bench - Compare per-row SQLite inserts with the batched WAL sink
+ * Usage: sqlite_sink_bench [sweeps] [directory] [sweeps_per_commit]
+ * Default is 170 sweeps of 6 sensors (2040 rows) in the current directory,
+ * 10 sweeps per commit (a 30 second interval committed every 5 minutes).
+ *
+ * Run it on the SD card, not tmpfs: write amplification is measured from the
+ * write_bytes counter in /proc/self/io, which only counts bytes sent to storage.
+ *
+ * Per-row mode mirrors a script running the sqlite3 CLI once per reading:
+ * open, default rollback journal, autocommit INSERT, close.
+ * Batched mode is src/sqlite_sink.c itself, fed one sweep at a time through
+ * sqlite_sink_write() and committed every sweeps_per_commit sweeps.
+ *
+ * Build: gcc -O2 -std=c99 -I../src -I/usr/include/ws -o sqlite_sink_bench sqlite_sink_bench.c \
+ *        ../src/sqlite_sink.c -lsqlite3
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "dht11.h"
+#include "sqlite_sink.h"
+
+#define SENSORS     6
+
+/* Definitions normally provided by dht11.c */
+void log_error(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+bool sensor_selected(const sensor_config_t *config, ws_location_filter_t location_filter) {
+    (void)config;
+    (void)location_filter;
+    return true;
+}
+
+bool measurement_selected(const char *filter, const char *measurement) {
+    return !filter || strcmp(filter, measurement) == 0 || strcmp(filter, "all") == 0;
+}
+
+static sensor_config_t g_configs[SENSORS];
+static char g_sensor_ids[SENSORS][32];
+
+/*
+ * Get current time in seconds (double precision)
+ */
+static double get_time_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Bytes this process has caused to be written to storage
+ */
+static long long storage_write_bytes(void) {
+    FILE *fp = fopen("/proc/self/io", "r");
+    char line[128];
+    long long value = -1;
+    
+    if (!fp) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "write_bytes: %lld", &value) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return value;
+}
+
+/*
+ * Remove a database and its journal/WAL files
+ */
+static void remove_db(const char *path) {
+    char extra[4096];
+    
+    unlink(path);
+    snprintf(extra, sizeof(extra), "%s-journal", path);
+    unlink(extra);
+    snprintf(extra, sizeof(extra), "%s-wal", path);
+    unlink(extra);
+    snprintf(extra, sizeof(extra), "%s-shm", path);
+    unlink(extra);
+}
+
+/*
+ * One sweep of readings for all sensors
+ */
+static void fill_sweep(int sweep, sensor_reading_t *readings) {
+    int i;
+    
+    for (i = 0; i < SENSORS; i++) {
+        memset(&readings[i], 0, sizeof(readings[i]));
+        readings[i].timestamp = 1700000000 + sweep * 30;
+        readings[i].temperature = 20.0f + (float)((sweep + i) % 10);
+        readings[i].humidity = 40.0f + (float)((sweep + i) % 20);
+        readings[i].valid = true;
+    }
+}
+
+/*
+ * Logical payload of one row: the bytes a reader actually cares about
+ */
+static size_t row_payload(const char *measurement) {
+    return sizeof(long long) + strlen(g_sensor_ids[0]) + strlen(measurement) + sizeof(double);
+}
+
+/*
+ * Create the database with the sink's schema, then return it to the default
+ * rollback journal, as a database only ever written by the sqlite3 CLI would be
+ */
+static int create_rollback_db(const char *path) {
+    sqlite_sink_t *sink = sqlite_sink_open(path, 0);
+    sqlite3 *db;
+    
+    if (!sink) {
+        return -1;
+    }
+    sqlite_sink_close(sink);
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_exec(db, "PRAGMA journal_mode=DELETE", NULL, NULL, NULL);
+    sqlite3_close(db);
+    return 0;
+}
+
+static int run_per_row(const char *path, int sweeps, size_t *payload) {
+    static const char *measurements[] = {"temperature", "humidity"};
+    sensor_reading_t readings[SENSORS];
+    int n, i, m;
+    
+    if (create_rollback_db(path) < 0) {
+        return -1;
+    }
+    for (n = 0; n < sweeps; n++) {
+        fill_sweep(n, readings);
+        for (i = 0; i < SENSORS; i++) {
+            for (m = 0; m < 2; m++) {
+                sqlite3 *db;
+                char sql[256];
+                
+                if (sqlite3_open(path, &db) != SQLITE_OK) {
+                    fprintf(stderr, "Cannot open %s\n", path);
+                    sqlite3_close(db);
+                    return -1;
+                }
+                snprintf(sql, sizeof(sql),
+                         "INSERT INTO readings VALUES (%lld, '%s', '%s', %.1f, NULL)",
+                         (long long)readings[i].timestamp, g_sensor_ids[i], measurements[m],
+                         m ? readings[i].humidity : readings[i].temperature);
+                sqlite3_exec(db, sql, NULL, NULL, NULL);
+                sqlite3_close(db);
+                *payload += row_payload(measurements[m]);
+            }
+        }
+    }
+    return 0;
+}
+
+static int run_batched(const char *path, int sweeps, int sweeps_per_commit, size_t *payload) {
+    /* The interval never elapses on its own; commits are driven below */
+    sqlite_sink_t *sink = sqlite_sink_open(path, 1000000);
+    sensor_reading_t readings[SENSORS];
+    int n;
+    
+    if (!sink) {
+        return -1;
+    }
+    for (n = 0; n < sweeps; n++) {
+        fill_sweep(n, readings);
+        sqlite_sink_write(sink, g_configs, readings, SENSORS, NULL, WS_LOCATION_ALL);
+        *payload += SENSORS * (row_payload("temperature") + row_payload("humidity"));
+        if (n % sweeps_per_commit == sweeps_per_commit - 1) {
+            sqlite_sink_commit(sink);
+        }
+    }
+    sqlite_sink_close(sink);
+    return 0;
+}
+
+static void report(const char *label, int rows, double elapsed, long long written, size_t payload) {
+    printf("%-10s %8d rows  %10.0f rows/s", label, rows, rows / elapsed);
+    if (written >= 0) {
+        printf("  %10lld bytes written  %8.1f bytes/row  %7.1fx amplification",
+               written, (double)written / rows, (double)written / payload);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int sweeps = 170;
+    const char *dir = ".";
+    int sweeps_per_commit = 10;
+    char path[4096];
+    double start;
+    long long written_before;
+    size_t payload;
+    int i;
+    
+    if (argc > 1) sweeps = atoi(argv[1]);
+    if (argc > 2) dir = argv[2];
+    if (argc > 3) sweeps_per_commit = atoi(argv[3]);
+    if (sweeps <= 0 || sweeps_per_commit <= 0) {
+        fprintf(stderr, "Usage: %s [sweeps] [directory] [sweeps_per_commit]\n", argv[0]);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/sqlite_sink_bench.db", dir);
+    for (i = 0; i < SENSORS; i++) {
+        snprintf(g_sensor_ids[i], sizeof(g_sensor_ids[i]), "10000000abcdef01_dht11_%d", i);
+        g_configs[i].sensor_id = g_sensor_ids[i];
+    }
+    
+    printf("=== SQLite sink: %d sweeps of %d sensors, %d sweeps per commit ===\n",
+           sweeps, SENSORS, sweeps_per_commit);
+    
+    remove_db(path);
+    payload = 0;
+    written_before = storage_write_bytes();
+    start = get_time_sec();
+    if (run_per_row(path, sweeps, &payload) < 0) return 1;
+    report("per-row", sweeps * SENSORS * 2, get_time_sec() - start,
+           written_before < 0 ? -1 : storage_write_bytes() - written_before, payload);
+    
+    remove_db(path);
+    payload = 0;
+    written_before = storage_write_bytes();
+    start = get_time_sec();
+    if (run_batched(path, sweeps, sweeps_per_commit, &payload) < 0) return 1;
+    report("batched", sweeps * SENSORS * 2, get_time_sec() - start,
+           written_before < 0 ? -1 : storage_write_bytes() - written_before, payload);
+    
+    remove_db(path);
+    return 0;
+}
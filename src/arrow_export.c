@@ -0,0 +1,638 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Export readings stored by the SQLite sink as Apache Arrow IPC.
+ *
+ * Rows are streamed from the database into record batches of
+ * (timestamp, sensor_id, measurement, value, error) so memory use is bounded
+ * by the batch size, not the time range. The IPC metadata is FlatBuffers;
+ * the handful of tables needed here are encoded directly rather than pulling
+ * the Arrow and FlatBuffers libraries onto the node. Buffers are written in
+ * host byte order, which is little-endian on the Raspberry Pi.
+ *
+ * The default output is the Arrow IPC file format (Feather v2), which
+ * pyarrow.ipc.open_file / pyarrow.memory_map and polars.read_ipc can load
+ * without copying. The stream format is available for piping.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+#include "arrow_export.h"
+#include "dht11.h"
+
+/* Arrow format enumerations (Schema.fbs / Message.fbs) */
+#define ARROW_METADATA_V5           4
+#define ARROW_HEADER_SCHEMA         1
+#define ARROW_HEADER_RECORD_BATCH   3
+#define ARROW_TYPE_FLOATING_POINT   3
+#define ARROW_TYPE_UTF8             5
+#define ARROW_TYPE_TIMESTAMP        10
+#define ARROW_PRECISION_DOUBLE      2
+#define ARROW_TIME_UNIT_SECOND      0
+
+#define ARROW_MAGIC         "ARROW1"
+#define ARROW_CONTINUATION  0xFFFFFFFFu
+
+#define NUM_COLUMNS     5
+#define NUM_BUFFERS     13  /* 2 per fixed-width column, 3 per string column */
+
+/* Growable byte buffer; allocation failure is sticky and checked once per message */
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} bytebuf_t;
+
+/* Arrow IPC file footer block (Footer.fbs struct Block) */
+typedef struct {
+    int64_t offset;
+    int32_t metadata_length;
+    int32_t padding;
+    int64_t body_length;
+} arrow_block_t;
+
+/* One column of the record batch being accumulated */
+typedef struct {
+    bytebuf_t validity;
+    bytebuf_t offsets;  /* int32 offsets, string columns only */
+    bytebuf_t values;   /* Fixed-width values or UTF-8 bytes */
+    int64_t null_count;
+} column_t;
+
+typedef struct {
+    FILE *out;
+    uint64_t offset;        /* Bytes written so far */
+    bytebuf_t blocks;       /* arrow_block_t per record batch, for the footer */
+} arrow_writer_t;
+
+enum { COL_TIMESTAMP, COL_SENSOR_ID, COL_MEASUREMENT, COL_VALUE, COL_ERROR };
+
+/* Column names, types and nullability, in schema order */
+static const struct {
+    const char *name;
+    int type;
+    bool nullable;
+} COLUMNS[NUM_COLUMNS] = {
+    { "timestamp",   ARROW_TYPE_TIMESTAMP,      false },
+    { "sensor_id",   ARROW_TYPE_UTF8,           false },
+    { "measurement", ARROW_TYPE_UTF8,           false },
+    { "value",       ARROW_TYPE_FLOATING_POINT, true  },
+    { "error",       ARROW_TYPE_UTF8,           true  },
+};
+
+/* === Byte buffer === */
+
+static void buf_reserve(bytebuf_t *b, size_t extra) {
+    if (b->failed || b->len + extra <= b->cap) {
+        return;
+    }
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra) {
+        cap *= 2;
+    }
+    uint8_t *data = realloc(b->data, cap);
+    if (!data) {
+        b->failed = true;
+        return;
+    }
+    b->data = data;
+    b->cap = cap;
+}
+
+static void buf_append(bytebuf_t *b, const void *src, size_t n) {
+    buf_reserve(b, n);
+    if (b->failed) {
+        return;
+    }
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+}
+
+static void buf_zeros(bytebuf_t *b, size_t n) {
+    buf_reserve(b, n);
+    if (b->failed) {
+        return;
+    }
+    memset(b->data + b->len, 0, n);
+    b->len += n;
+}
+
+static void buf_pad(bytebuf_t *b, size_t align) {
+    if (b->len % align) {
+        buf_zeros(b, align - b->len % align);
+    }
+}
+
+static void buf_put32(bytebuf_t *b, size_t pos, uint32_t value) {
+    if (!b->failed) {
+        memcpy(b->data + pos, &value, sizeof(value));
+    }
+}
+
+static void buf_free(bytebuf_t *b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+/* === Minimal FlatBuffers encoder ===
+ *
+ * Objects are written front to back, so a parent table comes before its
+ * children and offset fields are patched once the child position is known.
+ * FlatBuffers offsets are unsigned and must point forward, which this order
+ * guarantees.
+ */
+
+typedef struct {
+    int size;           /* 0 = absent, otherwise 1, 2, 4 or 8 bytes */
+    uint64_t value;     /* Scalar value */
+    size_t *slot;       /* Receives the position of an offset field to patch later */
+} fb_field_t;
+
+#define FB_ABSENT           { 0, 0, NULL }
+#define FB_SCALAR(sz, v)    { (sz), (uint64_t)(v), NULL }
+#define FB_OFFSET(slot)     { 4, 0, (slot) }
+
+#define FB_MAX_FIELDS   8
+
+/*
+ * Write a vtable and table for the given fields.
+ * Returns the table position.
+ */
+static size_t fb_table(bytebuf_t *fb, const fb_field_t *fields, int n) {
+    uint16_t field_pos[FB_MAX_FIELDS];
+    uint16_t inline_size = 4;   /* soffset to vtable */
+    size_t vtable_pos, table_pos;
+    uint16_t u16;
+    int32_t soffset;
+    int i;
+    
+    for (i = 0; i < n; i++) {
+        if (!fields[i].size) {
+            field_pos[i] = 0;
+            continue;
+        }
+        inline_size = (inline_size + fields[i].size - 1) / fields[i].size * fields[i].size;
+        field_pos[i] = inline_size;
+        inline_size += fields[i].size;
+    }
+    
+    buf_pad(fb, 2);
+    vtable_pos = fb->len;
+    u16 = (uint16_t)(4 + 2 * n);
+    buf_append(fb, &u16, 2);
+    buf_append(fb, &inline_size, 2);
+    buf_append(fb, field_pos, 2 * n);
+    
+    /* Align the table to 8 so field alignment is absolute */
+    buf_pad(fb, 8);
+    table_pos = fb->len;
+    soffset = (int32_t)(table_pos - vtable_pos);
+    buf_append(fb, &soffset, 4);
+    
+    for (i = 0; i < n; i++) {
+        if (!fields[i].size) {
+            continue;
+        }
+        buf_zeros(fb, table_pos + field_pos[i] - fb->len);
+        if (fields[i].slot) {
+            *fields[i].slot = fb->len;
+        }
+        buf_append(fb, &fields[i].value, fields[i].size);
+    }
+    return table_pos;
+}
+
+/*
+ * Point the offset field at slot to target
+ */
+static void fb_patch(bytebuf_t *fb, size_t slot, size_t target) {
+    buf_put32(fb, slot, (uint32_t)(target - slot));
+}
+
+static size_t fb_string(bytebuf_t *fb, const char *s) {
+    uint32_t len = (uint32_t)strlen(s);
+    size_t pos;
+    
+    buf_pad(fb, 4);
+    pos = fb->len;
+    buf_append(fb, &len, 4);
+    buf_append(fb, s, len + 1);
+    return pos;
+}
+
+/*
+ * Start a vector whose elements are aligned to align.
+ * Returns the vector position; elements follow immediately.
+ */
+static size_t fb_vector(bytebuf_t *fb, uint32_t count, size_t align) {
+    size_t pos;
+    
+    while ((fb->len + 4) % align) {
+        buf_zeros(fb, 1);
+    }
+    pos = fb->len;
+    buf_append(fb, &count, 4);
+    return pos;
+}
+
+/*
+ * Write a Type table for a column type
+ */
+static size_t write_type(bytebuf_t *fb, int type) {
+    if (type == ARROW_TYPE_TIMESTAMP) {
+        size_t tz_slot = 0;
+        fb_field_t fields[] = { FB_SCALAR(2, ARROW_TIME_UNIT_SECOND), FB_OFFSET(&tz_slot) };
+        size_t pos = fb_table(fb, fields, 2);
+        fb_patch(fb, tz_slot, fb_string(fb, "UTC"));
+        return pos;
+    }
+    if (type == ARROW_TYPE_FLOATING_POINT) {
+        fb_field_t fields[] = { FB_SCALAR(2, ARROW_PRECISION_DOUBLE) };
+        return fb_table(fb, fields, 1);
+    }
+    return fb_table(fb, NULL, 0);   /* Utf8 has no fields */
+}
+
+/*
+ * Write the Schema table
+ */
+static size_t write_schema(bytebuf_t *fb) {
+    size_t fields_slot = 0;
+    size_t field_slots[NUM_COLUMNS];
+    fb_field_t schema[] = { FB_SCALAR(2, 0), FB_OFFSET(&fields_slot) };
+    size_t pos = fb_table(fb, schema, 2);
+    size_t vec;
+    int i;
+    
+    vec = fb_vector(fb, NUM_COLUMNS, 4);
+    fb_patch(fb, fields_slot, vec);
+    for (i = 0; i < NUM_COLUMNS; i++) {
+        field_slots[i] = fb->len;
+        buf_zeros(fb, 4);
+    }
+    
+    for (i = 0; i < NUM_COLUMNS; i++) {
+        size_t name_slot = 0, type_slot = 0, children_slot = 0;
+        fb_field_t field[] = {
+            FB_OFFSET(&name_slot),
+            FB_SCALAR(1, COLUMNS[i].nullable),
+            FB_SCALAR(1, COLUMNS[i].type),
+            FB_OFFSET(&type_slot),
+            FB_ABSENT,
+            FB_OFFSET(&children_slot),
+        };
+        fb_patch(fb, field_slots[i], fb_table(fb, field, 6));
+        fb_patch(fb, name_slot, fb_string(fb, COLUMNS[i].name));
+        fb_patch(fb, type_slot, write_type(fb, COLUMNS[i].type));
+        fb_patch(fb, children_slot, fb_vector(fb, 0, 4));
+    }
+    return pos;
+}
+
+/*
+ * Start a Message flatbuffer with the given header type.
+ * Returns the slot to patch with the header table position.
+ */
+static size_t begin_message(bytebuf_t *fb, int header_type, int64_t body_length) {
+    size_t header_slot = 0;
+    fb_field_t message[] = {
+        FB_SCALAR(2, ARROW_METADATA_V5),
+        FB_SCALAR(1, header_type),
+        FB_OFFSET(&header_slot),
+        FB_SCALAR(8, body_length),
+    };
+    
+    fb->len = 0;
+    buf_zeros(fb, 4);   /* Root offset */
+    fb_patch(fb, 0, fb_table(fb, message, 4));
+    return header_slot;
+}
+
+/* === Output === */
+
+static int write_bytes(arrow_writer_t *w, const void *data, size_t len) {
+    if (len && fwrite(data, 1, len, w->out) != len) {
+        return -1;
+    }
+    w->offset += len;
+    return 0;
+}
+
+/*
+ * Write an encapsulated message: continuation marker, metadata length,
+ * metadata padded to 8 bytes, then the body.
+ */
+static int write_message(arrow_writer_t *w, bytebuf_t *meta, const bytebuf_t *body,
+                         arrow_block_t *block) {
+    uint32_t prefix[2];
+    
+    buf_pad(meta, 8);
+    if (meta->failed || (body && body->failed)) {
+        log_error("Arrow export: out of memory");
+        return -1;
+    }
+    
+    prefix[0] = ARROW_CONTINUATION;
+    prefix[1] = (uint32_t)meta->len;
+    if (block) {
+        block->offset = (int64_t)w->offset;
+        block->metadata_length = (int32_t)(sizeof(prefix) + meta->len);
+        block->padding = 0;
+        block->body_length = body ? (int64_t)body->len : 0;
+    }
+    
+    if (write_bytes(w, prefix, sizeof(prefix)) < 0 ||
+        write_bytes(w, meta->data, meta->len) < 0 ||
+        (body && write_bytes(w, body->data, body->len) < 0)) {
+        log_error("Arrow export: write failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* === Record batches === */
+
+static void column_reset(column_t *col) {
+    int32_t zero = 0;
+    
+    col->validity.len = 0;
+    col->offsets.len = 0;
+    col->values.len = 0;
+    col->null_count = 0;
+    buf_append(&col->offsets, &zero, 4);
+}
+
+static void column_free(column_t *col) {
+    buf_free(&col->validity);
+    buf_free(&col->offsets);
+    buf_free(&col->values);
+}
+
+static void column_set_valid(column_t *col, int64_t row, bool valid) {
+    if ((size_t)(row / 8) >= col->validity.len) {
+        buf_zeros(&col->validity, 1);
+    }
+    if (col->validity.failed) {
+        return;
+    }
+    if (valid) {
+        col->validity.data[row / 8] |= (uint8_t)(1u << (row % 8));
+    } else {
+        col->null_count++;
+    }
+}
+
+static void column_append_string(column_t *col, int64_t row, const unsigned char *s) {
+    int32_t end;
+    
+    column_set_valid(col, row, s != NULL);
+    if (s) {
+        buf_append(&col->values, s, strlen((const char *)s));
+    }
+    end = (int32_t)col->values.len;
+    buf_append(&col->offsets, &end, 4);
+}
+
+/*
+ * Append one buffer to the batch body and record its position
+ */
+static void body_add(bytebuf_t *body, bytebuf_t *buffers, const bytebuf_t *src, bool present) {
+    int64_t entry[2];
+    
+    entry[0] = (int64_t)body->len;
+    entry[1] = present ? (int64_t)src->len : 0;
+    if (present) {
+        buf_append(body, src->data, src->len);
+        buf_pad(body, 8);
+    }
+    buf_append(buffers, entry, sizeof(entry));
+}
+
+/*
+ * Write the accumulated columns as one RecordBatch message
+ */
+static int write_batch(arrow_writer_t *w, column_t *cols, int64_t rows) {
+    bytebuf_t meta = {0}, body = {0}, nodes = {0}, buffers = {0};
+    arrow_block_t block;
+    size_t header_slot, nodes_slot = 0, buffers_slot = 0, vec;
+    int i, result;
+    
+    for (i = 0; i < NUM_COLUMNS; i++) {
+        int64_t node[2] = { rows, cols[i].null_count };
+        buf_append(&nodes, node, sizeof(node));
+        
+        /* Validity bitmap may be omitted when there are no nulls */
+        body_add(&body, &buffers, &cols[i].validity, cols[i].null_count > 0);
+        if (COLUMNS[i].type == ARROW_TYPE_UTF8) {
+            body_add(&body, &buffers, &cols[i].offsets, true);
+        }
+        body_add(&body, &buffers, &cols[i].values, true);
+    }
+    
+    header_slot = begin_message(&meta, ARROW_HEADER_RECORD_BATCH, (int64_t)body.len);
+    {
+        fb_field_t batch[] = {
+            FB_SCALAR(8, rows),
+            FB_OFFSET(&nodes_slot),
+            FB_OFFSET(&buffers_slot),
+        };
+        fb_patch(&meta, header_slot, fb_table(&meta, batch, 3));
+    }
+    vec = fb_vector(&meta, NUM_COLUMNS, 8);
+    buf_append(&meta, nodes.data, nodes.len);
+    fb_patch(&meta, nodes_slot, vec);
+    vec = fb_vector(&meta, NUM_BUFFERS, 8);
+    buf_append(&meta, buffers.data, buffers.len);
+    fb_patch(&meta, buffers_slot, vec);
+    
+    result = (nodes.failed || buffers.failed) ? -1 : write_message(w, &meta, &body, &block);
+    if (result == 0) {
+        buf_append(&w->blocks, &block, sizeof(block));
+    }
+    
+    buf_free(&meta);
+    buf_free(&body);
+    buf_free(&nodes);
+    buf_free(&buffers);
+    return result;
+}
+
+/*
+ * Write the end-of-stream marker and, for the file format, the footer
+ */
+static int write_trailer(arrow_writer_t *w, bool stream) {
+    static const uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+    bytebuf_t fb = {0};
+    size_t schema_slot = 0, batches_slot = 0, vec;
+    uint32_t footer_len;
+    int result = 0;
+    
+    if (write_bytes(w, eos, sizeof(eos)) < 0) {
+        return -1;
+    }
+    if (stream) {
+        return 0;
+    }
+    
+    {
+        fb_field_t footer[] = {
+            FB_SCALAR(2, ARROW_METADATA_V5),
+            FB_OFFSET(&schema_slot),
+            FB_ABSENT,
+            FB_OFFSET(&batches_slot),
+        };
+        buf_zeros(&fb, 4);
+        fb_patch(&fb, 0, fb_table(&fb, footer, 4));
+    }
+    fb_patch(&fb, schema_slot, write_schema(&fb));
+    vec = fb_vector(&fb, (uint32_t)(w->blocks.len / sizeof(arrow_block_t)), 8);
+    buf_append(&fb, w->blocks.data, w->blocks.len);
+    fb_patch(&fb, batches_slot, vec);
+    buf_pad(&fb, 8);
+    
+    footer_len = (uint32_t)fb.len;
+    if (fb.failed || w->blocks.failed ||
+        write_bytes(w, fb.data, fb.len) < 0 ||
+        write_bytes(w, &footer_len, sizeof(footer_len)) < 0 ||
+        write_bytes(w, ARROW_MAGIC, 6) < 0) {
+        log_error("Arrow export: write failed");
+        result = -1;
+    }
+    buf_free(&fb);
+    return result;
+}
+
+/*
+ * Prepare the range query, with one placeholder per requested sensor
+ */
+static sqlite3_stmt *prepare_query(sqlite3 *db, const arrow_export_opts_t *opts) {
+    sqlite3_stmt *stmt = NULL;
+    size_t sql_len = 256 + (size_t)opts->sensor_id_count * 4;
+    char *sql = malloc(sql_len);
+    int i;
+    
+    if (!sql) {
+        return NULL;
+    }
+    strcpy(sql, "SELECT timestamp, sensor_id, measurement, value, error FROM readings"
+                " WHERE timestamp >= ?1 AND timestamp < ?2");
+    if (opts->sensor_ids && opts->sensor_id_count > 0) {
+        strcat(sql, " AND sensor_id IN (");
+        for (i = 0; i < opts->sensor_id_count; i++) {
+            strcat(sql, i ? ",?" : "?");
+        }
+        strcat(sql, ")");
+    }
+    strcat(sql, " ORDER BY timestamp");
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("SQLite error: %s", sqlite3_errmsg(db));
+        free(sql);
+        return NULL;
+    }
+    free(sql);
+    
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)opts->from);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)opts->to);
+    for (i = 0; opts->sensor_ids && i < opts->sensor_id_count; i++) {
+        sqlite3_bind_text(stmt, 3 + i, opts->sensor_ids[i], -1, SQLITE_STATIC);
+    }
+    return stmt;
+}
+
+/*
+ * Export readings from the SQLite database at db_path to out.
+ * Returns 0 on success, -1 on error.
+ */
+int arrow_export(const char *db_path, FILE *out, const arrow_export_opts_t *opts) {
+    arrow_writer_t w = { out, 0, {0} };
+    column_t cols[NUM_COLUMNS];
+    bytebuf_t meta = {0};
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt;
+    size_t header_slot;
+    int64_t rows = 0;
+    int rc, i, result = -1;
+    
+    memset(cols, 0, sizeof(cols));
+    
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        log_error("Cannot open SQLite database %s: %s", db_path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    
+    stmt = prepare_query(db, opts);
+    if (!stmt) {
+        sqlite3_close(db);
+        return -1;
+    }
+    
+    for (i = 0; i < NUM_COLUMNS; i++) {
+        column_reset(&cols[i]);
+    }
+    
+    /* Magic is only part of the file format */
+    if (!opts->stream && write_bytes(&w, ARROW_MAGIC "\0\0", 8) < 0) {
+        log_error("Arrow export: write failed");
+        goto done;
+    }
+    
+    header_slot = begin_message(&meta, ARROW_HEADER_SCHEMA, 0);
+    fb_patch(&meta, header_slot, write_schema(&meta));
+    if (write_message(&w, &meta, NULL, NULL) < 0) {
+        goto done;
+    }
+    
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t timestamp = sqlite3_column_int64(stmt, 0);
+        double value = sqlite3_column_double(stmt, 3);
+        bool has_value = sqlite3_column_type(stmt, 3) != SQLITE_NULL;
+        
+        buf_append(&cols[COL_TIMESTAMP].values, &timestamp, sizeof(timestamp));
+        column_append_string(&cols[COL_SENSOR_ID], rows, sqlite3_column_text(stmt, 1));
+        column_append_string(&cols[COL_MEASUREMENT], rows, sqlite3_column_text(stmt, 2));
+        column_set_valid(&cols[COL_VALUE], rows, has_value);
+        buf_append(&cols[COL_VALUE].values, &value, sizeof(value));
+        column_append_string(&cols[COL_ERROR], rows, sqlite3_column_text(stmt, 4));
+        rows++;
+        
+        if (rows == opts->batch_rows) {
+            if (write_batch(&w, cols, rows) < 0) {
+                goto done;
+            }
+            for (i = 0; i < NUM_COLUMNS; i++) {
+                column_reset(&cols[i]);
+            }
+            rows = 0;
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        log_error("SQLite error: %s", sqlite3_errmsg(db));
+        goto done;
+    }
+    
+    if ((rows > 0 && write_batch(&w, cols, rows) < 0) || write_trailer(&w, opts->stream) < 0) {
+        goto done;
+    }
+    result = fflush(out) == 0 ? 0 : -1;
+
+done:
+    for (i = 0; i < NUM_COLUMNS; i++) {
+        column_free(&cols[i]);
+    }
+    buf_free(&meta);
+    buf_free(&w.blocks);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return result;
+}
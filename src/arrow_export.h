@@ -0,0 +1,30 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Export stored readings as Apache Arrow IPC record batches
+ */
+
+#ifndef ARROW_EXPORT_H
+#define ARROW_EXPORT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Default rows per record batch */
+#define ARROW_DEFAULT_BATCH_ROWS  65536
+
+/* Export query: rows with from <= timestamp < to, optionally limited to sensor_ids */
+typedef struct {
+    time_t from;
+    time_t to;
+    const char **sensor_ids;    /* NULL for all sensors */
+    int sensor_id_count;
+    int batch_rows;
+    bool stream;                /* IPC stream format instead of the file format */
+} arrow_export_opts_t;
+
+int arrow_export(const char *db_path, FILE *out, const arrow_export_opts_t *opts);
+
+#endif /* ARROW_EXPORT_H */
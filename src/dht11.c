@@ -22,34 +22,37 @@
 #include <gpiod.h>
 
 #include "dht11.h"
+#include "dht11_core.h"
+#include "sqlite_sink.h"
+#include "arrow_export.h"
+#include "trace.h"
+#include "simulator.h"
+#include "mcu_backend.h"
+#include "spi_backend.h"
+#include "server.h"
+#include "handoff.h"
+#include "gateway.h"
+#include "line_watch.h"
+#include "sensor_state.h"
+#include "pressure.h"
+#include "pulse_classifier.h"
+#include "frame_log.h"
+#include "snapshot_sink.h"
+#include "read_pipeline.h"
 #include <ws_utils.h>
 
 /* Global state for signal handler cleanup */
-static volatile sig_atomic_t g_running = 1;
 static struct gpiod_chip *g_chip = NULL;
 static struct gpiod_line *g_line = NULL;
-
-/* DHT11 timing constants (microseconds) */
-#define DHT11_START_LOW_US      20000   /* Start signal: pull low for 20ms */
-#define DHT11_START_HIGH_US     20      /* Then release for 20-40us */
-#define DHT11_TIMEOUT_US        1000    /* Timeout waiting for edges */
+static pressure_monitor_t g_pressure;
 
 /* GPIO chip for Raspberry Pi */
 #define GPIO_CHIP_PATH  "/dev/gpiochip0"
 
-/*
- * Get current time in microseconds
- */
-static uint64_t micros(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
-}
-
 /*
  * Log error to both stderr and syslog
  */
-static void log_error(const char *fmt, ...) {
+void log_error(const char *fmt, ...) {
     va_list args;
     char buf[256];
     
@@ -96,6 +99,28 @@ static void setup_signal_handlers(void) {
     sigaction(SIGTERM, &sa, NULL);
 }
 
+/*
+ * Signal handler for watch mode - stop after the current sweep so that
+ * sinks can flush, instead of exiting immediately
+ */
+static void stop_handler(int sig) {
+    (void)sig;
+    g_running = 0;
+}
+
+/*
+ * Setup signal handlers for watch mode
+ */
+static void setup_watch_signal_handlers(void) {
+    struct sigaction sa;
+    sa.sa_handler = stop_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
 /*
  * Watchdog alarm handler - triggers if GPIO operations hang
  */
@@ -137,35 +162,43 @@ static void cancel_watchdog(void) {
     alarm(0);
 }
 
+/* Frames of the current read_dht11_until() call, kept for the frame log */
+static frame_log_read_t g_frame_read;
+
 /*
- * Wait for a specific GPIO level with timeout
- * Returns the duration in microseconds, or -1 on timeout
+ * Report a failed line request: log it unless another process holds the line
  */
-static int wait_for_level(struct gpiod_line *line, int level, int timeout_us) {
-    uint64_t start = micros();
-    uint64_t deadline = start + timeout_us;
-    int current;
+static int request_failed(int gpio_pin, const char *direction, char *error_msg, size_t error_len) {
+    char detail[128];
+    int result = dht11_request_failed(gpio_pin, direction, detail, sizeof(detail));
     
-    while ((current = gpiod_line_get_value(line)) != level) {
-        if (current < 0) {
-            return -2;  /* Error reading GPIO */
-        }
-        if (micros() > deadline) {
-            return -1;  /* Timeout */
-        }
+    if (result != DHT11_LINE_BUSY) {
+        log_error("%s", detail);
     }
-    return (int)(micros() - start);
+    if (error_msg) {
+        snprintf(error_msg, error_len, "%s", detail);
+    }
+    return result;
 }
 
 /*
- * Read DHT11 sensor using bit-banging
- * Returns 0 on success, -1 on error
- * If error_msg is provided, sets descriptive error message
+ * Sample one DHT11 frame by bit-banging: send the start signal and record
+ * the width of every low and high that follows. Only the bus exchange, from
+ * the end of the start signal to the last edge, runs under SCHED_FIFO (see
+ * dht11_exchange()); requesting the line, the 20ms start low and everything
+ * after the frame run at the caller's priority. Nothing is decoded here
+ * (see dht11_decode()).
+ * Returns 0 once the sensor has answered, with frame->count pulse pairs
+ * recorded, DHT11_LINE_BUSY if another process holds the line, or -1 on
+ * other errors. error_msg is set for errors that retrying will not fix.
  */
-static int dht11_read_raw(int gpio_pin, uint8_t data[5], char *error_msg, size_t error_len) {
+int dht11_sample(int gpio_pin, dht11_frame_t *frame, char *error_msg, size_t error_len) {
     struct gpiod_chip *chip;
     struct gpiod_line *line;
-    int i, j;
+    char detail[128] = "";
+    int result;
+    
+    frame->count = 0;
     
     /* Check if we should stop */
     if (!g_running) {
@@ -201,225 +234,168 @@ static int dht11_read_raw(int gpio_pin, uint8_t data[5], char *error_msg, size_t
     
     /* Request line as output, initially high */
     if (gpiod_line_request_output(line, "dht11", 1) < 0) {
-        log_error("Cannot request GPIO %d as output: %s", gpio_pin, strerror(errno));
-        fprintf(stderr, "Hint: Try running with sudo for GPIO access\n");
-        if (error_msg) {
-            snprintf(error_msg, error_len, "GPIO access denied - try running with sudo");
-        }
+        result = request_failed(gpio_pin, "output", error_msg, error_len);
         gpiod_chip_close(chip);
-        return -1;
+        g_line = NULL;
+        g_chip = NULL;
+        return result;
     }
     
-    /* Pull low for at least 18ms to signal start */
+    /* Pull low for at least 18ms to signal start; timing is loose here */
     gpiod_line_set_value(line, 0);
     usleep(DHT11_START_LOW_US);
     
-    /* Pull high and wait for DHT11 response */
-    gpiod_line_set_value(line, 1);
-    usleep(DHT11_START_HIGH_US);
+    /* === RECORD THE RESPONSE === */
+    result = dht11_exchange(line, gpio_pin, frame, detail, sizeof(detail));
+    gpiod_chip_close(chip);
+    g_line = NULL;
+    g_chip = NULL;
     
-    /* Release line and switch to input */
-    gpiod_line_release(line);
-    if (gpiod_line_request_input(line, "dht11") < 0) {
-        log_error("Cannot request GPIO %d as input: %s", gpio_pin, strerror(errno));
-        fprintf(stderr, "Hint: Try running with sudo for GPIO access\n");
+    if (detail[0] != '\0') {
+        if (result != DHT11_LINE_BUSY) {
+            log_error("%s", detail);
+        }
         if (error_msg) {
-            snprintf(error_msg, error_len, "GPIO access denied - try running with sudo");
+            snprintf(error_msg, error_len, "%s", detail);
         }
-        gpiod_chip_close(chip);
-        g_line = NULL;
-        g_chip = NULL;
-        return -1;
-    }
-    
-    /* === WAIT FOR DHT11 RESPONSE === */
-    
-    /* DHT11 response: LOW for ~80us, then HIGH for ~80us, then LOW for first bit */
-    /* Wait for response LOW */
-    if (wait_for_level(line, 0, DHT11_TIMEOUT_US) < 0) {
-        gpiod_line_release(line);
-        gpiod_chip_close(chip);
-        g_line = NULL;
-        g_chip = NULL;
-        return -1;
-    }
-    
-    /* Wait for response HIGH */
-    if (wait_for_level(line, 1, DHT11_TIMEOUT_US) < 0) {
-        gpiod_line_release(line);
-        gpiod_chip_close(chip);
-        g_line = NULL;
-        g_chip = NULL;
-        return -1;
     }
+    return result;
+}
+
+/*
+ * Wait while CPU or I/O pressure is over the deferral level, leaving room for
+ * one attempt before deadline_us. Counts the retries the wait replaced: the
+ * attempt that would have been made now and every backoff slot from attempt
+ * onwards that passes while waiting.
+ */
+static void defer_while_pressured(uint64_t deadline_us, int attempt) {
+    uint64_t start = monotonic_us();
+    uint64_t slot = start;
+    uint64_t now;
     
-    /* Wait for first data bit LOW (start of bit) */
-    if (wait_for_level(line, 0, DHT11_TIMEOUT_US) < 0) {
-        gpiod_line_release(line);
-        gpiod_chip_close(chip);
-        g_line = NULL;
-        g_chip = NULL;
-        return -1;
+    if (!pressure_high(&g_pressure, start)) {
+        return;
     }
-    
-    /* === READ 40 BITS OF DATA === */
-    /* Each bit: LOW for ~50us, then HIGH for 26-28us (0) or 70us (1)
-     * Measure the HIGH pulse width to determine bit value */
-    
-    memset(data, 0, 5);
-    int pulse_times[50];
-    int num_pulses = 0;
-    
-    /* Read all available pulses */
-    for (i = 0; i < 50; i++) {
-        /* Wait for HIGH with timeout */
-        int high_result = wait_for_level(line, 1, DHT11_TIMEOUT_US);
-        if (high_result < 0) {
-            break;  /* No more bits */
+    g_pressure_stats.deferrals++;
+    g_pressure_stats.attempts_saved++;
+    
+    while (g_running && monotonic_us() + PRESSURE_POLL_US + DHT11_ATTEMPT_US < deadline_us) {
+        usleep(PRESSURE_POLL_US);
+        now = monotonic_us();
+        while (attempt < num_retries && slot + DHT11_ATTEMPT_US + retry_delays_us[attempt] <= now) {
+            slot += DHT11_ATTEMPT_US + retry_delays_us[attempt];
+            attempt++;
+            g_pressure_stats.attempts_saved++;
         }
-        
-        /* Measure how long the HIGH lasts */
-        uint64_t start = micros();
-        wait_for_level(line, 0, DHT11_TIMEOUT_US);
-        int duration = (int)(micros() - start);
-        
-        pulse_times[num_pulses++] = duration;
-        
-        /* Stop if we hit a long timeout (line staying HIGH = end of data) */
-        if (duration > 500) {
+        if (!pressure_high(&g_pressure, now)) {
             break;
         }
     }
-    
-    /* Count valid pulses (not timeouts) */
-    int valid_pulses = 0;
-    for (i = 0; i < num_pulses; i++) {
-        if (pulse_times[i] < 500) valid_pulses++;
-    }
-    
-    /* We need at least 38 valid pulses - may be missing 1-2 due to timing */
-    if (valid_pulses < 38) {
-        gpiod_line_release(line);
-        gpiod_chip_close(chip);
-        g_line = NULL;
-        g_chip = NULL;
-        return -1;
-    }
-    
-    /* Find threshold from valid pulses */
-    int min_pulse = 10000, max_pulse = 0;
-    for (i = 0; i < num_pulses; i++) {
-        if (pulse_times[i] < 500) {
-            if (pulse_times[i] < min_pulse) min_pulse = pulse_times[i];
-            if (pulse_times[i] > max_pulse) max_pulse = pulse_times[i];
-        }
-    }
-    int threshold = (min_pulse + max_pulse) / 2;
-    
-    /* Extract valid pulses into a separate array */
-    int valid_times[50];
-    int v = 0;
-    for (i = 0; i < num_pulses && v < 50; i++) {
-        if (pulse_times[i] < 500) {
-            valid_times[v++] = pulse_times[i];
-        }
-    }
-    
-    /* Decode bits - use last valid_pulses bits, treating them as rightmost */
-    /* This handles the case where we missed 1-2 bits at the start */
-    int bits_missing = 40 - valid_pulses;
-    int bit_idx = 0;
-    
-    /* First fill in zeros for missing bits */
-    for (i = 0; i < bits_missing; i++) {
-        j = bit_idx / 8;
-        data[j] <<= 1;
-        bit_idx++;
-    }
-    
-    /* Then decode the pulses we have */
-    for (i = 0; i < valid_pulses && bit_idx < 40; i++) {
-        j = bit_idx / 8;
-        data[j] <<= 1;
-        if (valid_times[i] > threshold) {
-            data[j] |= 1;
-        }
-        bit_idx++;
-    }
-    
-    gpiod_line_release(line);
-    gpiod_chip_close(chip);
-    g_line = NULL;
-    g_chip = NULL;
-    
-    /* Verify checksum */
-    uint8_t checksum = data[0] + data[1] + data[2] + data[3];
-    if (checksum != data[4]) {
-        return -1;
-    }
-    
-    return 0;
+    g_pressure_stats.deferred_us += monotonic_us() - start;
 }
 
-/* Retry delays in microseconds: 0.05s x2, 0.1s x3, then 0.2, 0.4, 0.8, 1.6, 2s x3 */
-static const useconds_t retry_delays_us[] = {
-    50000, 50000,             /* 0.05s x2 */
-    100000, 100000, 100000,   /* 0.1s x3 */
-    200000, 400000, 800000, 1600000,  /* exponential */
-    2000000, 2000000, 2000000  /* 2s x3 */
-};
-static const int num_retries = sizeof(retry_delays_us) / sizeof(retry_delays_us[0]);
+/*
+ * Summarise pressure deferrals when a long-running mode exits
+ */
+static void report_pressure_stats(void) {
+    if (g_pressure_stats.deferrals == 0) {
+        return;
+    }
+    fprintf(stderr, "Deferred %llu reads for %.1f s under CPU/IO pressure, saving %llu attempts\n",
+            (unsigned long long)g_pressure_stats.deferrals,
+            g_pressure_stats.deferred_us / 1e6,
+            (unsigned long long)g_pressure_stats.attempts_saved);
+}
 
 /*
  * Read DHT11 with retries using predefined backoff schedule.
- * Elevates to SCHED_FIFO real-time priority during reads for reliable
- * GPIO timing, then restores normal scheduling afterward.
+ * Each attempt holds SCHED_FIFO real-time priority only for the bus
+ * exchange (see dht11_sample()); backoff, decoding and error reporting run
+ * at normal priority.
+ * Gives up at deadline_us (CLOCK_MONOTONIC). If another process holds the
+ * line, sleeps until it is released rather than backing off blindly. If
+ * defer is set and the system is under CPU or I/O pressure, attempts wait
+ * for it to ease; callers that must not block on pressure clear it.
  */
-int read_dht11(int gpio_pin, sensor_reading_t *reading) {
-    uint8_t data[5];
+int read_dht11_until(int gpio_pin, sensor_reading_t *reading, uint64_t deadline_us, bool defer) {
+    dht11_frame_t frame;
     int attempt;
-    struct sched_param rt_param = { .sched_priority = 99 };
-    struct sched_param normal_param = { .sched_priority = 0 };
-    int had_rt = 0;
+    int result;
     
     reading->valid = false;
     reading->error_msg[0] = '\0';
     
-    /* Elevate to real-time FIFO scheduling for reliable GPIO timing */
-    if (sched_setscheduler(0, SCHED_FIFO, &rt_param) == 0) {
-        had_rt = 1;
-    }
+    /* Open the frame log, if any, before timing matters */
+    frame_log_file();
+    g_frame_read.count = 0;
     
     for (attempt = 0; attempt <= num_retries; attempt++) {
-        if (dht11_read_raw(gpio_pin, data, reading->error_msg, sizeof(reading->error_msg)) == 0) {
-            /* DHT11 format: data[0]=humidity int, data[1]=humidity dec (always 0)
-             *               data[2]=temp int, data[3]=temp dec (always 0)
-             *               data[4]=checksum */
-            reading->humidity = (float)data[0] + (float)data[1] / 10.0f;
-            reading->temperature = (float)data[2] + (float)data[3] / 10.0f;
-            reading->valid = true;
+        if (defer) {
+            defer_while_pressured(deadline_us, attempt);
+        }
+        result = dht11_sample(gpio_pin, &frame, reading->error_msg, sizeof(reading->error_msg));
+        if (result == 0) {
+            frame_log_keep(&g_frame_read, gpio_pin, &frame);
+            if (dht11_decode(&frame, reading) == 0) {
 #ifdef DEBUG
-            fprintf(stderr, "DEBUG: Success on attempt %d\\n", attempt + 1);
+                fprintf(stderr, "DEBUG: Success on attempt %d\\n", attempt + 1);
 #endif
-            /* Restore normal scheduling */
-            if (had_rt)
-                sched_setscheduler(0, SCHED_OTHER, &normal_param);
-            return 0;
+                frame_log_commit(&g_frame_read, reading->raw);
+                return 0;
+            }
+        }
+        
+        /* Another process holds the line. That is not a failed attempt: wake
+         * when it lets go and try again at once, for as long as the deadline
+         * allows, without using up a retry */
+        if (result == DHT11_LINE_BUSY) {
+            char consumer[32];
+            int watch = line_watch_wait_released(GPIO_CHIP_PATH, (unsigned int)gpio_pin,
+                                                 deadline_us, consumer, sizeof(consumer));
+            if (watch == LINE_WATCH_TIMEOUT) {
+                if (consumer[0] != '\0') {
+                    snprintf(reading->error_msg, sizeof(reading->error_msg),
+                             "GPIO %d is in use by \"%s\"", gpio_pin, consumer);
+                }
+                break;
+            }
+            if (!g_running) {
+                break;
+            }
+            
+            /* No line-info watch on this kernel: poll at this slot's backoff */
+            if (watch == LINE_WATCH_UNSUPPORTED) {
+                uint32_t delay = retry_delays_us[attempt < num_retries ? attempt : num_retries - 1];
+                if (monotonic_us() + delay >= deadline_us) {
+                    break;
+                }
+                usleep(delay);
+            }
+            reading->error_msg[0] = '\0';
+            attempt--;
+            continue;
         }
         
         /* If we got a permission error, don't retry - it won't help */
         if (reading->error_msg[0] != '\0') {
-            if (had_rt)
-                sched_setscheduler(0, SCHED_OTHER, &normal_param);
             return -1;
         }
-        
+
 #ifdef DEBUG
         fprintf(stderr, "DEBUG: Attempt %d failed\\n", attempt + 1);
 #endif
         
-        /* Wait before next attempt (if not the last) */
+        /* Stop retrying once asked to exit */
+        if (!g_running) {
+            break;
+        }
+        
+        /* Wait before next attempt (if not the last), unless it would pass the deadline */
         if (attempt < num_retries) {
+            if (monotonic_us() + retry_delays_us[attempt] >= deadline_us) {
+                attempt++;
+                break;
+            }
             usleep(retry_delays_us[attempt]);
         }
     }
@@ -429,12 +405,34 @@ int read_dht11(int gpio_pin, sensor_reading_t *reading) {
         snprintf(reading->error_msg, sizeof(reading->error_msg),
                  "Failed to read DHT11 after %d attempts", attempt);
     }
-    /* Restore normal scheduling */
-    if (had_rt)
-        sched_setscheduler(0, SCHED_OTHER, &normal_param);
     return -1;
 }
 
+/*
+ * Read DHT11 within the default read deadline
+ */
+int read_dht11(int gpio_pin, sensor_reading_t *reading) {
+    return read_dht11_until(gpio_pin, reading, monotonic_us() + DHT11_READ_DEADLINE_US, true);
+}
+
+/*
+ * Read one sensor through its configured backend, giving up at deadline_us
+ * (CLOCK_MONOTONIC)
+ */
+int read_sensor(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us) {
+    switch (config->backend) {
+    case BACKEND_SERIAL:
+        return read_mcu(config, reading, deadline_us);
+    case BACKEND_SPI:
+        return read_spi(config, reading, deadline_us);
+    case BACKEND_SIM:
+        return read_simulated(config, reading, deadline_us);
+    case BACKEND_GPIO:
+    default:
+        return read_dht11_until(config->pin, reading, deadline_us, true);
+    }
+}
+
 /*
  * Get Raspberry Pi serial number with _dht11 suffix.
  * Returns dynamically allocated string, caller must free.
@@ -474,6 +472,31 @@ static int count_sensors_in_json(const char *buffer) {
     return count;
 }
 
+/*
+ * Find a string field ("key": "value") within one config object.
+ * Returns dynamically allocated value, or NULL if the field is not present.
+ */
+static char *parse_string_field(const char *ptr, const char *end, const char *key) {
+    const char *field = strstr(ptr, key);
+    if (!field || field >= end) {
+        return NULL;
+    }
+    field = strchr(field + strlen(key), ':');
+    if (!field || field >= end) {
+        return NULL;
+    }
+    const char *quote_start = strchr(field, '"');
+    if (!quote_start || quote_start >= end) {
+        return NULL;
+    }
+    quote_start++;
+    const char *quote_end = strchr(quote_start, '"');
+    if (!quote_end || quote_end >= end) {
+        return NULL;
+    }
+    return strndup(quote_start, quote_end - quote_start);
+}
+
 /*
  * Parse a simple JSON config file - returns dynamically allocated array
  */
@@ -536,13 +559,44 @@ sensor_config_t *load_config(const char *path, int *count) {
         configs[sensor_idx].internal = false;
         configs[sensor_idx].sensor_id = NULL;
         configs[sensor_idx].sensor_name = NULL;
+        configs[sensor_idx].backend = BACKEND_GPIO;
+        configs[sensor_idx].device = NULL;
+        configs[sensor_idx].mcu_decoded = false;
+        
+        char *backend = parse_string_field(ptr, end, "\"backend\"");
+        if (backend) {
+            if (strcmp(backend, "serial") == 0) {
+                configs[sensor_idx].backend = BACKEND_SERIAL;
+            } else if (strcmp(backend, "spi") == 0) {
+                configs[sensor_idx].backend = BACKEND_SPI;
+            } else if (strcmp(backend, "sim") == 0) {
+                configs[sensor_idx].backend = BACKEND_SIM;
+            } else if (strcmp(backend, "gpio") != 0) {
+                log_error("Unknown backend \"%s\", using gpio", backend);
+            }
+            free(backend);
+        }
+        configs[sensor_idx].device = parse_string_field(ptr, end, "\"device\"");
+        
+        char *mcu_mode = parse_string_field(ptr, end, "\"mcu_mode\"");
+        if (mcu_mode) {
+            if (strcmp(mcu_mode, "decoded") == 0) {
+                configs[sensor_idx].mcu_decoded = true;
+            } else if (strcmp(mcu_mode, "raw") != 0) {
+                log_error("Unknown mcu_mode \"%s\", using raw", mcu_mode);
+            }
+            free(mcu_mode);
+        }
         
         char *pin_ptr = strstr(ptr, "\"pin\"");
         if (pin_ptr && pin_ptr < end) {
             pin_ptr = strchr(pin_ptr, ':');
             if (pin_ptr) {
                 int parsed_pin = atoi(pin_ptr + 1);
-                if (ws_validate_gpio_pin(parsed_pin)) {
+                if (configs[sensor_idx].backend != BACKEND_GPIO) {
+                    /* Pin numbering belongs to the backend's own hardware */
+                    configs[sensor_idx].pin = parsed_pin;
+                } else if (ws_validate_gpio_pin(parsed_pin)) {
                     configs[sensor_idx].pin = parsed_pin;
                 } else {
                     log_error("Invalid GPIO pin %d (must be 2-27), using default %d",
@@ -614,6 +668,7 @@ void free_config(sensor_config_t *configs, int count) {
         for (int i = 0; i < count; i++) {
             free(configs[i].sensor_id);
             free(configs[i].sensor_name);
+            free(configs[i].device);
         }
         free(configs);
     }
@@ -621,18 +676,178 @@ void free_config(sensor_config_t *configs, int count) {
 
 /* get_prototype is now provided by ws_utils.h as ws_get_prototype_cached */
 
+/* Fields of the sc-prototype template that build_sensor_json() fills in */
+enum {
+    FIELD_SENSOR, FIELD_MEASURES, FIELD_UNIT, FIELD_SENSOR_ID, FIELD_SENSOR_NAME,
+    FIELD_INTERNAL, FIELD_TIMESTAMP, FIELD_VALUE, FIELD_ERROR, NUM_FIELDS
+};
+
+static const char *FIELD_NAMES[NUM_FIELDS] = {
+    "sensor", "measures", "unit", "sensor_id", "sensor_name",
+    "internal", "timestamp", "value", "error"
+};
+
+/* Output field projection: comma-separated field names, NULL for all fields */
+static const char *g_projection = NULL;
+
+/* Prototype reduced to the projected fields, prepared once */
+static char *g_template = NULL;
+static unsigned int g_template_fields = 0;  /* Bitmask of FIELD_* present in g_template */
+
 /*
- * Replace a JSON field value in a template string (in-place)
- * Looks for "field": and replaces the value after it
- * For string fields, the value should NOT include quotes - they're preserved from original
+ * Check whether a comma-separated list contains name (len bytes)
  */
-static void json_replace_field(char *json, size_t json_len, const char *field, const char *value) {
+static bool list_contains(const char *list, const char *name, size_t len) {
+    while (*list) {
+        size_t item_len = strcspn(list, ",");
+        if (item_len == len && strncmp(list, name, len) == 0) {
+            return true;
+        }
+        list += item_len;
+        if (*list == ',') list++;
+    }
+    return false;
+}
+
+/*
+ * Find the end of the JSON value starting at p
+ */
+static const char *json_value_end(const char *p) {
+    int depth = 0;
+    bool in_string = false;
+    
+    for (; *p; p++) {
+        if (in_string) {
+            if (*p == '\\' && p[1]) {
+                p++;
+            } else if (*p == '"') {
+                in_string = false;
+                if (depth == 0) return p + 1;
+            }
+        } else if (*p == '"') {
+            in_string = true;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (depth == 0) return p;
+            if (--depth == 0) return p + 1;
+        } else if (*p == ',' && depth == 0) {
+            return p;
+        }
+    }
+    return p;
+}
+
+/*
+ * Copy the prototype keeping only the top-level fields named in projection.
+ * Returns dynamically allocated string, caller must free.
+ */
+static char *project_prototype(const char *prototype, const char *projection) {
+    char *output = malloc(strlen(prototype) + 3);
+    const char *p = strchr(prototype, '{');
+    size_t out_len = 1;
+    bool first = true;
+    
+    if (!output || !p) {
+        free(output);
+        return NULL;
+    }
+    output[0] = '{';
+    p++;
+    
+    while (*p) {
+        const char *key, *key_end, *value_end;
+        
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ',') p++;
+        if (*p != '"') break;
+        
+        key = p + 1;
+        key_end = strchr(key, '"');
+        if (!key_end) break;
+        value_end = strchr(key_end, ':');
+        if (!value_end) break;
+        value_end++;
+        while (*value_end == ' ' || *value_end == '\t') value_end++;
+        value_end = json_value_end(value_end);
+        
+        if (list_contains(projection, key, key_end - key)) {
+            if (!first) output[out_len++] = ',';
+            memcpy(output + out_len, p, value_end - p);
+            out_len += value_end - p;
+            first = false;
+        }
+        p = value_end;
+    }
+    
+    output[out_len++] = '}';
+    output[out_len] = '\0';
+    return output;
+}
+
+/*
+ * Set the output field projection (comma-separated field names, NULL for all).
+ * Must be called before the first record is built.
+ */
+void set_field_projection(const char *fields) {
+    g_projection = fields;
+}
+
+/*
+ * Get the template records are built from: the sc-prototype, reduced to the
+ * projected fields the first time it is needed so that every record after
+ * that only pays for the fields it emits.
+ */
+static const char *prepared_template(void) {
+    const char *prototype;
+    int f;
+    
+    if (g_template) {
+        return g_template;
+    }
+    
+    prototype = ws_get_prototype_cached();
+    if (!prototype || !*prototype) {
+        return NULL;
+    }
+    
+    g_template = g_projection ? project_prototype(prototype, g_projection) : strdup(prototype);
+    if (!g_template) {
+        return NULL;
+    }
+    
+    for (f = 0; f < NUM_FIELDS; f++) {
+        char search[32];
+        snprintf(search, sizeof(search), "\"%s\"", FIELD_NAMES[f]);
+        if (strstr(g_template, search)) {
+            g_template_fields |= 1u << f;
+        }
+    }
+    
+    /* Warn about projected fields the template does not define */
+    for (const char *item = g_projection; item && *item; ) {
+        size_t len = strcspn(item, ",");
+        char search[64];
+        snprintf(search, sizeof(search), "\"%.*s\"", (int)len, item);
+        if (len > 0 && !strstr(g_template, search)) {
+            log_error("Field %.*s is not in the sc-prototype template", (int)len, item);
+        }
+        item += len;
+        if (*item == ',') item++;
+    }
+    return g_template;
+}
+
+#define HAS_FIELD(f)    (g_template_fields & (1u << (f)))
+
+/*
+ * Find the value of a JSON field: the first character after "field": or
+ * "field" : and any whitespace.
+ * Returns NULL if the field is not present.
+ */
+static char *json_field_value(char *json, const char *field) {
     char search[128];
     char *pos;
     char *value_start;
-    char *value_end = NULL;
-    size_t new_len, tail_len;
-    size_t prefix_len;
     
     snprintf(search, sizeof(search), "\"%s\":", field);
     pos = strstr(json, search);
@@ -640,15 +855,31 @@ static void json_replace_field(char *json, size_t json_len, const char *field, c
         snprintf(search, sizeof(search), "\"%s\" :", field);
         pos = strstr(json, search);
     }
-    if (!pos) return;
+    if (!pos) return NULL;
     
     /* Find the colon */
     value_start = strchr(pos, ':');
-    if (!value_start) return;
+    if (!value_start) return NULL;
     value_start++;
     
     /* Skip whitespace */
     while (*value_start == ' ' || *value_start == '\t') value_start++;
+    return value_start;
+}
+
+/*
+ * Replace a JSON field value in a template string (in-place)
+ * Looks for "field": and replaces the value after it
+ * For string fields, the value should NOT include quotes - they're preserved from original
+ */
+static void json_replace_field(char *json, size_t json_len, const char *field, const char *value) {
+    char *value_start;
+    char *value_end = NULL;
+    size_t new_len, tail_len;
+    size_t prefix_len;
+    
+    value_start = json_field_value(json, field);
+    if (!value_start) return;
     
     /* Find end of value based on type */
     if (*value_start == '"') {
@@ -703,7 +934,7 @@ static void build_sensor_json(char *output, size_t output_len,
                                const char *sensor, const char *measures, const char *unit,
                                float value, bool internal, const char *sensor_id,
                                const char *sensor_name, const char *error_msg, time_t timestamp) {
-    const char *prototype = ws_get_prototype_cached();
+    const char *prototype = prepared_template();
     char value_str[32];
     char quoted[512];
     char timestamp_str[32];
@@ -718,147 +949,996 @@ static void build_sensor_json(char *output, size_t output_len,
     strncpy(output, prototype, output_len - 1);
     output[output_len - 1] = '\0';
     
-    /* Replace string fields - need to add quotes since prototype has null */
-    snprintf(quoted, sizeof(quoted), "\"%s\"", sensor);
-    json_replace_field(output, output_len, "sensor", quoted);
+    /* Replace string fields - need to add quotes since prototype has null.
+     * Fields dropped by the projection are skipped entirely. */
+    if (HAS_FIELD(FIELD_SENSOR)) {
+        snprintf(quoted, sizeof(quoted), "\"%s\"", sensor);
+        json_replace_field(output, output_len, "sensor", quoted);
+    }
     
-    snprintf(quoted, sizeof(quoted), "\"%s\"", measures);
-    json_replace_field(output, output_len, "measures", quoted);
+    if (HAS_FIELD(FIELD_MEASURES)) {
+        snprintf(quoted, sizeof(quoted), "\"%s\"", measures);
+        json_replace_field(output, output_len, "measures", quoted);
+    }
     
-    snprintf(quoted, sizeof(quoted), "\"%s\"", unit);
-    json_replace_field(output, output_len, "unit", quoted);
+    if (HAS_FIELD(FIELD_UNIT)) {
+        snprintf(quoted, sizeof(quoted), "\"%s\"", unit);
+        json_replace_field(output, output_len, "unit", quoted);
+    }
     
-    snprintf(quoted, sizeof(quoted), "\"%s\"", sensor_id);
-    json_replace_field(output, output_len, "sensor_id", quoted);
+    if (HAS_FIELD(FIELD_SENSOR_ID)) {
+        snprintf(quoted, sizeof(quoted), "\"%s\"", sensor_id);
+        json_replace_field(output, output_len, "sensor_id", quoted);
+    }
     
     /* Only replace sensor_name if config provides one, otherwise keep prototype default */
-    if (sensor_name && sensor_name[0] != '\0') {
+    if (HAS_FIELD(FIELD_SENSOR_NAME) && sensor_name && sensor_name[0] != '\0') {
         snprintf(quoted, sizeof(quoted), "\"%s\"", sensor_name);
         json_replace_field(output, output_len, "sensor_name", quoted);
     }
     
-    json_replace_field(output, output_len, "internal", internal ? "true" : "false");
+    if (HAS_FIELD(FIELD_INTERNAL)) {
+        json_replace_field(output, output_len, "internal", internal ? "true" : "false");
+    }
     
     /* Add timestamp */
-    snprintf(timestamp_str, sizeof(timestamp_str), "%ld", (long)timestamp);
-    json_replace_field(output, output_len, "timestamp", timestamp_str);
+    if (HAS_FIELD(FIELD_TIMESTAMP)) {
+        snprintf(timestamp_str, sizeof(timestamp_str), "%ld", (long)timestamp);
+        json_replace_field(output, output_len, "timestamp", timestamp_str);
+    }
     
     if (error_msg) {
         char escaped_error[256];
-        ws_json_escape_string(error_msg, escaped_error, sizeof(escaped_error));
-        json_replace_field(output, output_len, "value", "null");
-        snprintf(quoted, sizeof(quoted), "\"%s\"", escaped_error);
-        json_replace_field(output, output_len, "error", quoted);
+        if (HAS_FIELD(FIELD_VALUE)) {
+            json_replace_field(output, output_len, "value", "null");
+        }
+        if (HAS_FIELD(FIELD_ERROR)) {
+            ws_json_escape_string(error_msg, escaped_error, sizeof(escaped_error));
+            snprintf(quoted, sizeof(quoted), "\"%s\"", escaped_error);
+            json_replace_field(output, output_len, "error", quoted);
+        }
     } else {
-        snprintf(value_str, sizeof(value_str), "%.1f", value);
-        json_replace_field(output, output_len, "value", value_str);
-        json_replace_field(output, output_len, "error", "null");
+        if (HAS_FIELD(FIELD_VALUE)) {
+            snprintf(value_str, sizeof(value_str), "%.1f", value);
+            json_replace_field(output, output_len, "value", value_str);
+        }
+        if (HAS_FIELD(FIELD_ERROR)) {
+            json_replace_field(output, output_len, "error", "null");
+        }
     }
 }
 
 /*
- * Output sensor reading as JSON
+ * Check whether a sensor passes the internal/external location filter
  */
-void output_json(sensor_config_t *configs, int count, const char *filter, ws_location_filter_t location_filter) {
-    size_t output_size = 4096;  /* Initial size, will grow if needed */
-    char *output = malloc(output_size);
-    if (!output) {
-        fprintf(stderr, "Memory allocation failed\n");
-        return;
+bool sensor_selected(const sensor_config_t *config, ws_location_filter_t location_filter) {
+    if (location_filter == WS_LOCATION_INTERNAL && !config->internal) {
+        return false;
     }
-    strcpy(output, "[");
-    int first = 1;
-    int i;
-    
+    if (location_filter == WS_LOCATION_EXTERNAL && config->internal) {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Count the sensors that pass the location filter
+ */
+int count_selected(const sensor_config_t *configs, int count, ws_location_filter_t location_filter) {
+    int selected = 0;
+    int i;
+    
     for (i = 0; i < count; i++) {
-        sensor_reading_t reading;
-        size_t id_len = configs[i].sensor_id ? strlen(configs[i].sensor_id) : 0;
-        char *escaped_id = malloc(id_len * 2 + 1);
-        if (!escaped_id) {
-            free(output);
-            fprintf(stderr, "Memory allocation failed\n");
-            return;
+        if (sensor_selected(&configs[i], location_filter)) {
+            selected++;
+        }
+    }
+    return selected;
+}
+
+/*
+ * Check whether a measurement ("temperature" or "humidity") passes the filter
+ */
+bool measurement_selected(const char *filter, const char *measurement) {
+    return !filter || strcmp(filter, measurement) == 0 || strcmp(filter, "all") == 0;
+}
+
+/*
+ * Read every sensor that passes the location filter.
+ * readings[i] is filled in for configs[i]; unselected sensors are left untouched.
+ * GPIO sensors are read together once the others are done, so that one
+ * sensor's retries overlap the rest (see read_pipeline.c). Every read shares
+ * one deadline, taken now, so the sweep ends within DHT11_READ_DEADLINE_US.
+ */
+void read_sensors(sensor_config_t *configs, int count, ws_location_filter_t location_filter,
+                  sensor_reading_t *readings) {
+    uint64_t deadline_us = monotonic_us() + DHT11_READ_DEADLINE_US;
+    int *gpio = malloc((size_t)count * sizeof(int));
+    int num_gpio = 0;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        if (!sensor_selected(&configs[i], location_filter)) {
+            continue;
+        }
+        if (configs[i].backend == BACKEND_GPIO && gpio) {
+            gpio[num_gpio++] = i;
+            continue;
         }
-        const char *error_msg = NULL;
-        time_t read_timestamp;
         
+        /* Capture timestamp when sensor is read */
+        readings[i].timestamp = time(NULL);
+        read_sensor(&configs[i], &readings[i], deadline_us);
+    }
+    
+    for (i = 0; i < num_gpio; i++) {
+        readings[gpio[i]].timestamp = time(NULL);
+    }
+    read_dht11_batch(configs, gpio, num_gpio, readings, deadline_us, true);
+    free(gpio);
+}
+
+/*
+ * Append one JSON object to the output array, growing the buffer if needed
+ */
+static char *append_record(char *output, size_t *output_size, const char *record, int *first) {
+    size_t needed = strlen(output) + strlen(record) + 3;
+    if (needed > *output_size) {
+        *output_size = needed * 2;
+        char *new_output = realloc(output, *output_size);
+        if (!new_output) {
+            return output;
+        }
+        output = new_output;
+    }
+    
+    if (!*first) strcat(output, ",");
+    strcat(output, record);
+    *first = 0;
+    return output;
+}
+
+/* The two records produced for every DHT11 reading */
+static const struct {
+    const char *sensor;
+    const char *measures;
+    const char *unit;
+} MEASUREMENTS[2] = {
+    { "dht11_temperature", "temperature", "Celsius" },
+    { "dht11_humidity",    "humidity",    "percentage" },
+};
+
+/*
+ * Render one measurement record for a sensor.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+static int render_record(char *output, size_t output_len, const sensor_config_t *config,
+                         const sensor_reading_t *reading, int m) {
+    size_t id_len = config->sensor_id ? strlen(config->sensor_id) : 0;
+    char *escaped_id = malloc(id_len * 2 + 1);
+    char *sensor_id = malloc(id_len * 2 + 16);
+    
+    if (!escaped_id || !sensor_id) {
+        free(escaped_id);
+        free(sensor_id);
+        return -1;
+    }
+    
+    ws_json_escape_string(config->sensor_id, escaped_id, id_len * 2 + 1);
+    snprintf(sensor_id, id_len * 2 + 16, "%s_%s", escaped_id, MEASUREMENTS[m].measures);
+    
+    build_sensor_json(output, output_len,
+                      MEASUREMENTS[m].sensor, MEASUREMENTS[m].measures, MEASUREMENTS[m].unit,
+                      m == 0 ? reading->temperature : reading->humidity,
+                      config->internal, sensor_id, config->sensor_name,
+                      reading->valid ? NULL : reading->error_msg, reading->timestamp);
+    
+    free(escaped_id);
+    free(sensor_id);
+    return 0;
+}
+
+/*
+ * Check whether a cache entry was rendered from the same frame and error
+ */
+static bool render_cache_matches(const render_cache_t *entry, const sensor_reading_t *reading) {
+    if (entry->valid != reading->valid) {
+        return false;
+    }
+    if (reading->valid) {
+        return memcmp(entry->raw, reading->raw, sizeof(entry->raw)) == 0;
+    }
+    return strcmp(entry->error_msg, reading->error_msg) == 0;
+}
+
+/*
+ * Get a record from the cache, rendering it only if the frame or error
+ * changed. Otherwise only the timestamp digits are patched in place.
+ * Returns NULL on allocation failure.
+ */
+static const char *cached_record(render_cache_t *entry, const sensor_config_t *config,
+                                 const sensor_reading_t *reading, int m) {
+    char timestamp_str[32];
+    int timestamp_len;
+    const char *ts;
+    
+    if (!render_cache_matches(entry, reading)) {
+        entry->valid = reading->valid;
+        memcpy(entry->raw, reading->raw, sizeof(entry->raw));
+        memcpy(entry->error_msg, reading->error_msg, sizeof(entry->error_msg));
+        entry->rendered[0] = false;
+        entry->rendered[1] = false;
+    }
+    
+    timestamp_len = snprintf(timestamp_str, sizeof(timestamp_str), "%ld", (long)reading->timestamp);
+    
+    if (entry->rendered[m] && entry->timestamp_len[m] == (size_t)timestamp_len) {
+        memcpy(entry->records[m] + entry->timestamp_pos[m], timestamp_str, timestamp_len);
+        return entry->records[m];
+    }
+    
+    if (render_record(entry->records[m], sizeof(entry->records[m]), config, reading, m) < 0) {
+        return NULL;
+    }
+    
+    /*
+     * Remember where the timestamp digits are so later sweeps can patch them.
+     * A record whose timestamp cannot be found is not reused, as it could
+     * not be brought up to date.
+     */
+    entry->rendered[m] = false;
+    ts = json_field_value(entry->records[m], "timestamp");
+    if (ts && strncmp(ts, timestamp_str, timestamp_len) == 0) {
+        entry->timestamp_pos[m] = (size_t)(ts - entry->records[m]);
+        entry->timestamp_len[m] = (size_t)timestamp_len;
+        entry->rendered[m] = true;
+    }
+    return entry->records[m];
+}
+
+/*
+ * Render readings as a JSON array.
+ * cache, if not NULL, holds one render_cache_t per config and is reused
+ * across calls; records whose raw frame and error are unchanged are not
+ * re-rendered.
+ * Returns dynamically allocated string, caller must free. NULL on allocation failure.
+ */
+char *render_json(const sensor_config_t *configs, const sensor_reading_t *readings, int count,
+                  const char *filter, ws_location_filter_t location_filter,
+                  render_cache_t *cache) {
+    size_t output_size = 4096;  /* Initial size, will grow if needed */
+    char *output = malloc(output_size);
+    if (!output) {
+        return NULL;
+    }
+    strcpy(output, "[");
+    int first = 1;
+    int i, m;
+    
+    for (i = 0; i < count; i++) {
         /* Skip sensors that don't match the location filter */
-        if (location_filter == WS_LOCATION_INTERNAL && !configs[i].internal) {
-            free(escaped_id);
+        if (!sensor_selected(&configs[i], location_filter)) {
             continue;
         }
-        if (location_filter == WS_LOCATION_EXTERNAL && configs[i].internal) {
-            free(escaped_id);
-            continue;
+        
+        for (m = 0; m < 2; m++) {
+            char record[1024];
+            const char *json = record;
+            
+            if (!measurement_selected(filter, MEASUREMENTS[m].measures)) {
+                continue;
+            }
+            
+            if (cache) {
+                json = cached_record(&cache[i], &configs[i], &readings[i], m);
+            } else if (render_record(record, sizeof(record), &configs[i], &readings[i], m) < 0) {
+                json = NULL;
+            }
+            if (!json) {
+                free(output);
+                return NULL;
+            }
+            
+            output = append_record(output, &output_size, json, &first);
+        }
+    }
+    
+    strcat(output, "]");
+    return output;
+}
+
+/*
+ * Output sensor reading as JSON
+ */
+void output_json(sensor_config_t *configs, int count, const char *filter, ws_location_filter_t location_filter) {
+    sensor_reading_t *readings = calloc(count, sizeof(sensor_reading_t));
+    char *output;
+    
+    if (!readings) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    
+    read_sensors(configs, count, location_filter, readings);
+    
+    output = render_json(configs, readings, count, filter, location_filter, NULL);
+    if (!output) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(readings);
+        return;
+    }
+    printf("%s\n", output);
+    free(output);
+    free(readings);
+}
+
+/*
+ * Watch mode: read all sensors every interval, print each sweep as one JSON
+ * line and optionally store it in an SQLite database and a snapshot file.
+ * args are the arguments following "watch".
+ */
+static int run_watch(sensor_config_t *configs, int count, int argc, char *argv[], int trace_fd) {
+    int interval_sec = WATCH_DEFAULT_INTERVAL_SEC;
+    int commit_interval_sec = SQLITE_DEFAULT_COMMIT_INTERVAL_SEC;
+    const char *sqlite_path = NULL;
+    const char *snapshot_path = NULL;
+    const char *filter = NULL;
+    ws_location_filter_t location_filter = WS_LOCATION_ALL;
+    sqlite_sink_t *sqlite_sink = NULL;
+    snapshot_sink_t *snapshot_sink = NULL;
+    sensor_reading_t *readings;
+    render_cache_t *render_cache;
+    struct timespec next;
+    int i;
+    
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sqlite") == 0 && i + 1 < argc) {
+            sqlite_path = argv[++i];
+        } else if (strcmp(argv[i], "--commit-interval") == 0 && i + 1 < argc) {
+            commit_interval_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (strcmp(argv[i], "--fields") == 0 && i + 1 < argc) {
+            set_field_projection(argv[++i]);
+        } else if (strcmp(argv[i], "temperature") == 0 || strcmp(argv[i], "humidity") == 0) {
+            filter = argv[i];
+        } else if (strcmp(argv[i], "internal") == 0) {
+            location_filter = WS_LOCATION_INTERNAL;
+        } else if (strcmp(argv[i], "external") == 0) {
+            location_filter = WS_LOCATION_EXTERNAL;
+        } else if (strcmp(argv[i], "all") != 0) {
+            fprintf(stderr, "Unknown watch option: %s\n", argv[i]);
+            fprintf(stderr, "Usage: sensor-dht11 watch [--interval SECS] [--sqlite PATH] "
+                            "[--commit-interval SECS] [--snapshot PATH] [--fields LIST] "
+                            "[temperature|humidity|internal|external|all]\n");
+            return WS_EXIT_INVALID_ARG;
         }
+    }
+    
+    if (interval_sec < 1 || commit_interval_sec < 0) {
+        fprintf(stderr, "Intervals must be positive\n");
+        return WS_EXIT_INVALID_ARG;
+    }
+    
+    readings = calloc(count, sizeof(sensor_reading_t));
+    render_cache = calloc(count, sizeof(render_cache_t));
+    if (!readings || !render_cache) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(readings);
+        free(render_cache);
+        return 1;
+    }
+    
+    if (sqlite_path) {
+        sqlite_sink = sqlite_sink_open(sqlite_path, commit_interval_sec);
+        if (!sqlite_sink) {
+            free(readings);
+            free(render_cache);
+            return 1;
+        }
+    }
+    if (snapshot_path) {
+        snapshot_sink = snapshot_sink_open(snapshot_path);
+        if (!snapshot_sink) {
+            sqlite_sink_close(sqlite_sink);
+            free(readings);
+            free(render_cache);
+            return 1;
+        }
+    }
+    
+    setup_watch_signal_handlers();
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    
+    while (g_running) {
+        uint64_t sweep_start = trace_now_us();
         
-        ws_json_escape_string(configs[i].sensor_id, escaped_id, id_len * 2 + 1);
+        /* Watchdog covers each sweep rather than the whole run */
+        alarm(WATCHDOG_TIMEOUT_SEC);
+        read_sensors(configs, count, location_filter, readings);
+        cancel_watchdog();
+        trace_record(trace_fd, TRACE_CMD_SWEEP, filter, location_filter,
+                     count_selected(configs, count, location_filter), sweep_start, getppid());
         
-        /* Capture timestamp when sensor is read */
-        read_timestamp = time(NULL);
+        char *output = render_json(configs, readings, count, filter, location_filter, render_cache);
+        if (output) {
+            printf("%s\n", output);
+            fflush(stdout);
+            if (snapshot_sink) {
+                snapshot_sink_write(snapshot_sink, output);
+            }
+            free(output);
+        }
         
-        if (read_dht11(configs[i].pin, &reading) != 0 || !reading.valid) {
-            error_msg = reading.error_msg;
+        if (sqlite_sink) {
+            sqlite_sink_write(sqlite_sink, configs, readings, count, filter, location_filter);
         }
         
-        if (!filter || strcmp(filter, "temperature") == 0 || strcmp(filter, "all") == 0) {
-            char temp_json[1024];
-            char *sensor_id_temp = malloc(id_len * 2 + 16);
-            if (sensor_id_temp) {
-                snprintf(sensor_id_temp, id_len * 2 + 16, "%s_temperature", escaped_id);
-                
-                build_sensor_json(temp_json, sizeof(temp_json),
-                                  "dht11_temperature", "temperature", "Celsius",
-                                  reading.temperature, configs[i].internal, sensor_id_temp,
-                                  configs[i].sensor_name, error_msg, read_timestamp);
-                
-                /* Grow output buffer if needed */
-                size_t needed = strlen(output) + strlen(temp_json) + 3;
-                if (needed > output_size) {
-                    output_size = needed * 2;
-                    char *new_output = realloc(output, output_size);
-                    if (new_output) output = new_output;
+        /* Sleep until the next sweep; signals interrupt the sleep */
+        next.tv_sec += interval_sec;
+        while (g_running &&
+               clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+    }
+    
+    report_pressure_stats();
+    sqlite_sink_close(sqlite_sink);
+    snapshot_sink_close(snapshot_sink);
+    free(readings);
+    free(render_cache);
+    return WS_EXIT_SUCCESS;
+}
+
+/* Node daemon state shared with the request handler */
+typedef struct {
+    sensor_config_t *configs;
+    int count;
+    sensor_reading_t *readings;
+    render_cache_t *render_cache;
+    sensor_state_t sensors;     /* Schedule, health and read times */
+    snapshot_sink_t *snapshot_sink;
+    int trace_fd;
+} serve_state_t;
+
+/*
+ * Describe pressure deferrals since start-up as a STATS response
+ */
+static char *serve_stats(void) {
+    char response[256];
+    
+    snprintf(response, sizeof(response),
+             "OK %llu {\"checks\":%llu,\"deferrals\":%llu,\"deferred_ms\":%llu,"
+             "\"attempts_saved\":%llu}",
+             (unsigned long long)trace_now_us(),
+             (unsigned long long)g_pressure_stats.checks,
+             (unsigned long long)g_pressure_stats.deferrals,
+             (unsigned long long)(g_pressure_stats.deferred_us / 1000),
+             (unsigned long long)g_pressure_stats.attempts_saved);
+    return strdup(response);
+}
+
+/*
+ * Answer one client request from the latest readings
+ */
+static char *serve_request(void *ctx, const char *request, const struct sockaddr_in *peer) {
+    serve_state_t *state = ctx;
+    uint64_t start_us = trace_now_us();
+    uint64_t oldest_us = 0;
+    const char *filter;
+    ws_location_filter_t location_filter;
+    char *output;
+    char *response;
+    size_t len;
+    int i;
+    
+    if (strcmp(request, "STATS") == 0) {
+        return serve_stats();
+    }
+    if (server_parse_request(request, &filter, &location_filter) < 0) {
+        return strdup("ERR unknown request");
+    }
+    output = render_json(state->configs, state->readings, state->count, filter,
+                         location_filter, state->render_cache);
+    if (!output) {
+        return strdup("ERR out of memory");
+    }
+    
+    /* Date the response by its oldest reading */
+    for (i = 0; i < state->count; i++) {
+        uint64_t read_us = state->sensors.read_us[i];
+        if (sensor_selected(&state->configs[i], location_filter) &&
+            (oldest_us == 0 || read_us < oldest_us)) {
+            oldest_us = read_us;
+        }
+    }
+    
+    len = strlen(output) + 32;
+    response = malloc(len);
+    if (response) {
+        snprintf(response, len, "OK %llu %s", (unsigned long long)oldest_us, output);
+    }
+    free(output);
+    trace_record_client(state->trace_fd, TRACE_CMD_REQUEST, filter, location_filter,
+                        count_selected(state->configs, state->count, location_filter),
+                        start_us, peer);
+    return response;
+}
+
+/*
+ * Record a due sensor's read and schedule its next one
+ */
+static void serve_record(serve_state_t *state, int idx, uint64_t read_us, uint64_t now_us,
+                         uint64_t interval_us) {
+    if (sensor_state_record(&state->sensors, idx, &state->readings[idx], read_us)) {
+        log_error("Sensor %s has failed %d reads in a row: %s",
+                  state->configs[idx].sensor_id ? state->configs[idx].sensor_id : "(default)",
+                  SENSOR_UNHEALTHY_FAILURES, state->readings[idx].error_msg);
+    }
+    
+    /* Keep each sensor on its own cadence; skip ticks missed while busy */
+    state->sensors.next_due_us[idx] += interval_us;
+    if (state->sensors.next_due_us[idx] <= now_us) {
+        state->sensors.next_due_us[idx] = now_us + interval_us;
+    }
+}
+
+/*
+ * Read the sensors that are due and schedule their next reads
+ */
+static void serve_read_due(serve_state_t *state, int *due, uint64_t interval_us) {
+    uint64_t now_us = monotonic_us();
+    uint64_t sweep_start = trace_now_us();
+    int n = sensor_state_due(&state->sensors, now_us, due);
+    int pressured = -1;     /* Checked once per batch, on the first GPIO sensor */
+    int num_gpio = 0;       /* GPIO sensors collected at the front of due[] */
+    uint64_t deadline_us;
+    int i;
+    
+    /* Watchdog covers each batch of due sensors; their reads end well before it */
+    alarm(WATCHDOG_TIMEOUT_SEC);
+    deadline_us = monotonic_us() + DHT11_READ_DEADLINE_US;
+    for (i = 0; i < n && g_running; i++) {
+        int idx = due[i];
+        uint64_t read_us = trace_now_us();
+        
+        /* Under pressure, move bit-banged reads to the next quiet slot, but
+         * never leave a sensor more than two intervals without an attempt */
+        if (state->configs[idx].backend == BACKEND_GPIO && state->sensors.read_us[idx] != 0 &&
+            read_us - state->sensors.read_us[idx] < 2 * interval_us) {
+            if (pressured < 0) {
+                pressured = pressure_high(&g_pressure, monotonic_us());
+            }
+            if (pressured) {
+                /* Recheck within the window so the next sample measures just the
+                 * wait; the wait counts once however often it is rechecked */
+                state->sensors.next_due_us[idx] = now_us + PRESSURE_WINDOW_US;
+                if (state->sensors.deferred_us[idx] == 0) {
+                    state->sensors.deferred_us[idx] = now_us;
+                    g_pressure_stats.deferrals++;
+                    g_pressure_stats.attempts_saved++;
                 }
-                
-                if (!first) strcat(output, ",");
-                strcat(output, temp_json);
-                first = 0;
-                free(sensor_id_temp);
+                continue;
             }
         }
+        if (state->sensors.deferred_us[idx] != 0) {
+            g_pressure_stats.deferred_us += now_us - state->sensors.deferred_us[idx];
+            state->sensors.deferred_us[idx] = 0;
+        }
         
-        if (!filter || strcmp(filter, "humidity") == 0 || strcmp(filter, "all") == 0) {
-            char humid_json[1024];
-            char *sensor_id_humid = malloc(id_len * 2 + 16);
-            if (sensor_id_humid) {
-                snprintf(sensor_id_humid, id_len * 2 + 16, "%s_humidity", escaped_id);
-                
-                build_sensor_json(humid_json, sizeof(humid_json),
-                                  "dht11_humidity", "humidity", "percentage",
-                                  reading.humidity, configs[i].internal, sensor_id_humid,
-                                  configs[i].sensor_name, error_msg, read_timestamp);
-                
-                /* Grow output buffer if needed */
-                size_t needed = strlen(output) + strlen(humid_json) + 3;
-                if (needed > output_size) {
-                    output_size = needed * 2;
-                    char *new_output = realloc(output, output_size);
-                    if (new_output) output = new_output;
-                }
-                
-                if (!first) strcat(output, ",");
-                strcat(output, humid_json);
-                first = 0;
-                free(sensor_id_humid);
+        state->readings[idx].timestamp = time(NULL);
+        if (state->configs[idx].backend == BACKEND_GPIO) {
+            /* num_gpio <= i, so this only overwrites entries already visited */
+            due[num_gpio++] = idx;
+            continue;
+        }
+        read_sensor(&state->configs[idx], &state->readings[idx], deadline_us);
+        serve_record(state, idx, read_us, now_us, interval_us);
+    }
+    
+    /* Bit-banged sensors are read together so their retries overlap. Pressure
+     * was dealt with above by rescheduling, and a read forced through it must
+     * not then wait on it: the loop answers no clients while reading */
+    if (num_gpio > 0 && g_running) {
+        uint64_t read_us = trace_now_us();
+        
+        read_dht11_batch(state->configs, due, num_gpio, state->readings, deadline_us, false);
+        for (i = 0; i < num_gpio; i++) {
+            serve_record(state, due[i], read_us, now_us, interval_us);
+        }
+    }
+    cancel_watchdog();
+    trace_record(state->trace_fd, TRACE_CMD_SWEEP, NULL, WS_LOCATION_ALL, n, sweep_start, getpid());
+    
+    /* Keep the snapshot in step with the latest readings of every sensor */
+    if (state->snapshot_sink) {
+        char *output = render_json(state->configs, state->readings, state->count, NULL,
+                                   WS_LOCATION_ALL, state->render_cache);
+        if (output) {
+            snapshot_sink_write(state->snapshot_sink, output);
+            free(output);
+        }
+    }
+}
+
+/*
+ * Serve mode: node daemon that reads each sensor every interval and answers
+ * requests from the latest readings over TCP (see server.h for the protocol).
+ * args are the arguments following "serve".
+ */
+static int run_serve(sensor_config_t *configs, int count, int argc, char *argv[], int trace_fd) {
+    int interval_sec = SERVER_DEFAULT_INTERVAL_SEC;
+    int port = SERVER_DEFAULT_PORT;
+    const char *bind_addr = NULL;
+    char default_handoff_path[64];
+    const char *handoff_path = NULL;
+    const char *snapshot_path = NULL;
+    int takeover = 0;
+    int taken = HANDOFF_NO_DAEMON;
+    handoff_listener_t handoff;
+    int handed_off = 0;
+    line_server_t *server = NULL;
+    serve_state_t state;
+    struct pollfd fds[2 + SERVER_MAX_CLIENTS];
+    int *due;
+    int i;
+    
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            bind_addr = argv[++i];
+        } else if (strcmp(argv[i], "--fields") == 0 && i + 1 < argc) {
+            set_field_projection(argv[++i]);
+        } else if (strcmp(argv[i], "--handoff") == 0 && i + 1 < argc) {
+            handoff_path = argv[++i];
+        } else if (strcmp(argv[i], "--takeover") == 0) {
+            takeover = 1;
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown serve option: %s\n", argv[i]);
+            fprintf(stderr, "Usage: sensor-dht11 serve [--port N] [--bind ADDR] "
+                            "[--interval SECS] [--fields LIST] [--snapshot PATH] "
+                            "[--handoff PATH] [--takeover]\n");
+            return WS_EXIT_INVALID_ARG;
+        }
+    }
+    
+    if (interval_sec < 1 || port < 1 || port > 65535) {
+        fprintf(stderr, "Interval and port must be positive\n");
+        return WS_EXIT_INVALID_ARG;
+    }
+    if (!handoff_path) {
+        snprintf(default_handoff_path, sizeof(default_handoff_path), HANDOFF_PATH_FORMAT, port);
+        handoff_path = default_handoff_path;
+    }
+    
+    memset(&state, 0, sizeof(state));
+    state.configs = configs;
+    state.count = count;
+    state.trace_fd = trace_fd;
+    state.readings = calloc(count, sizeof(sensor_reading_t));
+    state.render_cache = calloc(count, sizeof(render_cache_t));
+    due = calloc(count, sizeof(int));
+    if (!state.readings || !state.render_cache || !due ||
+        sensor_state_init(&state.sensors, configs, count, monotonic_us()) < 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+    } else if (snapshot_path && !(state.snapshot_sink = snapshot_sink_open(snapshot_path))) {
+        server = NULL;      /* snapshot_sink_open() has said why */
+    } else if (!takeover) {
+        server = server_open(bind_addr, port);
+    } else {
+        /* Adopt the running daemon's sockets and state, or start afresh if there is none */
+        taken = handoff_take(handoff_path, &server, &state.sensors, state.readings);
+        if (taken == HANDOFF_NO_DAEMON) {
+            server = server_open(bind_addr, port);
+        } else if (taken == HANDOFF_TAKEN) {
+            fprintf(stderr, "Took over %d clients from the running daemon\n",
+                    server_client_count(server));
+        }
+    }
+    if (!server) {
+        snapshot_sink_close(state.snapshot_sink);
+        sensor_state_free(&state.sensors);
+        free(state.readings);
+        free(state.render_cache);
+        free(due);
+        return 1;
+    }
+    
+    setup_watch_signal_handlers();
+    
+    /* A replacement can take over without clients noticing; optional */
+    handoff_listen(handoff_path, taken == HANDOFF_TAKEN, &handoff);
+    
+    while (g_running) {
+        uint64_t next_due_us;
+        uint64_t now_us;
+        int nfds;
+        int total;
+        
+        /* Requests wait while sensors are read; they are answered from the results */
+        if (sensor_state_next_due(&state.sensors) <= monotonic_us()) {
+            serve_read_due(&state, due, (uint64_t)interval_sec * 1000000ULL);
+        }
+        
+        next_due_us = sensor_state_next_due(&state.sensors);
+        now_us = monotonic_us();
+        nfds = server_pollfds(server, fds, 1 + SERVER_MAX_CLIENTS);
+        total = nfds;
+        if (handoff.fd >= 0) {
+            fds[total].fd = handoff.fd;
+            fds[total].events = POLLIN;
+            fds[total].revents = 0;
+            total++;
+        }
+        if (poll(fds, total, next_due_us > now_us ? (int)((next_due_us - now_us + 999) / 1000) : 0) > 0) {
+            if (total > nfds && (fds[nfds].revents & POLLIN) &&
+                handoff_give(handoff.fd, server, &state.sensors, state.readings) == 0) {
+                handed_off = 1;
+                break;
             }
+            server_dispatch(server, fds, nfds, serve_request, &state);
         }
+    }
+    
+    /* After a hand-off the socket file belongs to the replacement */
+    handoff_close(&handoff, handed_off ? NULL : handoff_path);
+    report_pressure_stats();
+    server_close(server);
+    snapshot_sink_close(state.snapshot_sink);
+    sensor_state_free(&state.sensors);
+    free(state.readings);
+    free(state.render_cache);
+    free(due);
+    return WS_EXIT_SUCCESS;
+}
+
+/*
+ * Read node addresses, one HOST:PORT per line, into nodes starting at count.
+ * Returns the new count, or -1 on error.
+ */
+static int read_node_file(const char *path, char ***nodes, int count) {
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    
+    if (!fp) {
+        log_error("Cannot open node list %s: %s", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        char *start = line + strspn(line, " \t");
+        char **grown;
         
-        free(escaped_id);
+        start[strcspn(start, " \t\r\n#")] = '\0';
+        if (*start == '\0') {
+            continue;
+        }
+        grown = realloc(*nodes, (count + 1) * sizeof(char *));
+        if (!grown || !(grown[count] = strdup(start))) {
+            *nodes = grown ? grown : *nodes;
+            fclose(fp);
+            return -1;
+        }
+        *nodes = grown;
+        count++;
     }
+    fclose(fp);
+    return count;
+}
+
+/*
+ * Gateway command: poll many node daemons and merge their readings.
+ * args are the arguments following "gateway".
+ */
+static int run_gateway(int argc, char *argv[]) {
+    gateway_opts_t opts;
+    char request[SERVER_MAX_REQUEST];
+    char **nodes = NULL;
+    int count = 0;
+    int result;
+    int i;
     
-    strcat(output, "]");
-    printf("%s\n", output);
-    free(output);
+    memset(&opts, 0, sizeof(opts));
+    opts.interval_ms = GATEWAY_DEFAULT_INTERVAL_MS;
+    opts.depth = GATEWAY_DEFAULT_DEPTH;
+    snprintf(request, sizeof(request), "READ");
+    
+    for (i = 0; i < argc && count >= 0; i++) {
+        if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+            count = read_node_file(argv[++i], &nodes, count);
+        } else if (strcmp(argv[i], "--interval-ms") == 0 && i + 1 < argc) {
+            opts.interval_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            opts.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            opts.duration_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            opts.report_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            opts.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            opts.bind_addr = argv[++i];
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            opts.quiet = true;
+        } else if (strcmp(argv[i], "temperature") == 0 || strcmp(argv[i], "humidity") == 0 ||
+                   strcmp(argv[i], "internal") == 0 || strcmp(argv[i], "external") == 0) {
+            snprintf(request, sizeof(request), "READ %s", argv[i]);
+        } else if (strchr(argv[i], ':') && argv[i][0] != '-') {
+            char **grown = realloc(nodes, (count + 1) * sizeof(char *));
+            if (!grown || !(grown[count] = strdup(argv[i]))) {
+                nodes = grown ? grown : nodes;
+                count = -1;
+                break;
+            }
+            nodes = grown;
+            count++;
+        } else {
+            count = -1;
+        }
+    }
+    
+    if (count <= 0 || opts.interval_ms < 1 || opts.depth < 1 || opts.depth > GATEWAY_MAX_DEPTH ||
+        opts.duration_sec < 0 || opts.report_sec < 0 || opts.port < 0 || opts.port > 65535) {
+        fprintf(stderr, "Usage: sensor-dht11 gateway [HOST:PORT]... [--nodes FILE] "
+                        "[--interval-ms MS] [--depth N] [--duration SECS] [--report SECS] "
+                        "[--port N] [--bind ADDR] [--quiet] "
+                        "[temperature|humidity|internal|external]\n");
+        result = WS_EXIT_INVALID_ARG;
+    } else {
+        opts.nodes = nodes;
+        opts.node_count = count;
+        opts.request = request;
+        setup_watch_signal_handlers();
+        result = gateway_run(&opts);
+    }
+    
+    for (i = 0; nodes && i < count; i++) {
+        free(nodes[i]);
+    }
+    free(nodes);
+    return result;
+}
+
+/*
+ * Parse a comma-separated list of non-negative integers.
+ * Returns the number parsed, or -1 if the list is malformed or too long.
+ */
+static int parse_int_list(const char *list, int *values, int max) {
+    int n = 0;
+    char *end;
+    
+    while (*list) {
+        long value = strtol(list, &end, 10);
+        if (end == list || value < 0 || n == max) {
+            return -1;
+        }
+        values[n++] = (int)value;
+        list = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+    return n;
+}
+
+/*
+ * Replay command: simulate a recorded trace against serve at several intervals.
+ * args are the arguments following "replay".
+ */
+static int run_replay(sensor_config_t *configs, int count, int argc, char *argv[]) {
+    trace_replay_opts_t opts;
+    const char *trace_path = NULL;
+    int i;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.intervals[0] = SERVER_DEFAULT_INTERVAL_SEC;
+    opts.intervals[1] = 30;
+    opts.intervals[2] = 60;
+    opts.intervals[3] = 300;
+    opts.n_intervals = 4;
+    opts.fail_rate = SIM_DEFAULT_FAIL_RATE;
+    opts.seed = 1;
+    
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            opts.n_intervals = parse_int_list(argv[++i], opts.intervals, TRACE_MAX_SETTINGS);
+        } else if (strcmp(argv[i], "--fail-rate") == 0 && i + 1 < argc) {
+            opts.fail_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            opts.seed = strtoull(argv[++i], NULL, 10);
+        } else if (!trace_path && argv[i][0] != '-') {
+            trace_path = argv[i];
+        } else {
+            trace_path = NULL;
+            break;
+        }
+    }
+    
+    /* serve reads at most once a second */
+    for (i = 0; i < opts.n_intervals; i++) {
+        if (opts.intervals[i] < 1) {
+            opts.n_intervals = -1;
+        }
+    }
+    if (!trace_path || opts.n_intervals <= 0 || opts.fail_rate < 0.0 || opts.fail_rate >= 1.0) {
+        fprintf(stderr, "Usage: sensor-dht11 replay TRACE [--interval LIST] [--fail-rate P] "
+                        "[--seed N]\n");
+        return WS_EXIT_INVALID_ARG;
+    }
+    
+    return trace_replay(trace_path, configs, count, &opts) == 0 ? WS_EXIT_SUCCESS : 1;
+}
+
+/*
+ * Export command: write readings stored by watch --sqlite as Arrow IPC.
+ * args are the arguments following "export".
+ */
+static int run_export(int argc, char *argv[]) {
+    arrow_export_opts_t opts;
+    const char *sqlite_path = NULL;
+    const char *output_path = NULL;
+    FILE *out = stdout;
+    int result;
+    int i;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.to = (time_t)INT64_MAX;
+    opts.batch_rows = ARROW_DEFAULT_BATCH_ROWS;
+    opts.sensor_ids = calloc(argc > 0 ? argc : 1, sizeof(char *));
+    if (!opts.sensor_ids) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--sqlite") == 0 && i + 1 < argc) {
+            sqlite_path = argv[++i];
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            opts.from = (time_t)atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            opts.to = (time_t)atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--sensor") == 0 && i + 1 < argc) {
+            opts.sensor_ids[opts.sensor_id_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--batch-rows") == 0 && i + 1 < argc) {
+            opts.batch_rows = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            opts.stream = true;
+        } else {
+            sqlite_path = NULL;
+            break;
+        }
+    }
+    
+    if (!sqlite_path || opts.batch_rows < 1) {
+        fprintf(stderr, "Usage: sensor-dht11 export --sqlite PATH [--from TIME] [--to TIME] "
+                        "[--sensor ID]... [--output FILE] [--batch-rows N] [--stream]\n");
+        free(opts.sensor_ids);
+        return WS_EXIT_INVALID_ARG;
+    }
+    
+    if (output_path) {
+        out = fopen(output_path, "wb");
+        if (!out) {
+            log_error("Cannot open %s for writing: %s", output_path, strerror(errno));
+            free(opts.sensor_ids);
+            return 1;
+        }
+    }
+    
+    result = arrow_export(sqlite_path, out, &opts) == 0 ? WS_EXIT_SUCCESS : 1;
+    
+    if (out != stdout && fclose(out) != 0) {
+        result = 1;
+    }
+    free(opts.sensor_ids);
+    return result;
 }
 
 int main(int argc, char *argv[]) {
@@ -867,6 +1947,13 @@ int main(int argc, char *argv[]) {
     int config_count = 0;
     const char *filter = NULL;
     ws_location_filter_t location_filter = WS_LOCATION_ALL;
+    int watch = 0;
+    int serve = 0;
+    int replay = 0;
+    int result = WS_EXIT_SUCCESS;
+    int trace_fd;
+    uint64_t start_us = trace_now_us();
+    const char *config_path;
     
     /* Initialize syslog */
     openlog("sensor-dht11", LOG_PID | LOG_CONS, LOG_USER);
@@ -877,6 +1964,13 @@ int main(int argc, char *argv[]) {
     /* Setup watchdog to prevent hanging on GPIO issues */
     setup_watchdog();
     
+    /* Output field projection applies to every command that prints readings */
+    if (argc >= 3 && strcmp(argv[1], "--fields") == 0) {
+        set_field_projection(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    
     if (argc >= 2) {
         if (strcmp(argv[1], "identify") == 0) {
             ws_cmd_identify();
@@ -919,18 +2013,39 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[1], "temperature") == 0 || 
                    strcmp(argv[1], "humidity") == 0) {
             filter = argv[1];
+        } else if (strcmp(argv[1], "watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[1], "replay") == 0) {
+            /* Replay is pure simulation; no GPIO is touched */
+            cancel_watchdog();
+            replay = 1;
+        } else if (strcmp(argv[1], "serve") == 0) {
+            serve = 1;
+        } else if (strcmp(argv[1], "gateway") == 0) {
+            /* The gateway reads no sensors; it only talks to node daemons */
+            cancel_watchdog();
+            result = run_gateway(argc - 2, argv + 2);
+            closelog();
+            return result;
+        } else if (strcmp(argv[1], "export") == 0) {
+            /* Large exports can outlast the watchdog; no GPIO is touched */
+            cancel_watchdog();
+            result = run_export(argc - 2, argv + 2);
+            closelog();
+            return result;
         } else if (strcmp(argv[1], "internal") == 0) {
             location_filter = WS_LOCATION_INTERNAL;
         } else if (strcmp(argv[1], "external") == 0) {
             location_filter = WS_LOCATION_EXTERNAL;
         } else if (strcmp(argv[1], "all") != 0) {
             fprintf(stderr, "Unknown command: %s\n", argv[1]);
-            fprintf(stderr, "Usage: sensor-dht11 [--version|identify|list|setup|enable|mock|temperature|humidity|internal|external|all]\n");
+            fprintf(stderr, "Usage: sensor-dht11 [--fields LIST] [--version|identify|list|setup|enable|mock|watch|serve|gateway|export|replay|temperature|humidity|internal|external|all]\n");
             return WS_EXIT_INVALID_ARG;
         }
     }
     
-    configs = load_config(CONFIG_PATH, &config_count);
+    config_path = getenv(CONFIG_ENV);
+    configs = load_config(config_path && *config_path ? config_path : CONFIG_PATH, &config_count);
     if (configs == NULL || config_count == 0) {
         /* Use default config - allocate dynamically for consistency */
         char *serial = get_serial_number();
@@ -938,17 +2053,35 @@ int main(int argc, char *argv[]) {
         default_config.internal = false;
         default_config.sensor_id = serial;
         default_config.sensor_name = NULL;  /* NULL = use sc-prototype default */
+        default_config.backend = BACKEND_GPIO;
+        default_config.device = NULL;
+        default_config.mcu_decoded = false;
         configs = &default_config;
         config_count = 1;
     }
     
-    output_json(configs, config_count, filter, location_filter);
+    trace_fd = replay ? -1 : trace_open();
+    
+    if (replay) {
+        result = run_replay(configs, config_count, argc - 2, argv + 2);
+    } else if (watch) {
+        result = run_watch(configs, config_count, argc - 2, argv + 2, trace_fd);
+    } else if (serve) {
+        result = run_serve(configs, config_count, argc - 2, argv + 2, trace_fd);
+    } else {
+        output_json(configs, config_count, filter, location_filter);
+        trace_record(trace_fd, TRACE_CMD_READ, filter, location_filter,
+                     count_selected(configs, config_count, location_filter), start_us, getppid());
+    }
+    trace_close(trace_fd);
+    mcu_close_all();
     
     /* Free config */
     if (configs == &default_config) {
         /* Free just the strings from stack-allocated default */
         free(default_config.sensor_id);
         free(default_config.sensor_name);
+        free(default_config.device);
     } else {
         free_config(configs, config_count);
     }
@@ -957,5 +2090,5 @@ int main(int argc, char *argv[]) {
     cancel_watchdog();
     
     closelog();
-    return WS_EXIT_SUCCESS;
+    return result;
 }
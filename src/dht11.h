@@ -9,9 +9,14 @@
 #define DHT11_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <signal.h>
+#include <time.h>
 #include <ws_utils.h>
 
+#include "pulse_classifier.h"
+
 /* Version information - passed via -DVERSION from Makefile (extracted from debian/changelog) */
 #ifndef VERSION
 #define VERSION "unknown"
@@ -21,16 +26,52 @@
 /* Watchdog timeout for entire read operation (seconds) */
 #define WATCHDOG_TIMEOUT_SEC  30
 
+/* DHT11 timing constants (microseconds) */
+#define DHT11_START_LOW_US      20000   /* Start signal: pull low for 20ms */
+#define DHT11_START_HIGH_US     20      /* Then release for 20-40us */
+#define DHT11_TIMEOUT_US        1000    /* Timeout waiting for edges */
+#define DHT11_FRAME_US          4200    /* Response plus 40 data bits, worst case */
+#define DHT11_ATTEMPT_US        (DHT11_START_LOW_US + DHT11_START_HIGH_US + DHT11_FRAME_US)
+
+/* Longest a sweep's reads may take, including retries and waiting for a busy
+ * line, from when the watchdog is armed; below the watchdog so the watchdog
+ * only catches hangs */
+#define DHT11_READ_DEADLINE_US  (20 * 1000000ULL)
+
+/* dht11 read result: the line is held by another process */
+#define DHT11_LINE_BUSY         -2
+
+/* Pulse pairs sampled per frame: 40 data bits and room for glitches */
+#define DHT11_MAX_PULSES        50
+
+/* Fewest pulse pairs a frame is decoded from; missing leading bits are zeros */
+#define DHT11_MIN_PULSES        38
+
 /* Default configuration */
 #define DEFAULT_PIN       4
 #define CONFIG_PATH       "/etc/ws/sensors/dht11.json"
+#define CONFIG_ENV        "SENSOR_DHT11_CONFIG"   /* Overrides CONFIG_PATH */
+
+/* Default seconds between sweeps in watch mode */
+#define WATCH_DEFAULT_INTERVAL_SEC  60
+
+/* How a sensor is read */
+typedef enum {
+    BACKEND_GPIO = 0,   /* Bit-banged on a Raspberry Pi GPIO line */
+    BACKEND_SERIAL,     /* Through an offload microcontroller on a serial device */
+    BACKEND_SPI,        /* Hardware-timed samples from an SPI controller */
+    BACKEND_SIM         /* Simulated sensor with realistic timing, for testing */
+} sensor_backend_t;
 
 /* Sensor configuration structure */
 typedef struct {
-    int pin;
+    int pin;            /* GPIO line, or the MCU pin for the serial backend */
     bool internal;
     char *sensor_id;    /* Dynamically allocated */
     char *sensor_name;  /* Dynamically allocated, NULL if not set */
+    sensor_backend_t backend;
+    char *device;       /* Serial or SPI device; dynamically allocated, NULL if not set */
+    bool mcu_decoded;   /* Serial backend: the MCU decodes the frame itself */
 } sensor_config_t;
 
 /* Sensor reading structure */
@@ -39,12 +80,54 @@ typedef struct {
     float humidity;
     bool valid;
     char error_msg[128];
+    time_t timestamp;   /* Unix time when the sensor was read */
+    uint8_t raw[5];     /* Frame the values were decoded from, valid readings only */
 } sensor_reading_t;
 
+/* One frame as sampled: its data-bit pulse pairs, decoded later at normal priority */
+typedef struct {
+    int count;
+    dht11_pulse_t pulses[DHT11_MAX_PULSES];
+} dht11_frame_t;
+
+/* Rendered records for one sensor, reused while the raw frame and error are unchanged */
+typedef struct {
+    bool valid;
+    uint8_t raw[5];
+    char error_msg[128];
+    bool rendered[2];           /* Temperature, humidity; set once the timestamp is located */
+    char records[2][1024];
+    size_t timestamp_pos[2];    /* Offset of the timestamp digits */
+    size_t timestamp_len[2];
+} render_cache_t;
+
+/* Cleared by the signal handlers; long reads stop retrying */
+extern volatile sig_atomic_t g_running;
+
+/* Retry backoff schedule used by read_dht11() */
+extern const uint32_t retry_delays_us[];
+extern const int num_retries;
+
 /* Function prototypes */
+void log_error(const char *fmt, ...);
+uint64_t monotonic_us(void);
+int dht11_sample(int gpio_pin, dht11_frame_t *frame, char *error_msg, size_t error_len);
+float dht11_temperature(const uint8_t raw[5]);
+int dht11_decode(const dht11_frame_t *frame, sensor_reading_t *reading);
 int read_dht11(int gpio_pin, sensor_reading_t *reading);
+int read_dht11_until(int gpio_pin, sensor_reading_t *reading, uint64_t deadline_us, bool defer);
+int read_sensor(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us);
+void set_field_projection(const char *fields);
 sensor_config_t *load_config(const char *path, int *count);
 void free_config(sensor_config_t *configs, int count);
+bool sensor_selected(const sensor_config_t *config, ws_location_filter_t location_filter);
+int count_selected(const sensor_config_t *configs, int count, ws_location_filter_t location_filter);
+bool measurement_selected(const char *filter, const char *measurement);
+void read_sensors(sensor_config_t *configs, int count, ws_location_filter_t location_filter,
+                  sensor_reading_t *readings);
+char *render_json(const sensor_config_t *configs, const sensor_reading_t *readings, int count,
+                  const char *filter, ws_location_filter_t location_filter,
+                  render_cache_t *cache);
 void output_json(sensor_config_t *configs, int count, const char *filter, ws_location_filter_t location_filter);
 
 #endif /* DHT11_H */
@@ -0,0 +1,434 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * C++20 API with coroutine-based reads.
+ *
+ * A read is a coroutine. The 20ms start signal and the retry backoff suspend
+ * it on an event loop timer instead of sleeping, so one thread can keep
+ * hundreds of reads in flight. Only the ~5ms in which a frame is sampled
+ * runs to completion, through the same dht11_exchange() and dht11_decode()
+ * that read_dht11() uses. The sensor
+ * model and backend are template parameters, resolved at compile time:
+ *
+ *   dht11::event_loop loop;
+ *   dht11::gpio_chip chip;
+ *   dht11::sensor<dht11::dht11_model, dht11::gpio_backend> s(loop, chip, 4);
+ *   loop.spawn([&]() -> dht11::task<void> {
+ *       sensor_reading_t r = co_await s.read();
+ *       ...
+ *   }());
+ *   loop.run();
+ *
+ * The reading core and simulator are C: compile dht11_core.c,
+ * pulse_classifier.c and simulator.c alongside, and link with -lgpiod.
+ */
+
+#ifndef DHT11_HPP
+#define DHT11_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <gpiod.h>
+#include "dht11.h"
+#include "dht11_core.h"
+#include "simulator.h"
+}
+
+namespace dht11 {
+
+using clock = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+template <typename T> class task;
+
+namespace detail {
+
+/* Resumes whoever awaited the task when it finishes */
+struct final_awaiter {
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) const noexcept {
+        return h.promise().continuation;
+    }
+    void await_resume() const noexcept {}
+};
+
+struct promise_base {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+    
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct promise : promise_base {
+    T value{};
+    
+    task<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T result() {
+        if (error) std::rethrow_exception(error);
+        return std::move(value);
+    }
+};
+
+template <>
+struct promise<void> : promise_base {
+    task<void> get_return_object();
+    void return_void() const noexcept {}
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+/*
+ * Lazily started coroutine producing a T. Awaiting it starts it and resumes
+ * the awaiter when it finishes; event_loop::spawn() starts it detached.
+ */
+template <typename T = void>
+class task {
+public:
+    using promise_type = detail::promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+    
+    explicit task(handle_type h) noexcept : handle_(h) {}
+    task(task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    task &operator=(task &&other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+    ~task() {
+        if (handle_) handle_.destroy();
+    }
+    
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle_.promise().continuation = awaiter;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+    
+    void start() { handle_.resume(); }
+    bool done() const noexcept { return handle_.done(); }
+    T result() { return handle_.promise().result(); }
+
+private:
+    handle_type handle_;
+};
+
+namespace detail {
+
+template <typename T>
+task<T> promise<T>::get_return_object() {
+    return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() {
+    return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+/*
+ * Single-threaded event loop: a timer queue of suspended coroutines
+ */
+class event_loop {
+public:
+    struct sleep_awaiter {
+        event_loop &loop;
+        clock::time_point at;
+        
+        bool await_ready() const noexcept { return at <= clock::now(); }
+        void await_suspend(std::coroutine_handle<> h) { loop.timers_.push({at, loop.sequence_++, h}); }
+        void await_resume() const noexcept {}
+    };
+    
+    event_loop() = default;
+    event_loop(const event_loop &) = delete;
+    event_loop &operator=(const event_loop &) = delete;
+    
+    sleep_awaiter sleep_until(clock::time_point at) { return {*this, at}; }
+    sleep_awaiter sleep_for(microseconds delay) { return {*this, clock::now() + delay}; }
+    
+    /* Start a task; the loop owns it until run() returns */
+    void spawn(task<void> t) {
+        tasks_.push_back(std::move(t));
+        tasks_.back().start();
+    }
+    
+    /*
+     * Resume timers as they expire until every coroutine has finished.
+     * Rethrows the first exception a spawned task ended with.
+     */
+    void run() {
+        while (!timers_.empty()) {
+            timer next = timers_.top();
+            timers_.pop();
+            std::this_thread::sleep_until(next.at);
+            next.handle.resume();
+        }
+        std::vector<task<void>> finished;
+        finished.swap(tasks_);
+        for (auto &t : finished) {
+            t.result();
+        }
+    }
+
+private:
+    struct timer {
+        clock::time_point at;
+        uint64_t sequence;          /* Keeps equal deadlines in FIFO order */
+        std::coroutine_handle<> handle;
+        
+        bool operator>(const timer &other) const {
+            return at != other.at ? at > other.at : sequence > other.sequence;
+        }
+    };
+    
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>> timers_;
+    uint64_t sequence_ = 0;
+    std::vector<task<void>> tasks_;
+};
+
+/*
+ * DHT11 timing, retry schedule and value conversion
+ */
+struct dht11_model {
+    static constexpr microseconds start_low{DHT11_START_LOW_US};
+    static constexpr microseconds start_high{DHT11_START_HIGH_US};
+    static constexpr microseconds frame{DHT11_FRAME_US};
+    static constexpr microseconds read_deadline{DHT11_READ_DEADLINE_US};
+    
+    /* The schedule read_dht11() backs off with */
+    static std::span<const uint32_t> retry_delays() {
+        return {::retry_delays_us, (std::size_t)::num_retries};
+    }
+    
+    static void convert(const uint8_t raw[5], sensor_reading_t &reading) {
+        reading.humidity = (float)raw[0] + (float)raw[1] / 10.0f;
+        reading.temperature = dht11_temperature(raw);
+    }
+};
+
+template <typename M>
+concept sensor_model = requires(const uint8_t *raw, sensor_reading_t &reading) {
+    { M::start_low } -> std::convertible_to<microseconds>;
+    { M::start_high } -> std::convertible_to<microseconds>;
+    { M::frame } -> std::convertible_to<microseconds>;
+    { M::read_deadline } -> std::convertible_to<microseconds>;
+    { M::retry_delays() } -> std::convertible_to<std::span<const uint32_t>>;
+    M::convert(raw, reading);
+};
+
+/*
+ * A backend makes one attempt to read a raw frame. The result is 0 on
+ * success, DHT11_LINE_BUSY if another process holds the line, or -1 on
+ * other failures; error is left empty when retrying may help.
+ */
+template <typename B, typename M>
+concept sensor_backend = requires(B &backend, event_loop &loop, uint8_t *raw, char *error,
+                                  std::size_t error_size) {
+    { backend.template attempt<M>(loop, raw, error, error_size) } -> std::same_as<task<int>>;
+};
+
+/*
+ * RAII handle on a GPIO chip, shared by the sensors wired to it
+ */
+class gpio_chip {
+public:
+    explicit gpio_chip(const char *path = "/dev/gpiochip0") : chip_(gpiod_chip_open(path)) {
+        if (!chip_) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+    }
+    ~gpio_chip() { gpiod_chip_close(chip_); }
+    gpio_chip(const gpio_chip &) = delete;
+    gpio_chip &operator=(const gpio_chip &) = delete;
+    
+    struct gpiod_chip *get() const noexcept { return chip_; }
+
+private:
+    struct gpiod_chip *chip_;
+};
+
+/*
+ * Bit-banged GPIO backend: a session on one line of a gpio_chip. The line
+ * is requested only for the duration of each attempt, as read_dht11() does,
+ * and released by the destructor if an attempt is abandoned.
+ */
+class gpio_backend {
+public:
+    gpio_backend(gpio_chip &chip, unsigned int pin)
+        : pin_(pin), line_(gpiod_chip_get_line(chip.get(), pin)) {
+        if (!line_) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "GPIO line " + std::to_string(pin));
+        }
+    }
+    ~gpio_backend() { release(); }
+    gpio_backend(const gpio_backend &) = delete;
+    gpio_backend &operator=(const gpio_backend &) = delete;
+    
+    template <sensor_model Model>
+    task<int> attempt(event_loop &loop, uint8_t *raw, char *error, std::size_t error_size) {
+        dht11_frame_t frame;
+        sensor_reading_t decoded{};
+        
+        if (gpiod_line_request_output(line_, "dht11", 0) < 0) {
+            co_return dht11_request_failed((int)pin_, "output", error, error_size);
+        }
+        requested_ = true;
+        
+        /* Other sensors run while this one holds its start signal low */
+        co_await loop.sleep_for(Model::start_low);
+        
+        /* The exchange runs without suspending and releases the line */
+        requested_ = false;
+        int result = dht11_exchange(line_, (int)pin_, &frame, error, error_size);
+        if (result != 0) {
+            co_return result;
+        }
+        if (dht11_decode(&frame, &decoded) < 0) {
+            co_return -1;
+        }
+        std::memcpy(raw, decoded.raw, sizeof(decoded.raw));
+        co_return 0;
+    }
+
+private:
+    unsigned int pin_;
+    struct gpiod_line *line_;
+    bool requested_ = false;
+    
+    void release() {
+        if (requested_) {
+            gpiod_line_release(line_);
+            requested_ = false;
+        }
+    }
+};
+
+/*
+ * Simulated backend: each attempt takes as long as a real one and fails
+ * with the C simulator's probability, with the frames it produces
+ */
+class sim_backend {
+public:
+    explicit sim_backend(int pin, double fail_rate = SIM_DEFAULT_FAIL_RATE, uint64_t seed = 0)
+        : pin_(pin) {
+        simulator_init(&sim_, seed ? seed : 0x9E3779B97F4A7C15ULL ^ ((uint64_t)pin << 32),
+                       fail_rate);
+    }
+    
+    template <sensor_model Model>
+    task<int> attempt(event_loop &loop, uint8_t *raw, char *, std::size_t) {
+        co_await loop.sleep_for(Model::start_low + Model::start_high + Model::frame);
+        co_return simulator_attempt(&sim_, pin_, raw);
+    }
+
+private:
+    int pin_;
+    simulator_t sim_;
+};
+
+/*
+ * One sensor: a backend driven with a model's timing and retry schedule.
+ * The sensor must outlive its reads, and reads one at a time.
+ */
+template <sensor_model Model, typename Backend>
+    requires sensor_backend<Backend, Model>
+class sensor {
+public:
+    template <typename... Args>
+    explicit sensor(event_loop &loop, Args &&...args)
+        : loop_(loop), backend_(std::forward<Args>(args)...) {}
+    
+    /*
+     * Read with retries, suspending between attempts. A line held by
+     * another process is backed off from like a failed attempt. Gives up
+     * once the next backoff would pass the deadline; reading.valid reports
+     * success and reading.error_msg the reason for failure.
+     */
+    task<sensor_reading_t> read(microseconds deadline = Model::read_deadline) {
+        sensor_reading_t reading{};
+        const std::span<const uint32_t> delays = Model::retry_delays();
+        clock::time_point give_up = clock::now() + deadline;
+        bool busy = false;
+        std::size_t attempt;
+        
+        for (attempt = 0; attempt <= delays.size(); attempt++) {
+            reading.error_msg[0] = '\0';
+            int result = co_await backend_.template attempt<Model>(loop_, reading.raw,
+                                                                   reading.error_msg,
+                                                                   sizeof(reading.error_msg));
+            if (result == 0) {
+                Model::convert(reading.raw, reading);
+                reading.valid = true;
+                reading.timestamp = std::time(nullptr);
+                co_return reading;
+            }
+            
+            /* A busy line may be let go; a specific error, such as a
+             * permission problem, won't go away */
+            busy = result == DHT11_LINE_BUSY;
+            if (!busy && reading.error_msg[0] != '\0') {
+                co_return reading;
+            }
+            
+            if (attempt < delays.size()) {
+                microseconds delay{delays[attempt]};
+                if (clock::now() + delay >= give_up) {
+                    attempt++;
+                    break;
+                }
+                co_await loop_.sleep_for(delay);
+            }
+        }
+        
+        /* Still busy: keep the backend's message saying so */
+        if (!busy) {
+            std::snprintf(reading.error_msg, sizeof(reading.error_msg),
+                          "Failed to read DHT11 after %zu attempts", attempt);
+        }
+        reading.timestamp = std::time(nullptr);
+        co_return reading;
+    }
+    
+    Backend &backend() noexcept { return backend_; }
+
+private:
+    event_loop &loop_;
+    Backend backend_;
+};
+
+} // namespace dht11
+
+#endif /* DHT11_HPP */
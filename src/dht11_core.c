@@ -0,0 +1,207 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * DHT11 reading core.
+ *
+ * The bus exchange, frame decoding and retry schedule, kept apart from the
+ * command line tool so the C++ API (dht11.hpp) samples and decodes frames
+ * with the same code. Nothing here logs: errors are returned in error_msg
+ * for the caller to report.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dht11_core.h"
+#include "pulse_classifier.h"
+
+/* Cleared by the signal handlers; long reads stop retrying */
+volatile sig_atomic_t g_running = 1;
+
+/* Retry delays in microseconds: 0.05s x2, 0.1s x3, then 0.2, 0.4, 0.8, 1.6, 2s x3 */
+const uint32_t retry_delays_us[] = {
+    50000, 50000,             /* 0.05s x2 */
+    100000, 100000, 100000,   /* 0.1s x3 */
+    200000, 400000, 800000, 1600000,  /* exponential */
+    2000000, 2000000, 2000000  /* 2s x3 */
+};
+const int num_retries = sizeof(retry_delays_us) / sizeof(retry_delays_us[0]);
+
+/*
+ * Get CLOCK_MONOTONIC time in microseconds, the clock every read deadline
+ * is measured on
+ */
+uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/*
+ * Wait for a specific GPIO level with timeout
+ * Returns the duration in microseconds, or -1 on timeout
+ */
+static int wait_for_level(struct gpiod_line *line, int level, int timeout_us) {
+    uint64_t start = monotonic_us();
+    uint64_t deadline = start + timeout_us;
+    int current;
+    
+    while ((current = gpiod_line_get_value(line)) != level) {
+        if (current < 0) {
+            return -2;  /* Error reading GPIO */
+        }
+        if (monotonic_us() > deadline) {
+            return -1;  /* Timeout */
+        }
+    }
+    return (int)(monotonic_us() - start);
+}
+
+/*
+ * Raise the calling thread to SCHED_FIFO for a bus exchange.
+ * Returns 1 if it was raised, 0 if the priority is not available.
+ */
+static int enter_realtime(void) {
+    struct sched_param rt_param = { .sched_priority = 99 };
+    return sched_setscheduler(0, SCHED_FIFO, &rt_param) == 0;
+}
+
+static void leave_realtime(int had_rt) {
+    struct sched_param normal_param = { .sched_priority = 0 };
+    if (had_rt)
+        sched_setscheduler(0, SCHED_OTHER, &normal_param);
+}
+
+/*
+ * Describe a failed line request from errno.
+ * Returns DHT11_LINE_BUSY if another process holds the line, -1 otherwise.
+ */
+int dht11_request_failed(int gpio_pin, const char *direction, char *error_msg, size_t error_len) {
+    int err = errno;
+    
+    if (!error_msg) {
+        return err == EBUSY ? DHT11_LINE_BUSY : -1;
+    }
+    
+    /* Busy is not a permission problem, and is worth waiting for */
+    if (err == EBUSY) {
+        snprintf(error_msg, error_len, "GPIO %d is in use by another process", gpio_pin);
+        return DHT11_LINE_BUSY;
+    }
+    if (err == EACCES || err == EPERM) {
+        snprintf(error_msg, error_len, "GPIO %d access denied - try running with sudo", gpio_pin);
+    } else {
+        snprintf(error_msg, error_len, "Cannot request GPIO %d as %s: %s",
+                 gpio_pin, direction, strerror(err));
+    }
+    return -1;
+}
+
+/*
+ * Finish the start signal on a line the caller has requested as an output
+ * and held low, then record the width of every low and high the sensor
+ * sends. Only this part runs under SCHED_FIFO. The line is released on
+ * return. Nothing is decoded here (see dht11_decode()).
+ * Returns 0 once the sensor has answered, with frame->count pulse pairs
+ * recorded, DHT11_LINE_BUSY if another process took the line, or -1 on
+ * other errors. error_msg is set for errors that retrying will not fix.
+ */
+int dht11_exchange(struct gpiod_line *line, int gpio_pin, dht11_frame_t *frame,
+                   char *error_msg, size_t error_len) {
+    int had_rt;
+    int i;
+    
+    frame->count = 0;
+    
+    /* From here the sensor sets the pace: hold the CPU until the last edge */
+    had_rt = enter_realtime();
+    
+    /* Pull high and wait for DHT11 response */
+    gpiod_line_set_value(line, 1);
+    usleep(DHT11_START_HIGH_US);
+    
+    /* Release line and switch to input */
+    gpiod_line_release(line);
+    if (gpiod_line_request_input(line, "dht11") < 0) {
+        int result = dht11_request_failed(gpio_pin, "input", error_msg, error_len);
+        leave_realtime(had_rt);
+        return result;
+    }
+    
+    /* DHT11 response: LOW for ~80us, then HIGH for ~80us, then LOW for first bit */
+    if (wait_for_level(line, 0, DHT11_TIMEOUT_US) < 0 ||
+        wait_for_level(line, 1, DHT11_TIMEOUT_US) < 0 ||
+        wait_for_level(line, 0, DHT11_TIMEOUT_US) < 0) {
+        leave_realtime(had_rt);
+        gpiod_line_release(line);
+        return -1;
+    }
+    
+    /* Each bit: LOW for ~50us, then HIGH for 26-28us (0) or 70us (1)
+     * Measure both widths; the LOW is the reference the HIGH is judged by */
+    for (i = 0; i < DHT11_MAX_PULSES; i++) {
+        /* Wait for HIGH with timeout; the wait is the LOW width */
+        int low_duration = wait_for_level(line, 1, DHT11_TIMEOUT_US);
+        if (low_duration < 0) {
+            break;  /* No more bits */
+        }
+        
+        /* Measure how long the HIGH lasts */
+        uint64_t start = monotonic_us();
+        wait_for_level(line, 0, DHT11_TIMEOUT_US);
+        int duration = (int)(monotonic_us() - start);
+        
+        /* Stop if we hit a long timeout (line staying HIGH = end of data) */
+        if (duration > 500) {
+            break;
+        }
+        frame->pulses[frame->count].low_us = (uint16_t)low_duration;
+        frame->pulses[frame->count].high_us = (uint16_t)duration;
+        frame->count++;
+    }
+    leave_realtime(had_rt);
+    
+    gpiod_line_release(line);
+    return 0;
+}
+
+/*
+ * Temperature carried by a DHT11 frame. Below zero the sensor sends the
+ * magnitude, with the sign in the top bit of the tenths byte.
+ */
+float dht11_temperature(const uint8_t raw[5]) {
+    float temperature = (float)raw[2] + (float)(raw[3] & 0x7F) / 10.0f;
+    return (raw[3] & 0x80) ? -temperature : temperature;
+}
+
+/*
+ * Decode a sampled frame into reading. Runs at normal priority.
+ * Returns 0 if the frame passed its checksum, -1 otherwise.
+ */
+int dht11_decode(const dht11_frame_t *frame, sensor_reading_t *reading) {
+    uint8_t data[5];
+    
+    /* We need at least 38 valid pulses - may be missing 1-2 due to timing;
+     * missing bits are taken as leading zeros */
+    if (frame->count < DHT11_MIN_PULSES ||
+        classify_pulses(frame->pulses, frame->count, CLASSIFY_RATIO, data) < 0) {
+        return -1;
+    }
+    
+    /* DHT11 format: data[0]=humidity int, data[1]=humidity dec (always 0)
+     *               data[2]=temp int, data[3]=temp dec, sign in bit 7
+     *               data[4]=checksum */
+    memcpy(reading->raw, data, sizeof(reading->raw));
+    reading->humidity = (float)data[0] + (float)data[1] / 10.0f;
+    reading->temperature = dht11_temperature(data);
+    reading->valid = true;
+    return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * DHT11 bus exchange shared by sensor-dht11 and the C++ API
+ */
+
+#ifndef DHT11_CORE_H
+#define DHT11_CORE_H
+
+#include <stddef.h>
+#include <gpiod.h>
+
+#include "dht11.h"
+
+int dht11_request_failed(int gpio_pin, const char *direction, char *error_msg, size_t error_len);
+int dht11_exchange(struct gpiod_line *line, int gpio_pin, dht11_frame_t *frame,
+                   char *error_msg, size_t error_len);
+
+#endif /* DHT11_CORE_H */
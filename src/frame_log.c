@@ -0,0 +1,157 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Labelled log of raw GPIO frames.
+ *
+ * With SENSOR_DHT11_FRAME_LOG set, every frame measured during a read is
+ * appended once the read succeeds, labelled with the data it returned. The
+ * frames of failed attempts are logged too: the sensor's value does not
+ * change between attempts a fraction of a second apart, so the successful
+ * attempt's data is their label. That label is only what dht11_decode()
+ * made of the successful frame, so the frame is marked and the bake-off
+ * does not score it. Reads that fail outright have no label and are not
+ * logged. benchmarks/decoder_bakeoff.c runs each decoder over the result.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "frame_log.h"
+
+/*
+ * Get the frame log named by SENSOR_DHT11_FRAME_LOG, opened on first use.
+ * Returns NULL if frames are not being logged.
+ */
+FILE *frame_log_file(void) {
+    static FILE *fp;
+    static int checked;
+    
+    if (!checked) {
+        const char *path = getenv(FRAME_LOG_ENV);
+        
+        checked = 1;
+        if (path && *path) {
+            fp = fopen(path, "a");
+            if (!fp) {
+                log_error("Cannot open frame log %s: %s", path, strerror(errno));
+            }
+        }
+    }
+    return fp;
+}
+
+/*
+ * Keep a frame of the read in progress, if frames are being logged
+ */
+void frame_log_keep(frame_log_read_t *read, int pin, const dht11_frame_t *frame) {
+    logged_frame_t *kept;
+    
+    if (!frame_log_file() || frame->count <= 0) {
+        return;
+    }
+    
+    /* Once full, the last slot holds the latest frame: it may be the labelling one */
+    if (read->count < FRAME_LOG_MAX_FRAMES) {
+        read->count++;
+    }
+    kept = &read->frames[read->count - 1];
+    kept->pin = pin;
+    kept->count = frame->count;
+    memcpy(kept->pulses, frame->pulses, (size_t)frame->count * sizeof(frame->pulses[0]));
+}
+
+/*
+ * Log the kept frames of a successful read, labelled with the data it
+ * returned, and start the next read. The last kept frame is the one the
+ * data was decoded from.
+ */
+void frame_log_commit(frame_log_read_t *read, const uint8_t label[5]) {
+    FILE *fp = frame_log_file();
+    int i;
+    
+    for (i = 0; fp && i < read->count; i++) {
+        memcpy(read->frames[i].label, label, sizeof(read->frames[i].label));
+        read->frames[i].labelling = i == read->count - 1;
+        frame_log_write(fp, &read->frames[i]);
+    }
+    if (fp) {
+        fflush(fp);
+    }
+    read->count = 0;
+}
+
+/*
+ * Append one frame as a line of the log.
+ * Returns 0 on success, -1 on error.
+ */
+int frame_log_write(FILE *fp, const logged_frame_t *frame) {
+    int i;
+    
+    fprintf(fp, "%02x%02x%02x%02x%02x", frame->label[0], frame->label[1], frame->label[2],
+            frame->label[3], frame->label[4]);
+    fprintf(fp, "%s %d", frame->labelling ? "*" : "", frame->pin);
+    for (i = 0; i < frame->count; i++) {
+        fprintf(fp, " %u:%u", frame->pulses[i].low_us, frame->pulses[i].high_us);
+    }
+    fputc('\n', fp);
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * Parse one line of the log.
+ * Returns 1 for a frame, 0 for a blank or comment line, -1 if malformed.
+ */
+int frame_log_parse(const char *line, logged_frame_t *frame) {
+    const char *p = line + strspn(line, " \t");
+    char *end;
+    int i;
+    
+    if (*p == '\0' || *p == '\n' || *p == '#') {
+        return 0;
+    }
+    memset(frame, 0, sizeof(*frame));
+    for (i = 0; i < 5; i++) {
+        char byte[3] = { p[0], p[0] ? p[1] : '\0', '\0' };
+        unsigned long value = strtoul(byte, &end, 16);
+        
+        if (end != byte + 2) {
+            return -1;
+        }
+        frame->label[i] = (uint8_t)value;
+        p += 2;
+    }
+    if (*p == '*') {
+        frame->labelling = true;
+        p++;
+    }
+    frame->pin = (int)strtol(p, &end, 10);
+    if ((*p != ' ' && *p != '\t') || end == p) {
+        return -1;
+    }
+    p = end;
+    
+    while (*p == ' ' || *p == '\t') {
+        unsigned long low, high;
+        
+        p += strspn(p, " \t");
+        if (*p == '\0' || *p == '\n' || *p == '\r') {
+            break;
+        }
+        low = strtoul(p, &end, 10);
+        if (end == p || *end != ':' || frame->count == FRAME_LOG_MAX_PULSES) {
+            return -1;
+        }
+        p = end + 1;
+        high = strtoul(p, &end, 10);
+        if (end == p || low > UINT16_MAX || high > UINT16_MAX) {
+            return -1;
+        }
+        p = end;
+        frame->pulses[frame->count].low_us = (uint16_t)low;
+        frame->pulses[frame->count].high_us = (uint16_t)high;
+        frame->count++;
+    }
+    return *p == '\0' || *p == '\n' || *p == '\r' ? 1 : -1;
+}
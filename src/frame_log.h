@@ -0,0 +1,57 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Labelled log of raw GPIO frames, the corpus for decoder comparisons
+ */
+
+#ifndef FRAME_LOG_H
+#define FRAME_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dht11.h"
+
+/* Environment variable naming the file frames are appended to */
+#define FRAME_LOG_ENV           "SENSOR_DHT11_FRAME_LOG"
+
+/* Most pulse pairs kept per frame, as many as dht11_sample() measures */
+#define FRAME_LOG_MAX_PULSES    DHT11_MAX_PULSES
+
+/* Most frames kept per read; a long read keeps its first attempts and its last */
+#define FRAME_LOG_MAX_FRAMES    16
+
+/*
+ * One frame as measured, with the data the read it belongs to finally
+ * returned. A line of the log is the label as 10 hex digits, the GPIO pin,
+ * then LOW:HIGH in microseconds for each pulse pair. The frame the label
+ * was decoded from, always the last of its read, has '*' after the label:
+ *
+ *   2a00170041 4 52:27 49:71 50:26 ...
+ *   2a00170041* 4 51:27 50:70 49:27 ...
+ *
+ * Blank lines and lines starting with '#' are ignored.
+ */
+typedef struct {
+    uint8_t label[5];
+    bool labelling;             /* The label is this frame's own decoding */
+    int pin;
+    int count;
+    dht11_pulse_t pulses[FRAME_LOG_MAX_PULSES];
+} logged_frame_t;
+
+/* Frames of one read in progress, logged once the read has a label */
+typedef struct {
+    int count;
+    logged_frame_t frames[FRAME_LOG_MAX_FRAMES];
+} frame_log_read_t;
+
+FILE *frame_log_file(void);
+void frame_log_keep(frame_log_read_t *read, int pin, const dht11_frame_t *frame);
+void frame_log_commit(frame_log_read_t *read, const uint8_t label[5]);
+int frame_log_write(FILE *fp, const logged_frame_t *frame);
+int frame_log_parse(const char *line, logged_frame_t *frame);
+
+#endif /* FRAME_LOG_H */
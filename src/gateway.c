@@ -0,0 +1,539 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Gateway.
+ *
+ * Keeps one persistent connection to each node daemon and sends it a request
+ * every interval without waiting for earlier answers, up to a pipeline depth,
+ * so a slow node never holds up the others. Every response is written to
+ * stdout as one line tagged with its node, giving a single merged stream,
+ * and the latest response from each node is cached. With --port the gateway
+ * answers READ requests itself from that cache, so gateways can be stacked.
+ *
+ * Staleness is measured end to end: from when the node read its sensors to
+ * when the gateway received the response. Across hosts this relies on the
+ * node and gateway clocks agreeing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "gateway.h"
+#include "server.h"
+#include "trace.h"
+
+typedef enum {
+    NODE_DISCONNECTED = 0,
+    NODE_CONNECTING,
+    NODE_CONNECTED
+} node_state_t;
+
+typedef struct {
+    uint64_t responses;
+    uint64_t errors;            /* ERR responses and malformed lines */
+    uint64_t reconnects;        /* Connections lost */
+    uint64_t bytes;
+    uint64_t rtt_total_us;
+    uint64_t rtt_max_us;
+    uint64_t stale_total_us;
+    uint64_t stale_max_us;
+} node_stats_t;
+
+typedef struct {
+    const char *name;
+    char *host;
+    char *port;
+    int fd;
+    node_state_t state;
+    uint64_t retry_at_us;           /* Next connect attempt while disconnected */
+    uint64_t connect_started_us;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    uint64_t sent_us[GATEWAY_MAX_DEPTH];    /* Send times of requests in flight, oldest first */
+    int in_flight;
+    size_t unsent;              /* Bytes of the last request not yet sent */
+    char *latest;               /* Latest JSON array, NULL until the first response */
+    uint64_t latest_read_us;
+    node_stats_t stats;
+    node_stats_t reported;      /* Stats at the last periodic report */
+    uint64_t window_rtt_max_us;     /* Maxima since the last periodic report */
+    uint64_t window_stale_max_us;
+} gateway_node_t;
+
+typedef struct {
+    gateway_node_t *nodes;
+    int count;
+} gateway_t;
+
+static void disconnect_node(gateway_node_t *node, uint64_t now_us) {
+    if (node->state == NODE_CONNECTED) {
+        node->stats.reconnects++;
+    }
+    if (node->fd >= 0) {
+        close(node->fd);
+    }
+    node->fd = -1;
+    node->state = NODE_DISCONNECTED;
+    node->retry_at_us = now_us + GATEWAY_RECONNECT_MS * 1000ULL;
+    node->in_len = 0;
+    node->in_flight = 0;
+    node->unsent = 0;
+}
+
+/*
+ * Start a non-blocking connect to a node
+ */
+static void connect_node(gateway_node_t *node, uint64_t now_us) {
+    struct addrinfo hints, *res = NULL;
+    int one = 1;
+    int fd;
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(node->host, node->port, &hints, &res) != 0 || !res) {
+        disconnect_node(node, now_us);
+        return;
+    }
+    
+    fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        disconnect_node(node, now_us);
+        return;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    node->fd = fd;
+    node->connect_started_us = now_us;
+    
+    if (connect(fd, res->ai_addr, res->ai_addrlen) == 0) {
+        node->state = NODE_CONNECTED;
+    } else if (errno == EINPROGRESS) {
+        node->state = NODE_CONNECTING;
+    } else {
+        disconnect_node(node, now_us);
+    }
+    freeaddrinfo(res);
+}
+
+/*
+ * Send a request unless the node's pipeline is full.
+ * Requests are small, so a partial send only happens under heavy backpressure;
+ * the remainder is finished before any new request.
+ */
+static void send_request(gateway_node_t *node, const char *request, size_t len,
+                         int depth, uint64_t now_us) {
+    const char *data = request;
+    ssize_t n;
+    
+    if (node->state != NODE_CONNECTED) {
+        return;
+    }
+    if (node->unsent > 0) {
+        data = request + len - node->unsent;
+    } else if (node->in_flight < depth) {
+        node->sent_us[node->in_flight++] = now_us;
+        node->unsent = len;
+    } else {
+        return;
+    }
+    
+    n = send(node->fd, data, node->unsent, MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            disconnect_node(node, now_us);
+        }
+        return;
+    }
+    node->unsent -= (size_t)n;
+}
+
+/*
+ * Account for one response line and add it to the merged stream
+ */
+static void handle_response(gateway_node_t *node, char *line, size_t len, bool quiet,
+                            uint64_t now_us) {
+    uint64_t now_wall_us = trace_now_us();
+    unsigned long long read_us;
+    uint64_t rtt_us, stale_us;
+    char *json;
+    int consumed = 0;
+    
+    node->stats.bytes += len + 1;
+    if (node->in_flight > 0) {
+        rtt_us = now_us - node->sent_us[0];
+        memmove(node->sent_us, node->sent_us + 1, (size_t)(node->in_flight - 1) * sizeof(uint64_t));
+        node->in_flight--;
+        node->stats.rtt_total_us += rtt_us;
+        if (rtt_us > node->stats.rtt_max_us) {
+            node->stats.rtt_max_us = rtt_us;
+        }
+        if (rtt_us > node->window_rtt_max_us) {
+            node->window_rtt_max_us = rtt_us;
+        }
+    }
+    
+    /* Only a whole array is cached, as gateway_request() splices its elements */
+    if (sscanf(line, "OK %llu %n", &read_us, &consumed) != 1 || consumed == 0 ||
+        line[consumed] != '[' || len - (size_t)consumed < 2 || line[len - 1] != ']') {
+        node->stats.errors++;
+        return;
+    }
+    json = line + consumed;
+    
+    stale_us = now_wall_us > read_us ? now_wall_us - read_us : 0;
+    node->stats.responses++;
+    node->stats.stale_total_us += stale_us;
+    if (stale_us > node->stats.stale_max_us) {
+        node->stats.stale_max_us = stale_us;
+    }
+    if (stale_us > node->window_stale_max_us) {
+        node->window_stale_max_us = stale_us;
+    }
+    
+    free(node->latest);
+    node->latest = strdup(json);
+    node->latest_read_us = read_us;
+    
+    if (!quiet) {
+        printf("{\"node\":\"%s\",\"read_us\":%llu,\"staleness_ms\":%.1f,\"readings\":%s}\n",
+               node->name, read_us, stale_us / 1000.0, json);
+    }
+}
+
+/*
+ * Read whatever the node has sent and handle complete lines
+ */
+static void receive(gateway_node_t *node, bool quiet, uint64_t now_us) {
+    for (;;) {
+        ssize_t n;
+        char *start, *newline;
+        
+        if (node->in_cap - node->in_len < 4096) {
+            size_t cap = node->in_cap ? node->in_cap * 2 : 16384;
+            char *grown = realloc(node->in, cap);
+            if (!grown) {
+                disconnect_node(node, now_us);
+                return;
+            }
+            node->in = grown;
+            node->in_cap = cap;
+        }
+        
+        n = recv(node->fd, node->in + node->in_len, node->in_cap - node->in_len, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            disconnect_node(node, now_us);
+            return;
+        }
+        if (n < 0) {
+            break;
+        }
+        node->in_len += (size_t)n;
+        
+        start = node->in;
+        while ((newline = memchr(start, '\n', node->in_len - (size_t)(start - node->in)))) {
+            *newline = '\0';
+            handle_response(node, start, (size_t)(newline - start), quiet, now_us);
+            start = newline + 1;
+        }
+        node->in_len -= (size_t)(start - node->in);
+        memmove(node->in, start, node->in_len);
+    }
+    if (!quiet) {
+        fflush(stdout);
+    }
+}
+
+/*
+ * Answer a client from the cache: the latest readings of every node merged
+ * into one array, dated by the oldest of them. The cache holds what the
+ * gateway's own request asked the nodes for, so clients cannot filter it.
+ */
+static char *gateway_request(void *ctx, const char *request, const struct sockaddr_in *peer) {
+    gateway_t *gw = ctx;
+    uint64_t oldest_us = 0;
+    size_t size = 64;
+    char *response, *p;
+    const char *filter;
+    ws_location_filter_t location_filter;
+    int first = 1;
+    int i;
+    
+    (void)peer;
+    if (server_parse_request(request, &filter, &location_filter) < 0) {
+        return strdup("ERR unknown request");
+    }
+    if (filter || location_filter != WS_LOCATION_ALL) {
+        return strdup("ERR filters are set on the gateway command line");
+    }
+    for (i = 0; i < gw->count; i++) {
+        if (gw->nodes[i].latest) {
+            size += strlen(gw->nodes[i].latest);
+        }
+    }
+    response = malloc(size);
+    if (!response) {
+        return NULL;
+    }
+    
+    for (i = 0; i < gw->count; i++) {
+        if (gw->nodes[i].latest && (oldest_us == 0 || gw->nodes[i].latest_read_us < oldest_us)) {
+            oldest_us = gw->nodes[i].latest_read_us;
+        }
+    }
+    p = response + sprintf(response, "OK %llu [", (unsigned long long)oldest_us);
+    for (i = 0; i < gw->count; i++) {
+        const char *latest = gw->nodes[i].latest;
+        size_t len;
+        
+        /* Splice the elements of each node's array */
+        if (!latest || strcmp(latest, "[]") == 0) {
+            continue;
+        }
+        len = strlen(latest);
+        if (!first) {
+            *p++ = ',';
+        }
+        memcpy(p, latest + 1, len - 2);
+        p += len - 2;
+        first = 0;
+    }
+    strcpy(p, "]");
+    return response;
+}
+
+/*
+ * Print per-node throughput, round trip and staleness since the last report
+ */
+static void report(gateway_t *gw, double seconds, bool since_last) {
+    int i;
+    
+    fprintf(stderr, "%-24s %6s %8s %8s %10s %9s %9s %10s %10s %6s %6s\n",
+            "node", "state", "resp", "resp/s", "KB/s", "rtt_ms", "rtt_max", "stale_ms",
+            "stale_max", "errors", "reconn");
+    for (i = 0; i < gw->count; i++) {
+        gateway_node_t *node = &gw->nodes[i];
+        node_stats_t s = node->stats;
+        uint64_t responses;
+        
+        if (since_last) {
+            s.responses -= node->reported.responses;
+            s.errors -= node->reported.errors;
+            s.reconnects -= node->reported.reconnects;
+            s.bytes -= node->reported.bytes;
+            s.rtt_total_us -= node->reported.rtt_total_us;
+            s.stale_total_us -= node->reported.stale_total_us;
+            s.rtt_max_us = node->window_rtt_max_us;
+            s.stale_max_us = node->window_stale_max_us;
+            node->reported = node->stats;
+            node->window_rtt_max_us = 0;
+            node->window_stale_max_us = 0;
+        }
+        responses = s.responses + s.errors;
+        fprintf(stderr, "%-24s %6s %8llu %8.1f %10.1f %9.2f %9.2f %10.1f %10.1f %6llu %6llu\n",
+                node->name,
+                node->state == NODE_CONNECTED ? "up" : node->state == NODE_CONNECTING ? "conn" : "down",
+                (unsigned long long)s.responses,
+                s.responses / seconds,
+                s.bytes / 1024.0 / seconds,
+                responses ? s.rtt_total_us / 1e3 / responses : 0.0,
+                s.rtt_max_us / 1e3,
+                s.responses ? s.stale_total_us / 1e3 / s.responses : 0.0,
+                s.stale_max_us / 1e3,
+                (unsigned long long)s.errors,
+                (unsigned long long)s.reconnects);
+    }
+}
+
+/*
+ * Split "host:port" (the port is after the last colon)
+ */
+static int split_node(gateway_node_t *node, const char *spec) {
+    const char *colon = strrchr(spec, ':');
+    
+    if (!colon || colon == spec || colon[1] == '\0') {
+        log_error("Invalid node %s, expected HOST:PORT", spec);
+        return -1;
+    }
+    node->host = strndup(spec, (size_t)(colon - spec));
+    node->port = strdup(colon + 1);
+    return node->host && node->port ? 0 : -1;
+}
+
+int gateway_run(const gateway_opts_t *opts) {
+    gateway_t gw;
+    line_server_t *server = NULL;
+    struct pollfd *fds;
+    char request[SERVER_MAX_REQUEST + 1];
+    size_t request_len;
+    uint64_t start_us, now_us, next_request_us, next_report_us, end_us;
+    int max_fds;
+    int result = WS_EXIT_SUCCESS;
+    int i;
+    
+    request_len = (size_t)snprintf(request, sizeof(request), "%s\n", opts->request);
+    
+    memset(&gw, 0, sizeof(gw));
+    gw.nodes = calloc(opts->node_count, sizeof(gateway_node_t));
+    max_fds = opts->node_count + 1 + SERVER_MAX_CLIENTS;
+    fds = calloc(max_fds, sizeof(struct pollfd));
+    if (!gw.nodes || !fds) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(gw.nodes);
+        free(fds);
+        return 1;
+    }
+    gw.count = opts->node_count;
+    for (i = 0; i < gw.count; i++) {
+        gw.nodes[i].name = opts->nodes[i];
+        gw.nodes[i].fd = -1;
+        if (split_node(&gw.nodes[i], opts->nodes[i]) < 0) {
+            result = WS_EXIT_INVALID_ARG;
+        }
+    }
+    
+    if (result == WS_EXIT_SUCCESS && opts->port > 0) {
+        server = server_open(opts->bind_addr, opts->port);
+        if (!server) {
+            result = 1;
+        }
+    }
+    
+    start_us = monotonic_us();
+    next_request_us = start_us;
+    next_report_us = start_us + (uint64_t)opts->report_sec * 1000000ULL;
+    end_us = opts->duration_sec > 0 ? start_us + (uint64_t)opts->duration_sec * 1000000ULL : UINT64_MAX;
+    
+    while (result == WS_EXIT_SUCCESS && g_running) {
+        uint64_t wake_us;
+        int nfds = 0;
+        int timeout_ms;
+        
+        now_us = monotonic_us();
+        if (now_us >= end_us) {
+            break;
+        }
+        
+        for (i = 0; i < gw.count; i++) {
+            gateway_node_t *node = &gw.nodes[i];
+            if (node->state == NODE_DISCONNECTED && now_us >= node->retry_at_us) {
+                connect_node(node, now_us);
+            } else if (node->state == NODE_CONNECTING &&
+                       now_us - node->connect_started_us > GATEWAY_CONNECT_TIMEOUT_MS * 1000ULL) {
+                disconnect_node(node, now_us);
+            }
+        }
+        
+        if (now_us >= next_request_us) {
+            for (i = 0; i < gw.count; i++) {
+                send_request(&gw.nodes[i], request, request_len, opts->depth, now_us);
+            }
+            next_request_us += (uint64_t)opts->interval_ms * 1000ULL;
+            if (next_request_us <= now_us) {
+                next_request_us = now_us + (uint64_t)opts->interval_ms * 1000ULL;
+            }
+        }
+        
+        if (opts->report_sec > 0 && now_us >= next_report_us) {
+            report(&gw, opts->report_sec, true);
+            next_report_us += (uint64_t)opts->report_sec * 1000000ULL;
+        }
+        
+        /* Sleep until the next request tick, reconnect or report */
+        wake_us = next_request_us < end_us ? next_request_us : end_us;
+        if (opts->report_sec > 0 && next_report_us < wake_us) {
+            wake_us = next_report_us;
+        }
+        for (i = 0; i < gw.count; i++) {
+            gateway_node_t *node = &gw.nodes[i];
+            if (node->state == NODE_DISCONNECTED && node->retry_at_us < wake_us) {
+                wake_us = node->retry_at_us;
+            }
+            if (node->fd >= 0) {
+                fds[nfds].fd = node->fd;
+                fds[nfds].events = POLLIN;
+                if (node->state == NODE_CONNECTING || node->unsent > 0) {
+                    fds[nfds].events |= POLLOUT;
+                }
+            } else {
+                /* Keep the index aligned with the node; poll ignores negative fds */
+                fds[nfds].fd = -1;
+                fds[nfds].events = 0;
+            }
+            fds[nfds++].revents = 0;
+        }
+        if (server) {
+            nfds += server_pollfds(server, fds + nfds, max_fds - nfds);
+        }
+        
+        timeout_ms = wake_us > now_us ? (int)((wake_us - now_us + 999) / 1000) : 0;
+        if (poll(fds, nfds, timeout_ms) <= 0) {
+            continue;
+        }
+        
+        now_us = monotonic_us();
+        for (i = 0; i < gw.count; i++) {
+            gateway_node_t *node = &gw.nodes[i];
+            short revents = fds[i].revents;
+            
+            if (node->fd < 0 || revents == 0) {
+                continue;
+            }
+            if (node->state == NODE_CONNECTING) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(node->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    disconnect_node(node, now_us);
+                    continue;
+                }
+                node->state = NODE_CONNECTED;
+                /* Do not wait a whole interval for the first request */
+                send_request(node, request, request_len, opts->depth, now_us);
+                continue;
+            }
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                receive(node, opts->quiet, now_us);
+            }
+            if (node->fd >= 0 && (revents & POLLOUT) && node->unsent > 0) {
+                send_request(node, request, request_len, opts->depth, now_us);
+            }
+        }
+        if (server) {
+            server_dispatch(server, fds + gw.count, nfds - gw.count, gateway_request, &gw);
+        }
+    }
+    
+    if (result == WS_EXIT_SUCCESS) {
+        now_us = monotonic_us();
+        report(&gw, (now_us - start_us) / 1e6, false);
+    }
+    
+    server_close(server);
+    for (i = 0; i < gw.count; i++) {
+        if (gw.nodes[i].fd >= 0) {
+            close(gw.nodes[i].fd);
+        }
+        free(gw.nodes[i].host);
+        free(gw.nodes[i].port);
+        free(gw.nodes[i].in);
+        free(gw.nodes[i].latest);
+    }
+    free(gw.nodes);
+    free(fds);
+    return result;
+}
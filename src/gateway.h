@@ -0,0 +1,35 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Gateway: aggregate many node daemons over persistent connections
+ */
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdbool.h>
+#include "dht11.h"
+
+#define GATEWAY_DEFAULT_INTERVAL_MS     1000
+#define GATEWAY_DEFAULT_DEPTH           4       /* Requests in flight per node */
+#define GATEWAY_MAX_DEPTH               64
+#define GATEWAY_RECONNECT_MS            1000
+#define GATEWAY_CONNECT_TIMEOUT_MS      3000
+
+typedef struct {
+    char **nodes;           /* "host:port" */
+    int node_count;
+    const char *request;    /* Request line sent to every node */
+    int interval_ms;        /* Time between requests to each node */
+    int depth;              /* Maximum pipelined requests per node */
+    int duration_sec;       /* Stop after this long, 0 = until signalled */
+    int report_sec;         /* Per-node report to stderr this often, 0 = only at exit */
+    const char *bind_addr;  /* Serve the merged cache to clients */
+    int port;               /* 0 = do not serve */
+    bool quiet;             /* Do not print the merged stream */
+} gateway_opts_t;
+
+int gateway_run(const gateway_opts_t *opts);
+
+#endif /* GATEWAY_H */
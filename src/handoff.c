@@ -0,0 +1,497 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Zero-downtime daemon upgrade.
+ *
+ * The node daemon listens on a unix socket. A replacement started with
+ * "serve --takeover" connects to it, and the running daemon stops serving
+ * and sends, in one SCM_RIGHTS message, its listening socket and every
+ * client connection, followed by each client's buffered bytes and each
+ * sensor's schedule, health and latest reading. Once the replacement has
+ * adopted all of it, it acknowledges and the old daemon exits. Clients
+ * keep their connections throughout and requests that arrive meanwhile wait
+ * in the socket buffers, so they see only the few milliseconds the transfer
+ * takes. If the replacement gives up before acknowledging, the old daemon
+ * carries on serving.
+ *
+ * GPIO lines are requested per read and released afterwards, so there are
+ * no line descriptors to hand over and none are held across the switch.
+ */
+
+#define _GNU_SOURCE     /* accept4, struct ucred */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "handoff.h"
+
+/* Precedes the descriptors: listener first, then one per client */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_clients;
+    uint32_t num_sensors;
+    uint32_t sensor_size;       /* sizeof(handoff_sensor_t), guards layout changes */
+} handoff_header_t;
+
+/* Per-client buffer lengths, followed by the bytes themselves */
+typedef struct {
+    uint32_t in_len;
+    uint32_t out_len;
+} handoff_client_t;
+
+/* One sensor's runtime state; matched to the new configuration by identity */
+typedef struct {
+    char sensor_id[64];         /* Empty for the default id */
+    int32_t pin;
+    int32_t backend;
+    uint64_t next_due_us;       /* CLOCK_MONOTONIC is system-wide, so still valid */
+    uint64_t read_us;
+    int16_t temperature_x10;
+    uint16_t humidity_x10;
+    uint8_t failures;
+    uint8_t reserved[3];
+    sensor_reading_t reading;
+} handoff_sensor_t;
+
+#define MAX_FDS     (1 + SERVER_MAX_CLIENTS)
+
+static int unix_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        log_error("Hand-off socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static void set_timeouts(int fd) {
+    struct timeval tv;
+    
+    tv.tv_sec = HANDOFF_TIMEOUT_MS / 1000;
+    tv.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/*
+ * Write or read exactly len bytes.
+ * Returns 0 on success, -1 on error or timeout.
+ */
+static int send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Check whether a daemon is accepting connections on path.
+ * Returns 1 if one is, 0 if the path is free or a stale socket file, -1 if
+ * it cannot be told.
+ */
+static int daemon_listening(const struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int err;
+    
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0) {
+        close(fd);
+        return 1;
+    }
+    err = errno;
+    close(fd);
+    return err == ENOENT || err == ECONNREFUSED ? 0 : -1;
+}
+
+/*
+ * Listen for a replacement daemon on path. A stale socket file is replaced,
+ * but one a live daemon answers on is left alone unless that daemon has
+ * just handed over to this one (replace).
+ * Returns the listening descriptor, or -1 on error.
+ */
+int handoff_listen(const char *path, int replace, handoff_listener_t *listener) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+    
+    listener->fd = -1;
+    if (unix_address(path, &addr) < 0) {
+        return -1;
+    }
+    if (!replace) {
+        int live = daemon_listening(&addr);
+        if (live != 0) {
+            log_error(live > 0 ? "Another daemon is listening for hand-off on %s" :
+                                 "Cannot check hand-off socket %s", path);
+            return -1;
+        }
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_error("Cannot create hand-off socket: %s", strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0 ||
+        stat(path, &st) < 0) {
+        log_error("Cannot listen for hand-off on %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    listener->fd = fd;
+    listener->dev = st.st_dev;
+    listener->ino = st.st_ino;
+    return fd;
+}
+
+/*
+ * Stop listening. The socket file is removed only if it is still the one
+ * this daemon bound, and left alone if it may already belong to a
+ * replacement (path NULL).
+ */
+void handoff_close(handoff_listener_t *listener, const char *path) {
+    struct stat st;
+    
+    if (listener->fd < 0) {
+        return;
+    }
+    close(listener->fd);
+    listener->fd = -1;
+    if (path && stat(path, &st) == 0 && st.st_dev == listener->dev &&
+        st.st_ino == listener->ino) {
+        unlink(path);
+    }
+}
+
+/*
+ * Send the header with every descriptor, then the client buffers, then the
+ * sensor records.
+ * Returns 0 on success, -1 on error.
+ */
+static int send_state(int conn, line_server_t *server, const sensor_state_t *sensors,
+                      const sensor_reading_t *readings) {
+    int fds[MAX_FDS];
+    char control[CMSG_SPACE(sizeof(fds))];
+    handoff_header_t header;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    int num_clients = server_client_count(server);
+    const char *in, *out;
+    size_t in_len, out_len;
+    int i;
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HANDOFF_MAGIC, sizeof(header.magic));
+    header.version = HANDOFF_VERSION;
+    header.num_clients = (uint32_t)num_clients;
+    header.num_sensors = (uint32_t)sensors->count;
+    header.sensor_size = sizeof(handoff_sensor_t);
+    
+    fds[0] = server_listen_fd(server);
+    for (i = 0; i < num_clients; i++) {
+        server_client_state(server, i, &fds[1 + i], &in, &in_len, &out, &out_len);
+    }
+    
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)(1 + num_clients));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)(1 + num_clients));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)(1 + num_clients));
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(header)) {
+        return -1;
+    }
+    
+    for (i = 0; i < num_clients; i++) {
+        handoff_client_t client;
+        int fd;
+        
+        server_client_state(server, i, &fd, &in, &in_len, &out, &out_len);
+        client.in_len = (uint32_t)in_len;
+        client.out_len = (uint32_t)out_len;
+        if (send_all(conn, &client, sizeof(client)) < 0 ||
+            send_all(conn, in, in_len) < 0 || send_all(conn, out, out_len) < 0) {
+            return -1;
+        }
+    }
+    
+    for (i = 0; i < sensors->count; i++) {
+        const sensor_config_t *config = &sensors->configs[i];
+        handoff_sensor_t rec;
+        
+        memset(&rec, 0, sizeof(rec));
+        if (config->sensor_id) {
+            snprintf(rec.sensor_id, sizeof(rec.sensor_id), "%s", config->sensor_id);
+        }
+        rec.pin = config->pin;
+        rec.backend = (int32_t)config->backend;
+        rec.next_due_us = sensors->next_due_us[i];
+        rec.read_us = sensors->read_us[i];
+        rec.temperature_x10 = sensors->temperature_x10[i];
+        rec.humidity_x10 = sensors->humidity_x10[i];
+        rec.failures = sensors->failures[i];
+        rec.reading = readings[i];
+        if (send_all(conn, &rec, sizeof(rec)) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Send the listener, the clients and the sensor state to a replacement
+ * connecting on handoff_fd.
+ * Returns 0 once the replacement has taken over, -1 if this daemon should
+ * carry on serving.
+ */
+int handoff_give(int handoff_fd, line_server_t *server, const sensor_state_t *sensors,
+                 const sensor_reading_t *readings) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    struct pollfd pfd;
+    char ack = 0;
+    int conn;
+    
+    conn = accept4(handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn < 0) {
+        return -1;
+    }
+    
+    /* A daemon starting up checks for this one by connecting and hanging up */
+    pfd.fd = conn;
+    pfd.events = POLLRDHUP;
+    if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP))) {
+        close(conn);
+        return -1;
+    }
+    
+    /* Only the same user may take over, whatever the socket file's mode */
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 ||
+        (cred.uid != getuid() && cred.uid != 0)) {
+        log_error("Refusing hand-off to uid %d", (int)cred.uid);
+        close(conn);
+        return -1;
+    }
+    set_timeouts(conn);
+    
+    if (send_state(conn, server, sensors, readings) < 0 ||
+        recv_all(conn, &ack, 1) < 0 || ack != 'A') {
+        log_error("Hand-off failed, carrying on");
+        close(conn);
+        return -1;
+    }
+    close(conn);
+    return 0;
+}
+
+/*
+ * Copy a transferred sensor's state to the configured sensor it matches
+ */
+static void adopt_sensor(const handoff_sensor_t *rec, sensor_state_t *sensors,
+                         sensor_reading_t *readings) {
+    int i;
+    
+    for (i = 0; i < sensors->count; i++) {
+        const sensor_config_t *config = &sensors->configs[i];
+        const char *id = config->sensor_id ? config->sensor_id : "";
+        
+        if (config->pin == rec->pin && (int32_t)config->backend == rec->backend &&
+            strncmp(id, rec->sensor_id, sizeof(rec->sensor_id)) == 0) {
+            sensors->next_due_us[i] = rec->next_due_us;
+            sensors->read_us[i] = rec->read_us;
+            sensors->temperature_x10[i] = rec->temperature_x10;
+            sensors->humidity_x10[i] = rec->humidity_x10;
+            sensors->failures[i] = rec->failures;
+            readings[i] = rec->reading;
+            return;
+        }
+    }
+}
+
+/*
+ * Receive the header and descriptors, then adopt the clients and sensors.
+ * Descriptors not yet owned by *server are left in fds, -1 once adopted.
+ * Returns 0 on success, -1 on error.
+ */
+static int receive_state(int conn, line_server_t **server, int *fds, int *num_fds,
+                         sensor_state_t *sensors, sensor_reading_t *readings) {
+    char control[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+    handoff_header_t header;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    uint32_t n;
+    int i;
+    
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(header)) {
+        log_error("No hand-off from the running daemon");
+        return -1;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            *num_fds = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * (size_t)*num_fds);
+        }
+    }
+    
+    if (memcmp(header.magic, HANDOFF_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != HANDOFF_VERSION || header.sensor_size != sizeof(handoff_sensor_t)) {
+        log_error("Running daemon speaks another hand-off version");
+        return -1;
+    }
+    if ((msg.msg_flags & MSG_CTRUNC) || header.num_clients > SERVER_MAX_CLIENTS ||
+        *num_fds != 1 + (int)header.num_clients) {
+        log_error("Hand-off carried %d descriptors for %u clients", *num_fds, header.num_clients);
+        return -1;
+    }
+    
+    *server = server_adopt(fds[0]);
+    if (!*server) {
+        return -1;
+    }
+    fds[0] = -1;
+    
+    for (i = 0; i < (int)header.num_clients; i++) {
+        handoff_client_t client;
+        char *buf;
+        int adopted;
+        
+        if (recv_all(conn, &client, sizeof(client)) < 0 ||
+            client.in_len > SERVER_MAX_REQUEST || client.out_len > SERVER_MAX_PENDING) {
+            return -1;
+        }
+        buf = malloc((size_t)client.in_len + client.out_len + 1);
+        if (!buf) {
+            return -1;
+        }
+        adopted = recv_all(conn, buf, (size_t)client.in_len + client.out_len) == 0 &&
+                  server_adopt_client(*server, fds[1 + i], buf, client.in_len,
+                                      buf + client.in_len, client.out_len) == 0;
+        free(buf);
+        if (!adopted) {
+            return -1;
+        }
+        fds[1 + i] = -1;
+    }
+    
+    for (n = 0; n < header.num_sensors; n++) {
+        handoff_sensor_t rec;
+        
+        if (recv_all(conn, &rec, sizeof(rec)) < 0) {
+            return -1;
+        }
+        rec.sensor_id[sizeof(rec.sensor_id) - 1] = '\0';
+        adopt_sensor(&rec, sensors, readings);
+    }
+    return 0;
+}
+
+/*
+ * Take over from the daemon listening on path: adopt its listener and
+ * clients into a new server and its state into sensors and readings, which
+ * must already be set up for this daemon's configuration. Sensors that are
+ * new in the configuration keep their initial state.
+ * Returns HANDOFF_TAKEN, HANDOFF_NO_DAEMON if nothing is listening, or
+ * HANDOFF_FAILED with the old daemon left running.
+ */
+int handoff_take(const char *path, line_server_t **server, sensor_state_t *sensors,
+                 sensor_reading_t *readings) {
+    int fds[MAX_FDS];
+    struct sockaddr_un addr;
+    int num_fds = 0;
+    int conn;
+    int i;
+    
+    *server = NULL;
+    if (unix_address(path, &addr) < 0) {
+        return HANDOFF_FAILED;
+    }
+    conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn < 0) {
+        return HANDOFF_FAILED;
+    }
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        close(conn);
+        if (err == ENOENT || err == ECONNREFUSED) {
+            return HANDOFF_NO_DAEMON;
+        }
+        log_error("Cannot connect to %s: %s", path, strerror(err));
+        return HANDOFF_FAILED;
+    }
+    set_timeouts(conn);
+    
+    if (receive_state(conn, server, fds, &num_fds, sensors, readings) < 0 ||
+        send_all(conn, "A", 1) < 0) {
+        /* Closing our copies leaves the old daemon's connections untouched */
+        if (*server) {
+            server_close(*server);
+            *server = NULL;
+        }
+        for (i = 0; i < num_fds; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+        close(conn);
+        return HANDOFF_FAILED;
+    }
+    close(conn);
+    return HANDOFF_TAKEN;
+}
@@ -0,0 +1,45 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Hand a running node daemon's sockets and state to its replacement
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <sys/types.h>
+
+#include "dht11.h"
+#include "server.h"
+#include "sensor_state.h"
+
+/* Unix socket the running daemon accepts its replacement on, one per port */
+#define HANDOFF_PATH_FORMAT     "/run/sensor-dht11.%d.handoff"
+
+/* Longest either side waits for the other once a hand-off has started */
+#define HANDOFF_TIMEOUT_MS      2000
+
+#define HANDOFF_MAGIC           "DHT11HO1"
+#define HANDOFF_VERSION         1
+
+/* Results of handoff_take() */
+#define HANDOFF_TAKEN           0
+#define HANDOFF_NO_DAEMON       1
+#define HANDOFF_FAILED          -1
+
+/* This daemon's hand-off socket */
+typedef struct {
+    int fd;
+    dev_t dev;                  /* Socket file bound, so only ours is removed */
+    ino_t ino;
+} handoff_listener_t;
+
+int handoff_listen(const char *path, int replace, handoff_listener_t *listener);
+void handoff_close(handoff_listener_t *listener, const char *path);
+int handoff_give(int handoff_fd, line_server_t *server, const sensor_state_t *sensors,
+                 const sensor_reading_t *readings);
+int handoff_take(const char *path, line_server_t **server, sensor_state_t *sensors,
+                 sensor_reading_t *readings);
+
+#endif /* HANDOFF_H */
@@ -0,0 +1,91 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Line-info watch.
+ *
+ * libgpiod v1 has no line-info watch, so this talks to the GPIO character
+ * device uAPI (v2, Linux 5.10+) directly. Watching a line makes the chip
+ * descriptor readable whenever the line is requested, released or
+ * reconfigured by anyone, so a reader blocked on another process's hold
+ * sleeps in poll() and wakes on the release itself instead of retrying
+ * blindly.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "line_watch.h"
+#include "dht11.h"
+
+/*
+ * Wait until line offset on chip_path is released, or until deadline_us
+ * (CLOCK_MONOTONIC). consumer receives the holder's consumer label.
+ * Returns LINE_WATCH_RELEASED, LINE_WATCH_TIMEOUT, or LINE_WATCH_UNSUPPORTED
+ * if the kernel cannot watch line info.
+ */
+int line_watch_wait_released(const char *chip_path, unsigned int offset, uint64_t deadline_us,
+                             char *consumer, size_t consumer_size) {
+    struct gpio_v2_line_info info;
+    struct gpio_v2_line_info_changed event;
+    int result = LINE_WATCH_TIMEOUT;
+    int fd;
+    
+    if (consumer_size > 0) {
+        consumer[0] = '\0';
+    }
+    
+    fd = open(chip_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return LINE_WATCH_UNSUPPORTED;
+    }
+    
+    memset(&info, 0, sizeof(info));
+    info.offset = offset;
+    if (ioctl(fd, GPIO_V2_GET_LINEINFO_WATCH_IOCTL, &info) < 0) {
+        close(fd);
+        return LINE_WATCH_UNSUPPORTED;
+    }
+    snprintf(consumer, consumer_size, "%.*s", (int)sizeof(info.consumer), info.consumer);
+    
+    /* Released between the failed request and the watch */
+    if (!(info.flags & GPIO_V2_LINE_FLAG_USED)) {
+        result = LINE_WATCH_RELEASED;
+    }
+    
+    while (result == LINE_WATCH_TIMEOUT && g_running) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        uint64_t now_us = monotonic_us();
+        int ready;
+        
+        if (now_us >= deadline_us) {
+            break;
+        }
+        ready = poll(&pfd, 1, (int)((deadline_us - now_us + 999) / 1000));
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            break;
+        }
+        if (read(fd, &event, sizeof(event)) != (ssize_t)sizeof(event)) {
+            break;
+        }
+        if (event.info.offset == offset && event.event_type == GPIO_V2_LINE_CHANGED_RELEASED) {
+            result = LINE_WATCH_RELEASED;
+        }
+    }
+    
+    ioctl(fd, GPIO_GET_LINEINFO_UNWATCH_IOCTL, &offset);
+    close(fd);
+    return result;
+}
@@ -0,0 +1,22 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Wait for a busy GPIO line to be released using line-info watch events
+ */
+
+#ifndef LINE_WATCH_H
+#define LINE_WATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Results of line_watch_wait_released() */
+#define LINE_WATCH_RELEASED     0
+#define LINE_WATCH_TIMEOUT      1
+#define LINE_WATCH_UNSUPPORTED  -1
+
+int line_watch_wait_released(const char *chip_path, unsigned int offset, uint64_t deadline_us,
+                             char *consumer, size_t consumer_size);
+
+#endif /* LINE_WATCH_H */
@@ -0,0 +1,247 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Serial backend.
+ *
+ * The microcontroller owns the DHT11 timing, so the host only writes a
+ * request and sleeps in poll() until the answer arrives: no busy-polling
+ * and no real-time scheduling. Serial devices stay open between reads
+ * because reopening a USB serial port resets many boards.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "mcu_backend.h"
+#include "mcu_protocol.h"
+
+#define MAX_DEVICES     8
+
+/* Open serial devices, shared by all sensors on the same MCU */
+static struct {
+    char *path;
+    int fd;
+    uint8_t seq;
+} g_devices[MAX_DEVICES];
+static int g_num_devices = 0;
+
+/*
+ * Open a serial device in raw mode, or return the already open one.
+ * Returns the device slot, or -1 on error.
+ */
+static int open_device(const char *path) {
+    struct termios tio;
+    int fd, i;
+    
+    for (i = 0; i < g_num_devices; i++) {
+        if (strcmp(g_devices[i].path, path) == 0) {
+            return i;
+        }
+    }
+    if (g_num_devices == MAX_DEVICES) {
+        log_error("Too many MCU serial devices (max %d)", MAX_DEVICES);
+        return -1;
+    }
+    
+    fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        log_error("Cannot open MCU serial device %s: %s", path, strerror(errno));
+        return -1;
+    }
+    
+    /* A pty has no line speed, so only fail if the device is not a terminal */
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, MCU_BAUD);
+        cfsetospeed(&tio, MCU_BAUD);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(fd, TCSANOW, &tio);
+    } else if (errno != ENOTTY) {
+        log_error("Cannot configure MCU serial device %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    g_devices[g_num_devices].path = strdup(path);
+    g_devices[g_num_devices].fd = fd;
+    g_devices[g_num_devices].seq = 0;
+    if (!g_devices[g_num_devices].path) {
+        close(fd);
+        return -1;
+    }
+    return g_num_devices++;
+}
+
+/*
+ * Wait for the response to request seq, discarding stale or corrupt frames,
+ * for MCU_RESPONSE_TIMEOUT_MS or until deadline_us, whichever comes first.
+ * Returns 0 when msg holds the response, -1 on timeout or error.
+ */
+static int wait_response(int fd, uint8_t seq, mcu_msg_t *msg, uint64_t deadline_us) {
+    uint64_t deadline = monotonic_us() + MCU_RESPONSE_TIMEOUT_MS * 1000ULL;
+    mcu_parser_t parser;
+    uint8_t buf[64];
+    
+    if (deadline_us < deadline) {
+        deadline = deadline_us;
+    }
+    mcu_parser_init(&parser);
+    
+    for (;;) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        uint64_t now = monotonic_us();
+        ssize_t n, i;
+        
+        if (now >= deadline) {
+            return -1;
+        }
+        if (poll(&pfd, 1, (int)((deadline - now + 999) / 1000)) <= 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        
+        n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            return -1;
+        }
+        
+        for (i = 0; i < n; i++) {
+            if (mcu_parse_byte(&parser, buf[i], msg) == 1 && msg->seq == seq &&
+                msg->type != MCU_MSG_READ) {
+                return 0;
+            }
+        }
+    }
+}
+
+/*
+ * Read a DHT11 attached to an offload MCU, waiting for it no later than
+ * deadline_us (CLOCK_MONOTONIC).
+ * Returns 0 on success, -1 on error with reading->error_msg set.
+ */
+int read_mcu(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us) {
+    uint8_t frame[MCU_FRAME_MAX];
+    mcu_msg_t msg;
+    mcu_response_t resp;
+    size_t len;
+    int slot;
+    
+    reading->valid = false;
+    reading->error_msg[0] = '\0';
+    
+    if (!config->device) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg), "No MCU serial device configured");
+        return -1;
+    }
+    
+    slot = open_device(config->device);
+    if (slot < 0) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "Cannot open MCU serial device %s", config->device);
+        return -1;
+    }
+    
+    /* Drop anything left over from an earlier timed-out request */
+    tcflush(g_devices[slot].fd, TCIFLUSH);
+    
+    msg.type = MCU_MSG_READ;
+    msg.seq = ++g_devices[slot].seq;
+    msg.len = 2;
+    msg.payload[0] = (uint8_t)config->pin;
+    msg.payload[1] = config->mcu_decoded ? MCU_MODE_DECODED : MCU_MODE_RAW;
+    len = mcu_encode(&msg, frame);
+    
+    if (write(g_devices[slot].fd, frame, len) != (ssize_t)len) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "Write to MCU serial device %s failed", config->device);
+        return -1;
+    }
+    
+    if (wait_response(g_devices[slot].fd, msg.seq, &msg, deadline_us) < 0 ||
+        mcu_parse_response(&msg, &resp) < 0) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "No response from MCU on %s", config->device);
+        return -1;
+    }
+    
+    if (resp.pin != (uint8_t)config->pin) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "MCU on %s answered for pin %d, expected %d", config->device, resp.pin,
+                 config->pin);
+        return -1;
+    }
+    
+    if (msg.type == MCU_MSG_ERROR) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "MCU read failed after %d attempts: %s", resp.attempts,
+                 mcu_error_string(resp.error));
+        return -1;
+    }
+    
+    if (msg.type == MCU_MSG_READING) {
+        int temperature_x10 = resp.temperature_x10;
+        
+        /*
+         * Keep a frame as the render cache key, laid out as DHT22 frames are:
+         * humidity x10, then magnitude of temperature x10 with the sign in
+         * the top bit. It is never decoded as a DHT11 frame.
+         */
+        if (temperature_x10 < 0) {
+            temperature_x10 = -temperature_x10;
+        }
+        memset(reading->raw, 0, sizeof(reading->raw));
+        reading->raw[0] = (uint8_t)(resp.humidity_x10 >> 8);
+        reading->raw[1] = (uint8_t)(resp.humidity_x10 & 0xFF);
+        reading->raw[2] = (uint8_t)((temperature_x10 >> 8) & 0x7F);
+        if (resp.temperature_x10 < 0) {
+            reading->raw[2] |= 0x80;
+        }
+        reading->raw[3] = (uint8_t)(temperature_x10 & 0xFF);
+        reading->raw[4] = (uint8_t)(reading->raw[0] + reading->raw[1] + reading->raw[2] +
+                                    reading->raw[3]);
+        reading->humidity = (float)resp.humidity_x10 / 10.0f;
+        reading->temperature = (float)resp.temperature_x10 / 10.0f;
+        reading->valid = true;
+        return 0;
+    }
+    
+    if ((uint8_t)(resp.frame[0] + resp.frame[1] + resp.frame[2] + resp.frame[3]) != resp.frame[4]) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg), "MCU frame checksum mismatch");
+        return -1;
+    }
+    
+    memcpy(reading->raw, resp.frame, sizeof(reading->raw));
+    reading->humidity = (float)resp.frame[0] + (float)resp.frame[1] / 10.0f;
+    reading->temperature = dht11_temperature(resp.frame);
+    reading->valid = true;
+    return 0;
+}
+
+/*
+ * Close all open serial devices
+ */
+void mcu_close_all(void) {
+    int i;
+    
+    for (i = 0; i < g_num_devices; i++) {
+        close(g_devices[i].fd);
+        free(g_devices[i].path);
+    }
+    g_num_devices = 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Serial backend: read DHT11 sensors through an offload microcontroller
+ */
+
+#ifndef MCU_BACKEND_H
+#define MCU_BACKEND_H
+
+#include "dht11.h"
+
+/* How long to wait for the MCU, which runs its own retries (milliseconds) */
+#define MCU_RESPONSE_TIMEOUT_MS     10000
+
+/* Serial line speed */
+#define MCU_BAUD    B115200
+
+int read_mcu(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us);
+void mcu_close_all(void);
+
+#endif /* MCU_BACKEND_H */
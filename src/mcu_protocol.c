@@ -0,0 +1,172 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Framed serial protocol between the host and a DHT11 offload microcontroller.
+ * Shared by the serial backend and the MCU emulator; no host dependencies so
+ * it can also be compiled into MCU firmware.
+ */
+
+#include <string.h>
+
+#include "mcu_protocol.h"
+
+/*
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+ */
+uint16_t mcu_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    size_t i;
+    int bit;
+    
+    for (i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/*
+ * Frame a message for the wire.
+ * Returns the number of bytes written to out.
+ */
+size_t mcu_encode(const mcu_msg_t *msg, uint8_t out[MCU_FRAME_MAX]) {
+    size_t len = msg->len > MCU_MAX_PAYLOAD ? MCU_MAX_PAYLOAD : msg->len;
+    uint16_t crc;
+    
+    out[0] = MCU_SYNC0;
+    out[1] = MCU_SYNC1;
+    out[2] = msg->type;
+    out[3] = msg->seq;
+    out[4] = (uint8_t)len;
+    memcpy(out + 5, msg->payload, len);
+    crc = mcu_crc16(out + 2, 3 + len);
+    out[5 + len] = (uint8_t)(crc & 0xFF);
+    out[6 + len] = (uint8_t)(crc >> 8);
+    return 7 + len;
+}
+
+void mcu_parser_init(mcu_parser_t *parser) {
+    parser->pos = 0;
+}
+
+/*
+ * Feed one received byte to the parser.
+ * Returns 1 when msg holds a complete frame with a valid CRC, -1 when a
+ * complete frame failed its CRC, 0 when more bytes are needed. The parser
+ * resynchronises on the next sync pair after an error.
+ */
+int mcu_parse_byte(mcu_parser_t *parser, uint8_t byte, mcu_msg_t *msg) {
+    size_t len;
+    uint16_t crc;
+    
+    if ((parser->pos == 0 && byte != MCU_SYNC0) ||
+        (parser->pos == 1 && byte != MCU_SYNC1)) {
+        parser->pos = (byte == MCU_SYNC0) ? 1 : 0;
+        return 0;
+    }
+    
+    parser->buf[parser->pos++] = byte;
+    
+    if (parser->pos == 5 && parser->buf[4] > MCU_MAX_PAYLOAD) {
+        parser->pos = 0;
+        return -1;
+    }
+    if (parser->pos < 5) {
+        return 0;
+    }
+    
+    len = parser->buf[4];
+    if (parser->pos < 7 + len) {
+        return 0;
+    }
+    
+    parser->pos = 0;
+    crc = mcu_crc16(parser->buf + 2, 3 + len);
+    if (parser->buf[5 + len] != (crc & 0xFF) || parser->buf[6 + len] != (crc >> 8)) {
+        return -1;
+    }
+    
+    msg->type = parser->buf[2];
+    msg->seq = parser->buf[3];
+    msg->len = (uint8_t)len;
+    memcpy(msg->payload, parser->buf + 5, len);
+    return 1;
+}
+
+/*
+ * Build a RAW, READING or ERROR message from a response
+ */
+void mcu_build_response(mcu_msg_t *msg, uint8_t type, uint8_t seq, const mcu_response_t *resp) {
+    uint8_t *p = msg->payload;
+    
+    msg->type = type;
+    msg->seq = seq;
+    p[0] = resp->pin;
+    p[1] = resp->attempts;
+    p[2] = (uint8_t)(resp->mcu_time_us & 0xFF);
+    p[3] = (uint8_t)((resp->mcu_time_us >> 8) & 0xFF);
+    p[4] = (uint8_t)((resp->mcu_time_us >> 16) & 0xFF);
+    p[5] = (uint8_t)(resp->mcu_time_us >> 24);
+    
+    if (type == MCU_MSG_RAW) {
+        memcpy(p + 6, resp->frame, 5);
+        msg->len = 11;
+    } else if (type == MCU_MSG_READING) {
+        uint16_t t = (uint16_t)resp->temperature_x10;
+        p[6] = (uint8_t)(t & 0xFF);
+        p[7] = (uint8_t)(t >> 8);
+        p[8] = (uint8_t)(resp->humidity_x10 & 0xFF);
+        p[9] = (uint8_t)(resp->humidity_x10 >> 8);
+        msg->len = 10;
+    } else {
+        p[6] = resp->error;
+        msg->len = 7;
+    }
+}
+
+/*
+ * Decode the payload of a RAW, READING or ERROR message.
+ * Returns 0 on success, -1 if the message is not a well-formed response.
+ */
+int mcu_parse_response(const mcu_msg_t *msg, mcu_response_t *resp) {
+    const uint8_t *p = msg->payload;
+    
+    memset(resp, 0, sizeof(*resp));
+    if (msg->len < 6) {
+        return -1;
+    }
+    resp->pin = p[0];
+    resp->attempts = p[1];
+    resp->mcu_time_us = (uint32_t)p[2] | ((uint32_t)p[3] << 8) |
+                        ((uint32_t)p[4] << 16) | ((uint32_t)p[5] << 24);
+    
+    switch (msg->type) {
+    case MCU_MSG_RAW:
+        if (msg->len < 11) return -1;
+        memcpy(resp->frame, p + 6, 5);
+        return 0;
+    case MCU_MSG_READING:
+        if (msg->len < 10) return -1;
+        resp->temperature_x10 = (int16_t)(p[6] | (p[7] << 8));
+        resp->humidity_x10 = (uint16_t)(p[8] | (p[9] << 8));
+        return 0;
+    case MCU_MSG_ERROR:
+        if (msg->len < 7) return -1;
+        resp->error = p[6];
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+const char *mcu_error_string(int code) {
+    switch (code) {
+    case MCU_ERR_TIMEOUT:   return "sensor timeout";
+    case MCU_ERR_CHECKSUM:  return "checksum mismatch";
+    case MCU_ERR_BAD_PIN:   return "pin not configured";
+    default:                return "unknown error";
+    }
+}
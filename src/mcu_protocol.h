@@ -0,0 +1,84 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Framed serial protocol between the host and a DHT11 offload microcontroller
+ *
+ * Every message is framed as:
+ *
+ *   0xA5 0x5A  type  seq  len  payload[len]  crc16 (little-endian)
+ *
+ * The CRC is CRC-16/CCITT-FALSE over type, seq, len and the payload. The
+ * host sends MCU_MSG_READ; the MCU drives the DHT11, retries on its own and
+ * answers with one MCU_MSG_RAW, MCU_MSG_READING or MCU_MSG_ERROR carrying
+ * the same seq. Multi-byte fields are little-endian.
+ *
+ *   READ     pin, mode (MCU_MODE_RAW or MCU_MODE_DECODED)
+ *   RAW      pin, attempts, mcu_time_us (u32), frame[5]
+ *   READING  pin, attempts, mcu_time_us (u32), temperature x10 (i16), humidity x10 (u16)
+ *   ERROR    pin, attempts, mcu_time_us (u32), code
+ *
+ * mcu_time_us is the MCU clock when the successful (or last) start signal
+ * was sent.
+ */
+
+#ifndef MCU_PROTOCOL_H
+#define MCU_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MCU_SYNC0           0xA5
+#define MCU_SYNC1           0x5A
+#define MCU_MAX_PAYLOAD     32
+#define MCU_FRAME_MAX       (5 + MCU_MAX_PAYLOAD + 2)
+
+#define MCU_MODE_RAW        0
+#define MCU_MODE_DECODED    1
+
+typedef enum {
+    MCU_MSG_READ = 0x01,
+    MCU_MSG_RAW = 0x81,
+    MCU_MSG_READING = 0x82,
+    MCU_MSG_ERROR = 0x83
+} mcu_msg_type_t;
+
+typedef enum {
+    MCU_ERR_TIMEOUT = 1,    /* No response from the sensor */
+    MCU_ERR_CHECKSUM = 2,   /* Every attempt failed its checksum */
+    MCU_ERR_BAD_PIN = 3     /* Pin not wired to a sensor */
+} mcu_error_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t len;
+    uint8_t payload[MCU_MAX_PAYLOAD];
+} mcu_msg_t;
+
+/* Decoded response payload (RAW, READING or ERROR) */
+typedef struct {
+    uint8_t pin;
+    uint8_t attempts;
+    uint32_t mcu_time_us;
+    uint8_t frame[5];       /* RAW */
+    int16_t temperature_x10;    /* READING */
+    uint16_t humidity_x10;      /* READING */
+    uint8_t error;          /* ERROR, mcu_error_t */
+} mcu_response_t;
+
+/* Incremental frame parser */
+typedef struct {
+    size_t pos;
+    uint8_t buf[MCU_FRAME_MAX];
+} mcu_parser_t;
+
+uint16_t mcu_crc16(const uint8_t *data, size_t len);
+size_t mcu_encode(const mcu_msg_t *msg, uint8_t out[MCU_FRAME_MAX]);
+void mcu_parser_init(mcu_parser_t *parser);
+int mcu_parse_byte(mcu_parser_t *parser, uint8_t byte, mcu_msg_t *msg);
+void mcu_build_response(mcu_msg_t *msg, uint8_t type, uint8_t seq, const mcu_response_t *resp);
+int mcu_parse_response(const mcu_msg_t *msg, mcu_response_t *resp);
+const char *mcu_error_string(int code);
+
+#endif /* MCU_PROTOCOL_H */
@@ -0,0 +1,114 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Pressure stall information (PSI) checks for deferring GPIO reads.
+ *
+ * Bit-banged reads fail when the CPU or SD card is saturated, even under
+ * SCHED_FIFO, because interrupts and I/O completions still steal the few
+ * microseconds that separate a 0 bit from a 1 bit. Rather than burn retries
+ * in those periods, readers check /proc/pressure/cpu and /proc/pressure/io
+ * first and wait for a quieter moment.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pressure.h"
+
+pressure_stats_t g_pressure_stats;
+
+/*
+ * Read the "some" line of one PSI file.
+ * Returns 0 on success, -1 if the kernel does not provide it.
+ */
+static int read_some(const char *resource, double *avg10, uint64_t *total_us) {
+    char path[128];
+    unsigned long long total;
+    FILE *fp;
+    int n;
+    
+    snprintf(path, sizeof(path), "%s/%s", PRESSURE_DIR, resource);
+    fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    n = fscanf(fp, "some avg10=%lf avg60=%*f avg300=%*f total=%llu", avg10, &total);
+    fclose(fp);
+    if (n != 2) {
+        return -1;
+    }
+    *total_us = (uint64_t)total;
+    return 0;
+}
+
+/*
+ * Get the higher of CPU and I/O "some" pressure, in percent, since the last
+ * sample if it was recent or over the last 10 s otherwise.
+ * Returns -1 if the kernel has no PSI support.
+ */
+double pressure_level(pressure_monitor_t *monitor, uint64_t now_us) {
+    double cpu_avg10 = 0.0, io_avg10 = 0.0;
+    uint64_t cpu_total = 0, io_total = 0;
+    bool have_cpu = read_some("cpu", &cpu_avg10, &cpu_total) == 0;
+    bool have_io = read_some("io", &io_avg10, &io_total) == 0;
+    double level;
+    
+    if (!have_cpu && !have_io) {
+        return -1.0;
+    }
+    
+    if (monitor->at_us != 0 && now_us > monitor->at_us &&
+        now_us - monitor->at_us <= PRESSURE_WINDOW_US &&
+        cpu_total >= monitor->cpu_total_us && io_total >= monitor->io_total_us) {
+        uint64_t stalled = cpu_total - monitor->cpu_total_us;
+        uint64_t io_stalled = io_total - monitor->io_total_us;
+        if (io_stalled > stalled) {
+            stalled = io_stalled;
+        }
+        level = 100.0 * (double)stalled / (double)(now_us - monitor->at_us);
+    } else {
+        level = cpu_avg10 > io_avg10 ? cpu_avg10 : io_avg10;
+    }
+    
+    monitor->cpu_total_us = cpu_total;
+    monitor->io_total_us = io_total;
+    monitor->at_us = now_us;
+    return level;
+}
+
+/*
+ * Get the pressure level above which reads are deferred, 0 if disabled
+ */
+double pressure_threshold(void) {
+    static double threshold = -1.0;
+    
+    if (threshold < 0.0) {
+        const char *env = getenv(PRESSURE_ENV);
+        char *end;
+        
+        threshold = PRESSURE_DEFAULT_LEVEL;
+        if (env && *env) {
+            double value = strtod(env, &end);
+            if (*end == '\0' && value >= 0.0) {
+                threshold = value;
+            }
+        }
+    }
+    return threshold;
+}
+
+/*
+ * Check whether pressure is over the deferral level
+ */
+bool pressure_high(pressure_monitor_t *monitor, uint64_t now_us) {
+    double threshold = pressure_threshold();
+    
+    if (threshold <= 0.0) {
+        return false;
+    }
+    g_pressure_stats.checks++;
+    return pressure_level(monitor, now_us) > threshold;
+}
@@ -0,0 +1,55 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Pressure stall information (PSI) checks for deferring GPIO reads
+ */
+
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef PRESSURE_DIR
+#define PRESSURE_DIR            "/proc/pressure"
+#endif
+
+/* Environment variable overriding the deferral level, 0 disables deferral */
+#define PRESSURE_ENV            "SENSOR_DHT11_MAX_PRESSURE"
+
+/* Percentage of time some task stalled on CPU or I/O above which reads wait */
+#define PRESSURE_DEFAULT_LEVEL  40.0
+
+/* How often pressure is rechecked while a read waits */
+#define PRESSURE_POLL_US        250000
+
+/* Samples further apart than this fall back to the kernel's 10 s average */
+#define PRESSURE_WINDOW_US      1000000
+
+/*
+ * Stall totals from the previous sample. Pressure is measured as the share
+ * of the time since then that tasks stalled, so it drops as soon as the
+ * load does instead of decaying over the 10 s average.
+ */
+typedef struct {
+    uint64_t cpu_total_us;
+    uint64_t io_total_us;
+    uint64_t at_us;             /* CLOCK_MONOTONIC time of the sample, 0 if none */
+} pressure_monitor_t;
+
+/* Deferral counters since start-up */
+typedef struct {
+    uint64_t checks;            /* Pressure checks before an attempt */
+    uint64_t deferrals;         /* Waits for pressure to drop, one per attempt put off */
+    uint64_t deferred_us;       /* Time spent waiting for pressure to drop */
+    uint64_t attempts_saved;    /* Blind retries the waits replaced */
+} pressure_stats_t;
+
+extern pressure_stats_t g_pressure_stats;
+
+double pressure_level(pressure_monitor_t *monitor, uint64_t now_us);
+double pressure_threshold(void);
+bool pressure_high(pressure_monitor_t *monitor, uint64_t now_us);
+
+#endif /* PRESSURE_H */
@@ -0,0 +1,152 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Classify DHT11 data bits from measured low/high pulse pairs.
+ *
+ * Every bit starts with a ~50us low and is encoded in the width of the high
+ * that follows. The threshold method compares each high with the midpoint of
+ * the shortest and longest highs in the frame, so one late edge that
+ * stretches a single high moves the threshold for every bit. The ratio
+ * method compares each high with the frame's lows instead, which were timed
+ * by the same oscillator and measured by the same polling loop: a sensor
+ * running slow in the cold, or a board that polls slowly, shifts both sides
+ * of the comparison together. The lows are pooled rather than each high
+ * being judged by its own low, because a single low carries up to a poll
+ * period of error and a preempted one can be off by far more.
+ */
+
+#include <string.h>
+
+#include "pulse_classifier.h"
+
+#define DATA_BITS   40
+
+/*
+ * Interquartile mean of a frame's lows: the mean of the middle half once
+ * sorted, which ignores disturbed lows like a median but averages out
+ * polling error like a mean. Returned in 1/256us.
+ */
+static uint32_t reference_low(const dht11_pulse_t *pulses, int count) {
+    uint16_t lows[DATA_BITS];
+    uint32_t sum = 0;
+    int first = count / 4;
+    int last = count - count / 4;
+    int i, j;
+    
+    for (i = 0; i < count; i++) {
+        uint16_t v = pulses[i].low_us;
+        for (j = i; j > 0 && lows[j - 1] > v; j--) {
+            lows[j] = lows[j - 1];
+        }
+        lows[j] = v;
+    }
+    for (i = first; i < last; i++) {
+        sum += lows[i];
+    }
+    return sum * 256 / (uint32_t)(last - first);
+}
+
+/*
+ * Decide each bit from the ratio of its high to the frame's lows
+ */
+static void classify_ratio(const dht11_pulse_t *pulses, int count, uint8_t *bits) {
+    uint32_t reference = reference_low(pulses, count) * PULSE_RATIO_THRESHOLD_PCT / 100;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        bits[i] = (uint32_t)pulses[i].high_us * 256 > reference;
+    }
+}
+
+/*
+ * Decide each bit from its high against the frame's min/max midpoint
+ */
+static void classify_threshold(const dht11_pulse_t *pulses, int count, uint8_t *bits) {
+    int min_pulse = 10000, max_pulse = 0;
+    int threshold;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        if (pulses[i].high_us < min_pulse) min_pulse = pulses[i].high_us;
+        if (pulses[i].high_us > max_pulse) max_pulse = pulses[i].high_us;
+    }
+    threshold = (min_pulse + max_pulse) / 2;
+    
+    for (i = 0; i < count; i++) {
+        bits[i] = pulses[i].high_us > threshold;
+    }
+}
+
+/*
+ * Decide each bit from its high against the nominal 0/1 midpoint
+ */
+static void classify_fixed(const dht11_pulse_t *pulses, int count, uint8_t *bits) {
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        bits[i] = pulses[i].high_us > PULSE_FIXED_THRESHOLD_US;
+    }
+}
+
+/*
+ * The frame's typical low in microseconds (see reference_low()), from its
+ * last 40 pairs
+ */
+uint32_t pulse_typical_low_us(const dht11_pulse_t *pulses, int count) {
+    if (count <= 0) {
+        return 0;
+    }
+    if (count > DATA_BITS) {
+        pulses += count - DATA_BITS;
+        count = DATA_BITS;
+    }
+    return (reference_low(pulses, count) + 128) / 256;
+}
+
+/*
+ * Decode a frame from its data-bit pulse pairs.
+ * Uses the last 40 pairs; if fewer were captured, the missing leading bits
+ * are taken as zeros (the first bits are the ones lost to a late start).
+ * Returns 0 if the checksum matches, -1 otherwise.
+ */
+int classify_pulses(const dht11_pulse_t *pulses, int count, classify_method_t method,
+                    uint8_t data[5]) {
+    uint8_t bits[DATA_BITS];
+    int missing;
+    int i;
+    
+    memset(data, 0, 5);
+    if (count <= 0) {
+        return -1;
+    }
+    if (count > DATA_BITS) {
+        pulses += count - DATA_BITS;
+        count = DATA_BITS;
+    }
+    
+    if (method == CLASSIFY_RATIO) {
+        classify_ratio(pulses, count, bits);
+    } else if (method == CLASSIFY_FIXED) {
+        classify_fixed(pulses, count, bits);
+    } else {
+        classify_threshold(pulses, count, bits);
+    }
+    
+    missing = DATA_BITS - count;
+    for (i = 0; i < count; i++) {
+        int bit = missing + i;
+        data[bit / 8] |= (uint8_t)(bits[i] << (7 - bit % 8));
+    }
+    
+    return (uint8_t)(data[0] + data[1] + data[2] + data[3]) == data[4] ? 0 : -1;
+}
+
+const char *classify_method_name(classify_method_t method) {
+    switch (method) {
+    case CLASSIFY_THRESHOLD:    return "threshold";
+    case CLASSIFY_RATIO:        return "ratio";
+    case CLASSIFY_FIXED:        return "fixed48";
+    default:                    return "unknown";
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Classify DHT11 data bits from measured low/high pulse pairs
+ */
+
+#ifndef PULSE_CLASSIFIER_H
+#define PULSE_CLASSIFIER_H
+
+#include <stdint.h>
+
+/* A 1 bit's high pulse is longer than this percentage of the frame's typical
+ * low. Nominal highs are 27us for 0 and 70us for 1 against 50us lows; polling
+ * error adds to widths rather than scaling them, so the threshold sits at
+ * their arithmetic midpoint. */
+#define PULSE_RATIO_THRESHOLD_PCT   97
+
+/* A 1 bit's high pulse is longer than this, between the nominal 27us and 70us.
+ * Only sound when the widths are hardware-timed and the sensor is on time. */
+#define PULSE_FIXED_THRESHOLD_US    48
+
+/* Nominal low that starts each bit */
+#define PULSE_NOMINAL_LOW_US        50
+
+/* One data bit: the ~50us low that starts it and the high that encodes it */
+typedef struct {
+    uint16_t low_us;
+    uint16_t high_us;
+} dht11_pulse_t;
+
+typedef enum {
+    CLASSIFY_THRESHOLD = 0,     /* High vs the frame's min/max midpoint */
+    CLASSIFY_RATIO,             /* High vs the frame's typical low */
+    CLASSIFY_FIXED              /* High vs PULSE_FIXED_THRESHOLD_US */
+} classify_method_t;
+
+int classify_pulses(const dht11_pulse_t *pulses, int count, classify_method_t method,
+                    uint8_t data[5]);
+uint32_t pulse_typical_low_us(const dht11_pulse_t *pulses, int count);
+const char *classify_method_name(classify_method_t method);
+
+#endif /* PULSE_CLASSIFIER_H */
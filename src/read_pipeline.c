@@ -0,0 +1,398 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Two-stage reads of many GPIO sensors.
+ *
+ * The calling thread is the sampler. For each sensor it sends the start
+ * signal and records the frame's pulse widths straight into a slot of a
+ * preallocated ring, holding SCHED_FIFO only for the bus exchange (see
+ * dht11_sample()), and moves on to the next sensor. A decoder thread at
+ * normal priority classifies the bits, checks the checksum, converts the
+ * values and keeps the frame log, and sends each result back through a
+ * second ring. A sensor whose frame fails is sampled again once its backoff
+ * has passed, so one sensor's retries overlap the other sensors' reads
+ * instead of holding up the sweep.
+ *
+ * Each ring has one producer and one consumer. Each index is written by one
+ * side only and published with a release store, so neither side ever takes
+ * a lock or waits on the other while it has work; semaphores only wake a
+ * side that has nothing to do.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+
+#include "read_pipeline.h"
+#include "frame_log.h"
+#include "pressure.h"
+
+/* Keeps the two ends of a ring on separate cache lines */
+#define CACHE_LINE          64
+
+/* Longest the sampler sleeps without checking for results */
+#define MAX_WAIT_US         100000
+
+/* A single-producer single-consumer ring of fixed-size slots */
+typedef struct {
+    unsigned head;              /* Next slot to consume; written by the consumer only */
+    char head_pad[CACHE_LINE - sizeof(unsigned)];
+    unsigned tail;              /* Next slot to fill; written by the producer only */
+    char tail_pad[CACHE_LINE - sizeof(unsigned)];
+    size_t slot_size;
+    unsigned char *slots;
+} ring_t;
+
+/* Sampler to decoder: one sampled frame, or sensor -1 to stop */
+typedef struct {
+    int sensor;                 /* Position in the batch */
+    int pin;
+    dht11_frame_t frame;
+} sample_slot_t;
+
+/* Decoder to sampler */
+typedef struct {
+    int sensor;
+    bool decoded;
+    sensor_reading_t reading;
+} result_slot_t;
+
+/* One sensor's progress through the batch; sampler only */
+typedef struct {
+    uint64_t next_us;           /* When it may next be sampled */
+    uint64_t deferred_since_us; /* Start of a wait for pressure to drop, or 0 */
+    int attempts;
+    bool in_flight;             /* A frame is with the decoder */
+    bool busy;                  /* Line held elsewhere; left to read_dht11_until() */
+    bool done;
+} batch_sensor_t;
+
+typedef struct {
+    ring_t samples;
+    ring_t results;
+    sem_t samples_posted;
+    sem_t results_posted;
+    frame_log_read_t *frame_log;    /* Per sensor, NULL unless logging; decoder only */
+} pipeline_t;
+
+static pressure_monitor_t g_batch_pressure;
+
+static int ring_init(ring_t *ring, size_t slot_size) {
+    memset(ring, 0, sizeof(*ring));
+    ring->slot_size = slot_size;
+    ring->slots = calloc(PIPELINE_SLOTS, slot_size);
+    return ring->slots ? 0 : -1;
+}
+
+/*
+ * Producer: the slot to fill next, or NULL if the ring is full
+ */
+static void *ring_reserve(ring_t *ring) {
+    unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == PIPELINE_SLOTS) {
+        return NULL;
+    }
+    return ring->slots + (tail & (PIPELINE_SLOTS - 1)) * ring->slot_size;
+}
+
+/*
+ * Producer: hand the reserved slot to the consumer
+ */
+static void ring_publish(ring_t *ring) {
+    __atomic_store_n(&ring->tail, __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELEASE);
+}
+
+/*
+ * Consumer: the oldest published slot, or NULL if the ring is empty
+ */
+static void *ring_front(ring_t *ring) {
+    unsigned head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    
+    if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+        return NULL;
+    }
+    return ring->slots + (head & (PIPELINE_SLOTS - 1)) * ring->slot_size;
+}
+
+/*
+ * Consumer: give the front slot back to the producer
+ */
+static void ring_pop(ring_t *ring) {
+    __atomic_store_n(&ring->head, __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELEASE);
+}
+
+/*
+ * Decoder thread: decode frames until told to stop
+ */
+static void *decoder_main(void *arg) {
+    pipeline_t *p = arg;
+    
+    for (;;) {
+        sample_slot_t *sample;
+        result_slot_t *result;
+        
+        while (!(sample = ring_front(&p->samples))) {
+            sem_wait(&p->samples_posted);
+        }
+        if (sample->sensor < 0) {
+            ring_pop(&p->samples);
+            return NULL;
+        }
+        
+        /* Never full: the sampler keeps at most PIPELINE_SLOTS frames in flight */
+        result = ring_reserve(&p->results);
+        result->sensor = sample->sensor;
+        memset(&result->reading, 0, sizeof(result->reading));
+        if (p->frame_log) {
+            frame_log_keep(&p->frame_log[sample->sensor], sample->pin, &sample->frame);
+        }
+        result->decoded = dht11_decode(&sample->frame, &result->reading) == 0;
+        if (result->decoded && p->frame_log) {
+            frame_log_commit(&p->frame_log[sample->sensor], result->reading.raw);
+        }
+        ring_pop(&p->samples);
+        ring_publish(&p->results);
+        sem_post(&p->results_posted);
+    }
+}
+
+/*
+ * Schedule a sensor's next attempt after a failed one, or give up on it.
+ * Returns true if the sensor is done.
+ */
+static bool retry_later(batch_sensor_t *s, sensor_reading_t *reading, uint64_t now_us,
+                        uint64_t deadline_us) {
+    if (s->attempts <= num_retries && g_running &&
+        now_us + retry_delays_us[s->attempts - 1] < deadline_us) {
+        s->next_us = now_us + retry_delays_us[s->attempts - 1];
+        return false;
+    }
+    snprintf(reading->error_msg, sizeof(reading->error_msg),
+             "Failed to read DHT11 after %d attempts", s->attempts);
+    return true;
+}
+
+/*
+ * Sleep until a result arrives or until wake_us
+ */
+static void wait_for_result(pipeline_t *p, uint64_t now_us, uint64_t wake_us) {
+    uint64_t wait_us = wake_us > now_us + MAX_WAIT_US ? MAX_WAIT_US : wake_us - now_us;
+    struct timespec until;
+    
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += (time_t)(wait_us / 1000000);
+    until.tv_nsec += (long)(wait_us % 1000000) * 1000;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    sem_timedwait(&p->results_posted, &until);
+}
+
+/*
+ * Sample the sensors and collect their decoded results.
+ * Returns the number of sensors left to read_dht11_until() because their
+ * line was busy.
+ */
+static int run_sampler(pipeline_t *p, const sensor_config_t *configs, const int *indices,
+                       int count, sensor_reading_t *readings, batch_sensor_t *sensors,
+                       uint64_t deadline_us, bool defer) {
+    int remaining = count;
+    int in_flight = 0;
+    int busy = 0;
+    int i;
+    
+    while (remaining > 0) {
+        result_slot_t *result;
+        sample_slot_t *slot;
+        batch_sensor_t *s;
+        sensor_reading_t *reading;
+        uint64_t now_us, wake_us = UINT64_MAX;
+        int next = -1;
+        int sampled;
+        
+        /* Collect decoded frames */
+        while ((result = ring_front(&p->results))) {
+            s = &sensors[result->sensor];
+            reading = &readings[indices[result->sensor]];
+            s->in_flight = false;
+            in_flight--;
+            if (result->decoded) {
+                memcpy(reading->raw, result->reading.raw, sizeof(reading->raw));
+                reading->humidity = result->reading.humidity;
+                reading->temperature = result->reading.temperature;
+                reading->valid = true;
+                s->done = true;
+            } else {
+                s->done = retry_later(s, reading, monotonic_us(), deadline_us);
+            }
+            remaining -= s->done;
+            ring_pop(&p->results);
+        }
+        
+        /* The sensor that has waited longest past its backoff */
+        now_us = monotonic_us();
+        for (i = 0; i < count; i++) {
+            if (sensors[i].done || sensors[i].in_flight) {
+                continue;
+            }
+            if (sensors[i].next_us <= now_us) {
+                if (next < 0 || sensors[i].next_us < sensors[next].next_us) {
+                    next = i;
+                }
+            } else if (sensors[i].next_us < wake_us) {
+                wake_us = sensors[i].next_us;
+            }
+        }
+        if (next < 0 || in_flight == PIPELINE_SLOTS) {
+            if (remaining > 0) {
+                wait_for_result(p, now_us, wake_us);
+            }
+            continue;
+        }
+        
+        s = &sensors[next];
+        reading = &readings[indices[next]];
+        
+        /* Under pressure, try this sensor again later while there is time;
+         * a wait counts once however often it is rechecked */
+        if (defer && now_us + PRESSURE_POLL_US + DHT11_ATTEMPT_US < deadline_us &&
+            pressure_high(&g_batch_pressure, now_us)) {
+            s->next_us = now_us + PRESSURE_POLL_US;
+            if (s->deferred_since_us == 0) {
+                s->deferred_since_us = now_us;
+                g_pressure_stats.deferrals++;
+                g_pressure_stats.attempts_saved++;
+            }
+            continue;
+        }
+        if (s->deferred_since_us != 0) {
+            g_pressure_stats.deferred_us += now_us - s->deferred_since_us;
+            s->deferred_since_us = 0;
+        }
+        
+        /* Never full while fewer than PIPELINE_SLOTS frames are in flight */
+        slot = ring_reserve(&p->samples);
+        sampled = dht11_sample(configs[indices[next]].pin, &slot->frame,
+                               reading->error_msg, sizeof(reading->error_msg));
+        s->attempts++;
+        if (sampled == 0) {
+            slot->sensor = next;
+            slot->pin = configs[indices[next]].pin;
+            ring_publish(&p->samples);
+            sem_post(&p->samples_posted);
+            s->in_flight = true;
+            in_flight++;
+        } else if (sampled == DHT11_LINE_BUSY) {
+            reading->error_msg[0] = '\0';
+            s->busy = true;
+            s->done = true;
+            busy++;
+        } else if (reading->error_msg[0] != '\0') {
+            /* Permission and similar errors: retrying won't help */
+            s->done = true;
+        } else {
+            s->done = retry_later(s, reading, monotonic_us(), deadline_us);
+        }
+        remaining -= s->done;
+    }
+    return busy;
+}
+
+/*
+ * Read sensors one after another
+ */
+static void read_each(const sensor_config_t *configs, const int *indices, int count,
+                      sensor_reading_t *readings, uint64_t deadline_us, bool defer) {
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        read_dht11_until(configs[indices[i]].pin, &readings[indices[i]], deadline_us, defer);
+    }
+}
+
+/*
+ * Read the GPIO sensors configs[indices[0..count-1]] into the matching
+ * readings, giving up on each at deadline_us. Timestamps are left to the
+ * caller. A sensor whose line is held by another process is read
+ * afterwards by read_dht11_until(), which waits for the line. Attempts wait
+ * out CPU or I/O pressure only if defer is set.
+ */
+void read_dht11_batch(const sensor_config_t *configs, const int *indices, int count,
+                      sensor_reading_t *readings, uint64_t deadline_us, bool defer) {
+    pipeline_t p;
+    batch_sensor_t *sensors;
+    sigset_t all, old;
+    pthread_t decoder;
+    sample_slot_t *stop;
+    int started;
+    int i;
+    
+    if (count < 2) {
+        read_each(configs, indices, count, readings, deadline_us, defer);
+        return;
+    }
+    
+    memset(&p, 0, sizeof(p));
+    sensors = calloc((size_t)count, sizeof(*sensors));
+    if (frame_log_file()) {
+        p.frame_log = calloc((size_t)count, sizeof(*p.frame_log));
+    }
+    if (!sensors || ring_init(&p.samples, sizeof(sample_slot_t)) < 0 ||
+        ring_init(&p.results, sizeof(result_slot_t)) < 0) {
+        free(sensors);
+        free(p.frame_log);
+        free(p.samples.slots);
+        free(p.results.slots);
+        read_each(configs, indices, count, readings, deadline_us, defer);
+        return;
+    }
+    sem_init(&p.samples_posted, 0, 0);
+    sem_init(&p.results_posted, 0, 0);
+    
+    /* Signals stay with the sampler, whose handlers release the GPIO line */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    started = pthread_create(&decoder, NULL, decoder_main, &p) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    
+    for (i = 0; i < count; i++) {
+        readings[indices[i]].valid = false;
+        readings[indices[i]].error_msg[0] = '\0';
+    }
+    
+    if (!started) {
+        read_each(configs, indices, count, readings, deadline_us, defer);
+    } else {
+        int busy = run_sampler(&p, configs, indices, count, readings, sensors, deadline_us, defer);
+        
+        stop = ring_reserve(&p.samples);
+        stop->sensor = -1;
+        ring_publish(&p.samples);
+        sem_post(&p.samples_posted);
+        pthread_join(decoder, NULL);
+        
+        for (i = 0; busy > 0 && i < count; i++) {
+            if (sensors[i].busy) {
+                read_dht11_until(configs[indices[i]].pin, &readings[indices[i]], deadline_us, defer);
+                busy--;
+            }
+        }
+    }
+    
+    sem_destroy(&p.samples_posted);
+    sem_destroy(&p.results_posted);
+    free(p.samples.slots);
+    free(p.results.slots);
+    free(p.frame_log);
+    free(sensors);
+}
@@ -0,0 +1,19 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Read many GPIO sensors with a real-time sampler and a normal-priority decoder
+ */
+
+#ifndef READ_PIPELINE_H
+#define READ_PIPELINE_H
+
+#include "dht11.h"
+
+/* Frames in flight between sampler and decoder; a power of two */
+#define PIPELINE_SLOTS      64
+
+void read_dht11_batch(const sensor_config_t *configs, const int *indices, int count,
+                      sensor_reading_t *readings, uint64_t deadline_us, bool defer);
+
+#endif /* READ_PIPELINE_H */
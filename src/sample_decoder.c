@@ -0,0 +1,137 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Sample-buffer decoder.
+ *
+ * The buffer holds one bit per sample of the data line, MSB first, taken at
+ * a fixed rate from the start of the host's start signal. Because the
+ * samples are hardware-timed, a pulse width is simply its run length
+ * divided by the rate: no clock reads and no scheduling assumptions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dht11.h"
+#include "sample_decoder.h"
+
+#define SAMPLE(buf, i)  (((buf)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+/*
+ * Find the end of the run of level starting at sample i.
+ * Whole bytes at one level are skipped at once, which covers the start signal.
+ */
+static size_t run_end(const uint8_t *buf, size_t total, size_t i, int level) {
+    uint8_t same = level ? 0xFF : 0x00;
+    
+    while (i < total && SAMPLE(buf, i) == level) {
+        i++;
+        while ((i & 7) == 0 && i + 8 <= total && buf[i >> 3] == same) {
+            i += 8;
+        }
+    }
+    return i;
+}
+
+/*
+ * Convert a run of samples to microseconds, rounded to nearest
+ */
+uint32_t samples_to_us(uint32_t samples, uint32_t rate_hz) {
+    return (uint32_t)(((uint64_t)samples * 1000000ULL + rate_hz / 2) / rate_hz);
+}
+
+/*
+ * Convert microseconds to a number of samples, rounded up
+ */
+uint32_t us_to_samples(uint32_t us, uint32_t rate_hz) {
+    return (uint32_t)(((uint64_t)us * rate_hz + 999999ULL) / 1000000ULL);
+}
+
+/*
+ * Buffer size in bytes to capture the start signal and a worst-case frame
+ */
+size_t sample_capture_bytes(uint32_t start_low_us, uint32_t rate_hz) {
+    uint32_t samples = us_to_samples(start_low_us + DHT11_FRAME_US + SAMPLE_TAIL_US, rate_hz);
+    return (samples + 7) / 8;
+}
+
+/*
+ * Collect the low/high pulse pairs from a sample buffer, keeping the last max.
+ * Data bits are the last 40 complete high pulses; the line idles high after
+ * the frame, so that final run is never complete.
+ * Returns the number of pairs stored.
+ */
+int sample_pulses(const uint8_t *buf, size_t len, uint32_t rate_hz,
+                  dht11_pulse_t *pulses, int max) {
+    size_t total = len * 8;
+    size_t i = 0;
+    size_t run_start;
+    uint32_t low = 0;
+    int count = 0;
+    
+    /* Skip to the end of the host start signal */
+    i = run_end(buf, total, i, 1);
+    i = run_end(buf, total, i, 0);
+    
+    while (i < total) {
+        run_start = i;
+        i = run_end(buf, total, i, 1);
+        if (i == total) {
+            break;
+        }
+        if (count == max) {
+            memmove(pulses, pulses + 1, (size_t)(max - 1) * sizeof(pulses[0]));
+            count--;
+        }
+        pulses[count].low_us = (uint16_t)(low > 0xFFFF ? 0xFFFF : low);
+        pulses[count].high_us = (uint16_t)samples_to_us((uint32_t)(i - run_start), rate_hz);
+        count++;
+        
+        run_start = i;
+        i = run_end(buf, total, i, 0);
+        low = samples_to_us((uint32_t)(i - run_start), rate_hz);
+    }
+    return count;
+}
+
+/*
+ * Classify the data bits of a sampled frame. The samples are hardware-timed,
+ * so while the frame's lows show the sensor on nominal timing the fixed
+ * threshold is tried first: it does not average jitter into its reference.
+ * Otherwise, or if it fails, the bits are classified against the frame's own
+ * lows, which follows a sensor whose oscillator has drifted. A fixed
+ * threshold on a drifted frame passes the checksum with wrong data too
+ * often to be tried there.
+ * Returns 0 if the checksum matches, -1 otherwise.
+ */
+int classify_samples(const dht11_pulse_t *pulses, int count, uint8_t data[5]) {
+    uint32_t low = pulse_typical_low_us(pulses, count);
+    uint32_t tolerance = PULSE_NOMINAL_LOW_US * SAMPLE_NOMINAL_TOLERANCE_PCT / 100;
+    
+    if (low + tolerance >= PULSE_NOMINAL_LOW_US && low <= PULSE_NOMINAL_LOW_US + tolerance &&
+        classify_pulses(pulses, count, CLASSIFY_FIXED, data) == 0) {
+        return 0;
+    }
+    return classify_pulses(pulses, count, CLASSIFY_RATIO, data);
+}
+
+/*
+ * Decode the 40 data bits from a sample buffer.
+ * Returns 0 on success, -1 on error with error_msg set.
+ */
+int decode_samples(const uint8_t *buf, size_t len, uint32_t rate_hz, uint8_t data[5],
+                   char *error_msg, size_t error_size) {
+    dht11_pulse_t pulses[SAMPLE_MAX_PULSES];
+    int count = sample_pulses(buf, len, rate_hz, pulses, SAMPLE_MAX_PULSES);
+    
+    if (count < 40) {
+        snprintf(error_msg, error_size, "Incomplete frame: %d high pulses captured", count);
+        return -1;
+    }
+    if (classify_samples(pulses + count - 40, 40, data) < 0) {
+        snprintf(error_msg, error_size, "Checksum mismatch");
+        return -1;
+    }
+    return 0;
+}
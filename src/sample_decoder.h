@@ -0,0 +1,33 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Decode a DHT11 frame from a buffer of fixed-rate line samples
+ */
+
+#ifndef SAMPLE_DECODER_H
+#define SAMPLE_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pulse_classifier.h"
+
+/* Pulse pairs kept from the end of a capture */
+#define SAMPLE_MAX_PULSES       48
+
+/* Percentage the typical low may be off nominal for the fixed threshold to be tried */
+#define SAMPLE_NOMINAL_TOLERANCE_PCT    10
+
+/* Margin after the worst-case frame before the capture ends */
+#define SAMPLE_TAIL_US          500
+
+uint32_t samples_to_us(uint32_t samples, uint32_t rate_hz);
+uint32_t us_to_samples(uint32_t us, uint32_t rate_hz);
+size_t sample_capture_bytes(uint32_t start_low_us, uint32_t rate_hz);
+int sample_pulses(const uint8_t *buf, size_t len, uint32_t rate_hz,
+                  dht11_pulse_t *pulses, int max);
+int classify_samples(const dht11_pulse_t *pulses, int count, uint8_t data[5]);
+int decode_samples(const uint8_t *buf, size_t len, uint32_t rate_hz, uint8_t data[5],
+                   char *error_msg, size_t error_size);
+
+#endif /* SAMPLE_DECODER_H */
@@ -0,0 +1,119 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Structure-of-arrays sensor runtime state.
+ *
+ * The arrays are carved from one cache-line aligned block, each padded to a
+ * whole number of cache lines, so scanning one field never shares a line
+ * with another field and the scans vectorise.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sensor_state.h"
+
+/*
+ * Bytes for count elements of size, rounded up to whole cache lines
+ */
+static size_t padded(int count, size_t size) {
+    size_t bytes = (size_t)count * size;
+    return (bytes + SENSOR_STATE_ALIGN - 1) & ~(size_t)(SENSOR_STATE_ALIGN - 1);
+}
+
+/*
+ * Allocate state for count sensors, all first due at first_due_us.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int sensor_state_init(sensor_state_t *state, const sensor_config_t *configs, int count,
+                      uint64_t first_due_us) {
+    size_t size = padded(count, sizeof(uint64_t)) * 3 + padded(count, sizeof(uint8_t)) +
+                  padded(count, sizeof(int16_t)) + padded(count, sizeof(uint16_t));
+    char *p;
+    int i;
+    
+    memset(state, 0, sizeof(*state));
+    if (posix_memalign(&state->block, SENSOR_STATE_ALIGN, size ? size : SENSOR_STATE_ALIGN) != 0) {
+        state->block = NULL;
+        return -1;
+    }
+    memset(state->block, 0, size);
+    
+    p = state->block;
+    state->next_due_us = (uint64_t *)p;
+    p += padded(count, sizeof(uint64_t));
+    state->read_us = (uint64_t *)p;
+    p += padded(count, sizeof(uint64_t));
+    state->deferred_us = (uint64_t *)p;
+    p += padded(count, sizeof(uint64_t));
+    state->failures = (uint8_t *)p;
+    p += padded(count, sizeof(uint8_t));
+    state->temperature_x10 = (int16_t *)p;
+    p += padded(count, sizeof(int16_t));
+    state->humidity_x10 = (uint16_t *)p;
+    
+    state->count = count;
+    state->configs = configs;
+    for (i = 0; i < count; i++) {
+        state->next_due_us[i] = first_due_us;
+    }
+    return 0;
+}
+
+void sensor_state_free(sensor_state_t *state) {
+    free(state->block);
+    memset(state, 0, sizeof(*state));
+}
+
+/*
+ * Collect the indices of sensors due at now_us into due (room for count).
+ * Returns the number due.
+ */
+int sensor_state_due(const sensor_state_t *state, uint64_t now_us, int *due) {
+    const uint64_t *next_due_us = state->next_due_us;
+    int n = 0;
+    int i;
+    
+    /* Branch-free append: always store, advance only when due */
+    for (i = 0; i < state->count; i++) {
+        due[n] = i;
+        n += next_due_us[i] <= now_us;
+    }
+    return n;
+}
+
+/*
+ * Earliest time any sensor is due, UINT64_MAX if there are none
+ */
+uint64_t sensor_state_next_due(const sensor_state_t *state) {
+    const uint64_t *next_due_us = state->next_due_us;
+    uint64_t earliest = UINT64_MAX;
+    int i;
+    
+    for (i = 0; i < state->count; i++) {
+        earliest = next_due_us[i] < earliest ? next_due_us[i] : earliest;
+    }
+    return earliest;
+}
+
+/*
+ * Record the outcome of reading sensor i, which started at read_us.
+ * Returns true if this read made the sensor unhealthy.
+ */
+bool sensor_state_record(sensor_state_t *state, int i, const sensor_reading_t *reading,
+                         uint64_t read_us) {
+    state->read_us[i] = read_us;
+    if (reading->valid) {
+        state->failures[i] = 0;
+        state->temperature_x10[i] = (int16_t)(reading->temperature * 10.0f + (reading->temperature < 0 ? -0.5f : 0.5f));
+        state->humidity_x10[i] = (uint16_t)(reading->humidity * 10.0f + 0.5f);
+        return false;
+    }
+    if (state->failures[i] < UINT8_MAX) {
+        state->failures[i]++;
+    }
+    return state->failures[i] == SENSOR_UNHEALTHY_FAILURES;
+}
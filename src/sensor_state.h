@@ -0,0 +1,52 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Per-sensor runtime state as structure-of-arrays
+ */
+
+#ifndef SENSOR_STATE_H
+#define SENSOR_STATE_H
+
+#include <stdint.h>
+#include "dht11.h"
+
+/* Every array starts on its own cache line */
+#define SENSOR_STATE_ALIGN          64
+
+/* Consecutive failed reads before a sensor is reported unhealthy */
+#define SENSOR_UNHEALTHY_FAILURES   5
+
+/*
+ * Runtime state for sensor i lives at index i of each array. The scheduler
+ * scans only next_due_us, so a tick over thousands of sensors reads 8 bytes
+ * per sensor instead of pulling in whole configs and readings. Strings and
+ * other cold settings stay in the sensor_config_t table, indexed the same way.
+ */
+typedef struct {
+    int count;
+    
+    /* Hot: scanned on every scheduler tick */
+    uint64_t *next_due_us;      /* CLOCK_MONOTONIC time the sensor is next due */
+    
+    /* Warm: touched only for sensors being read or served */
+    uint64_t *read_us;          /* Wall-clock start of the last read, 0 if never read */
+    uint64_t *deferred_us;      /* CLOCK_MONOTONIC start of a wait for pressure to ease, or 0 */
+    uint8_t *failures;          /* Consecutive failed reads, saturating */
+    int16_t *temperature_x10;   /* Last good reading */
+    uint16_t *humidity_x10;
+    
+    /* Cold */
+    const sensor_config_t *configs;
+    void *block;                /* Single allocation backing the arrays */
+} sensor_state_t;
+
+int sensor_state_init(sensor_state_t *state, const sensor_config_t *configs, int count,
+                      uint64_t first_due_us);
+void sensor_state_free(sensor_state_t *state);
+int sensor_state_due(const sensor_state_t *state, uint64_t now_us, int *due);
+uint64_t sensor_state_next_due(const sensor_state_t *state);
+bool sensor_state_record(sensor_state_t *state, int i, const sensor_reading_t *reading,
+                         uint64_t read_us);
+
+#endif /* SENSOR_STATE_H */
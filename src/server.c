@@ -0,0 +1,370 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Non-blocking line protocol server.
+ *
+ * The owner polls the descriptors from server_pollfds() alongside its own
+ * and passes the results to server_dispatch(), which accepts clients, splits
+ * requests into lines and queues the handler's responses. A single thread
+ * serves every client, so the handler never races with the owner's state.
+ */
+
+#define _GNU_SOURCE     /* accept4 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "server.h"
+
+typedef struct {
+    int fd;
+    struct sockaddr_in peer;    /* Client address, for tracing */
+    char in[SERVER_MAX_REQUEST];
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    size_t out_pos;
+    size_t out_cap;
+} server_client_t;
+
+struct line_server {
+    int listen_fd;
+    server_client_t clients[SERVER_MAX_CLIENTS];
+    int num_clients;
+};
+
+/*
+ * Listen on bind_addr:port (loopback only if bind_addr is NULL)
+ */
+line_server_t *server_open(const char *bind_addr, int port) {
+    struct sockaddr_in addr;
+    line_server_t *server;
+    int one = 1;
+    int fd;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind_addr && inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1) {
+        log_error("Invalid bind address %s", bind_addr);
+        return NULL;
+    }
+    
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_error("Cannot create socket: %s", strerror(errno));
+        return NULL;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        log_error("Cannot listen on port %d: %s", port, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    
+    server = calloc(1, sizeof(*server));
+    if (!server) {
+        close(fd);
+        return NULL;
+    }
+    server->listen_fd = fd;
+    return server;
+}
+
+/*
+ * Fill fds with the descriptors to poll: the listener, then each client.
+ * Returns the number filled.
+ */
+int server_pollfds(const line_server_t *server, struct pollfd *fds, int max) {
+    int n = 0;
+    int i;
+    
+    if (max < 1 + server->num_clients) {
+        return 0;
+    }
+    fds[n].fd = server->listen_fd;
+    fds[n].events = server->num_clients < SERVER_MAX_CLIENTS ? POLLIN : 0;
+    fds[n++].revents = 0;
+    for (i = 0; i < server->num_clients; i++) {
+        const server_client_t *client = &server->clients[i];
+        fds[n].fd = client->fd;
+        fds[n].events = POLLIN | (client->out_pos < client->out_len ? POLLOUT : 0);
+        fds[n++].revents = 0;
+    }
+    return n;
+}
+
+static void drop_client(line_server_t *server, int idx) {
+    close(server->clients[idx].fd);
+    free(server->clients[idx].out);
+    server->clients[idx] = server->clients[--server->num_clients];
+}
+
+/*
+ * Queue a response line.
+ * Returns 0 on success, -1 if the client is too far behind.
+ */
+static int queue_response(server_client_t *client, const char *response) {
+    size_t len = strlen(response);
+    
+    /* Reclaim space already sent */
+    if (client->out_pos == client->out_len) {
+        client->out_pos = client->out_len = 0;
+    }
+    if (client->out_len - client->out_pos + len + 1 > SERVER_MAX_PENDING) {
+        return -1;
+    }
+    if (client->out_len + len + 1 > client->out_cap) {
+        size_t cap = client->out_cap ? client->out_cap : 4096;
+        char *grown;
+        while (cap < client->out_len + len + 1) {
+            cap *= 2;
+        }
+        grown = realloc(client->out, cap);
+        if (!grown) {
+            return -1;
+        }
+        client->out = grown;
+        client->out_cap = cap;
+    }
+    memcpy(client->out + client->out_len, response, len);
+    client->out[client->out_len + len] = '\n';
+    client->out_len += len + 1;
+    return 0;
+}
+
+/*
+ * Send as much queued output as the socket takes.
+ * Returns 0 on success, -1 if the connection failed.
+ */
+static int flush_client(server_client_t *client) {
+    while (client->out_pos < client->out_len) {
+        ssize_t n = send(client->fd, client->out + client->out_pos,
+                         client->out_len - client->out_pos, MSG_NOSIGNAL);
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        client->out_pos += (size_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Read requests from a client and queue their responses.
+ * Returns 0 on success, -1 if the client should be dropped.
+ */
+static int serve_client(server_client_t *client, server_handler_t handler, void *ctx) {
+    for (;;) {
+        ssize_t n = recv(client->fd, client->in + client->in_len,
+                         sizeof(client->in) - client->in_len, 0);
+        char *start, *newline;
+        
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        client->in_len += (size_t)n;
+        
+        start = client->in;
+        while ((newline = memchr(start, '\n', client->in_len - (size_t)(start - client->in)))) {
+            char *response;
+            
+            *newline = '\0';
+            if (newline > start && newline[-1] == '\r') {
+                newline[-1] = '\0';
+            }
+            response = handler(ctx, start, &client->peer);
+            if (!response || queue_response(client, response) < 0) {
+                free(response);
+                return -1;
+            }
+            free(response);
+            start = newline + 1;
+        }
+        client->in_len -= (size_t)(start - client->in);
+        memmove(client->in, start, client->in_len);
+        
+        if (client->in_len == sizeof(client->in)) {
+            /* Request line too long */
+            return -1;
+        }
+    }
+}
+
+/*
+ * Handle poll results for the descriptors filled by server_pollfds()
+ */
+void server_dispatch(line_server_t *server, const struct pollfd *fds, int nfds,
+                     server_handler_t handler, void *ctx) {
+    int polled = nfds - 1;
+    int i;
+    
+    if (nfds < 1) {
+        return;
+    }
+    
+    /* Clients from the back, so dropping one does not disturb unvisited slots */
+    for (i = polled - 1; i >= 0; i--) {
+        server_client_t *client = &server->clients[i];
+        short revents = fds[1 + i].revents;
+        
+        if (revents & (POLLERR | POLLNVAL)) {
+            drop_client(server, i);
+            continue;
+        }
+        if ((revents & (POLLIN | POLLHUP)) && serve_client(client, handler, ctx) < 0) {
+            drop_client(server, i);
+            continue;
+        }
+        if (flush_client(client) < 0) {
+            drop_client(server, i);
+        }
+    }
+    
+    if (fds[0].revents & POLLIN) {
+        while (server->num_clients < SERVER_MAX_CLIENTS) {
+            server_client_t *client = &server->clients[server->num_clients];
+            struct sockaddr_in peer;
+            socklen_t peer_len = sizeof(peer);
+            int one = 1;
+            int fd;
+            
+            memset(&peer, 0, sizeof(peer));
+            fd = accept4(server->listen_fd, (struct sockaddr *)&peer, &peer_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                break;
+            }
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            memset(client, 0, sizeof(*client));
+            client->fd = fd;
+            client->peer = peer;
+            server->num_clients++;
+        }
+    }
+}
+
+void server_close(line_server_t *server) {
+    if (!server) {
+        return;
+    }
+    while (server->num_clients > 0) {
+        drop_client(server, server->num_clients - 1);
+    }
+    close(server->listen_fd);
+    free(server);
+}
+
+/*
+ * Hand-off accessors: a replacement daemon takes over the listener and each
+ * client connection, with whatever request bytes were not yet complete and
+ * whatever response bytes were not yet sent.
+ */
+int server_listen_fd(const line_server_t *server) {
+    return server->listen_fd;
+}
+
+int server_client_count(const line_server_t *server) {
+    return server->num_clients;
+}
+
+void server_client_state(const line_server_t *server, int i, int *fd,
+                         const char **in, size_t *in_len, const char **out, size_t *out_len) {
+    const server_client_t *client = &server->clients[i];
+    
+    *fd = client->fd;
+    *in = client->in;
+    *in_len = client->in_len;
+    *out = client->out ? client->out + client->out_pos : NULL;
+    *out_len = client->out_len - client->out_pos;
+}
+
+/*
+ * Serve on an already listening socket
+ */
+line_server_t *server_adopt(int listen_fd) {
+    line_server_t *server = calloc(1, sizeof(*server));
+    
+    if (server) {
+        server->listen_fd = listen_fd;
+    }
+    return server;
+}
+
+/*
+ * Add a connected client with its buffered input and unsent output.
+ * Returns 0 on success, -1 if the client cannot be taken on.
+ */
+int server_adopt_client(line_server_t *server, int fd, const char *in, size_t in_len,
+                        const char *out, size_t out_len) {
+    server_client_t *client;
+    socklen_t peer_len;
+    
+    if (server->num_clients == SERVER_MAX_CLIENTS || in_len > sizeof(client->in) ||
+        out_len > SERVER_MAX_PENDING) {
+        return -1;
+    }
+    client = &server->clients[server->num_clients];
+    memset(client, 0, sizeof(*client));
+    peer_len = sizeof(client->peer);
+    getpeername(fd, (struct sockaddr *)&client->peer, &peer_len);
+    if (out_len > 0) {
+        client->out = malloc(out_len);
+        if (!client->out) {
+            return -1;
+        }
+        memcpy(client->out, out, out_len);
+        client->out_len = client->out_cap = out_len;
+    }
+    memcpy(client->in, in, in_len);
+    client->in_len = in_len;
+    client->fd = fd;
+    server->num_clients++;
+    return 0;
+}
+
+/*
+ * Parse a READ request.
+ * Returns 0 on success, -1 if the request is not understood.
+ */
+int server_parse_request(const char *request, const char **filter,
+                         ws_location_filter_t *location_filter) {
+    const char *arg;
+    
+    *filter = NULL;
+    *location_filter = WS_LOCATION_ALL;
+    if (strncmp(request, "READ", 4) != 0 || (request[4] != '\0' && request[4] != ' ')) {
+        return -1;
+    }
+    arg = request + 4;
+    while (*arg == ' ') {
+        arg++;
+    }
+    
+    if (*arg == '\0' || strcmp(arg, "all") == 0) {
+        return 0;
+    } else if (strcmp(arg, "temperature") == 0) {
+        *filter = "temperature";
+    } else if (strcmp(arg, "humidity") == 0) {
+        *filter = "humidity";
+    } else if (strcmp(arg, "internal") == 0) {
+        *location_filter = WS_LOCATION_INTERNAL;
+    } else if (strcmp(arg, "external") == 0) {
+        *location_filter = WS_LOCATION_EXTERNAL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
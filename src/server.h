@@ -0,0 +1,59 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Line protocol server shared by the node daemon and the gateway
+ *
+ * Requests and responses are single lines over TCP:
+ *
+ *   READ [temperature|humidity|internal|external|all]
+ *   OK <read_us> <JSON array of readings>
+ *   ERR <message>
+ *
+ *   STATS
+ *   OK <now_us> <JSON object of pressure deferral counters>
+ *
+ * read_us is when the oldest reading in the response was taken, in
+ * microseconds since the epoch, so clients can tell how stale it is.
+ * Clients may pipeline requests; responses come back in request order.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include "dht11.h"
+
+#define SERVER_DEFAULT_PORT     7411
+#define SERVER_DEFAULT_INTERVAL_SEC 10      /* Seconds between node daemon sweeps */
+#define SERVER_MAX_CLIENTS      64
+#define SERVER_MAX_REQUEST      256         /* Longest request line */
+#define SERVER_MAX_PENDING      (1 << 20)   /* Unsent response bytes before a client is dropped */
+
+typedef struct line_server line_server_t;
+
+/*
+ * Produce the response line (without newline) for one request from the
+ * client at peer; NULL drops the client
+ */
+typedef char *(*server_handler_t)(void *ctx, const char *request,
+                                  const struct sockaddr_in *peer);
+
+line_server_t *server_open(const char *bind_addr, int port);
+int server_pollfds(const line_server_t *server, struct pollfd *fds, int max);
+void server_dispatch(line_server_t *server, const struct pollfd *fds, int nfds,
+                     server_handler_t handler, void *ctx);
+void server_close(line_server_t *server);
+int server_listen_fd(const line_server_t *server);
+int server_client_count(const line_server_t *server);
+void server_client_state(const line_server_t *server, int i, int *fd,
+                         const char **in, size_t *in_len, const char **out, size_t *out_len);
+line_server_t *server_adopt(int listen_fd);
+int server_adopt_client(line_server_t *server, int fd, const char *in, size_t in_len,
+                        const char *out, size_t out_len);
+int server_parse_request(const char *request, const char **filter,
+                         ws_location_filter_t *location_filter);
+
+#endif /* SERVER_H */
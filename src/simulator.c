@@ -0,0 +1,121 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * DHT11 simulator.
+ *
+ * Models what one read_dht11() call costs: each attempt holds the bus for
+ * the start signal plus the frame and fails with a fixed probability, and
+ * failed attempts back off with the real retry schedule. Values drift slowly
+ * with wall-clock time so consecutive reads usually return the same frame,
+ * as a real DHT11 does.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "simulator.h"
+
+/*
+ * Seed the simulator; the same seed replays the same failures
+ */
+void simulator_init(simulator_t *sim, uint64_t seed, double fail_rate) {
+    sim->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    sim->fail_rate = fail_rate;
+}
+
+/*
+ * Uniform random number in [0, 1) (xorshift64)
+ */
+double simulator_uniform(simulator_t *sim) {
+    sim->rng ^= sim->rng << 13;
+    sim->rng ^= sim->rng >> 7;
+    sim->rng ^= sim->rng << 17;
+    return (double)(sim->rng >> 11) / (double)(1ULL << 53);
+}
+
+/*
+ * Simulate one read attempt on a pin. On success fills raw with the frame
+ * the sensor would send now and returns 0; returns -1 if the attempt fails.
+ */
+int simulator_attempt(simulator_t *sim, int gpio_pin, uint8_t raw[5]) {
+    long now = (long)time(NULL);
+    
+    if (simulator_uniform(sim) < sim->fail_rate) {
+        return -1;
+    }
+    raw[0] = (uint8_t)(40 + (now / 900 + gpio_pin * 3) % 20);
+    raw[1] = 0;
+    raw[2] = (uint8_t)(18 + (now / 600 + gpio_pin) % 8);
+    raw[3] = 0;
+    raw[4] = (uint8_t)(raw[0] + raw[2]);
+    return 0;
+}
+
+/*
+ * Simulate read_dht11() on a pin, filling reading and cost
+ */
+void simulator_read(simulator_t *sim, int gpio_pin, sensor_reading_t *reading, sim_cost_t *cost) {
+    int attempt;
+    
+    memset(cost, 0, sizeof(*cost));
+    reading->valid = false;
+    reading->error_msg[0] = '\0';
+    
+    for (attempt = 0; attempt <= num_retries; attempt++) {
+        cost->attempts++;
+        cost->bus_us += DHT11_START_LOW_US + DHT11_START_HIGH_US + DHT11_FRAME_US;
+        cost->elapsed_us += DHT11_START_LOW_US + DHT11_START_HIGH_US + DHT11_FRAME_US;
+        
+        if (simulator_attempt(sim, gpio_pin, reading->raw) == 0) {
+            reading->humidity = (float)reading->raw[0];
+            reading->temperature = (float)reading->raw[2];
+            reading->valid = true;
+            return;
+        }
+        
+        if (attempt < num_retries) {
+            cost->elapsed_us += retry_delays_us[attempt];
+        }
+    }
+    
+    snprintf(reading->error_msg, sizeof(reading->error_msg),
+             "Failed to read DHT11 after %d attempts", cost->attempts);
+}
+
+/*
+ * Simulated backend: read through the simulator and take as long as the
+ * real read would, so daemons can be load-tested without sensors. A read
+ * that would run past deadline_us (CLOCK_MONOTONIC) fails there instead.
+ * Returns 0 on success, -1 on error with reading->error_msg set.
+ */
+int read_simulated(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us) {
+    static simulator_t sim;
+    static bool seeded = false;
+    struct timespec delay;
+    uint64_t now_us;
+    sim_cost_t cost;
+    
+    if (!seeded) {
+        simulator_init(&sim, (uint64_t)getpid() << 32 ^ (uint64_t)time(NULL), SIM_DEFAULT_FAIL_RATE);
+        seeded = true;
+    }
+    simulator_read(&sim, config->pin, reading, &cost);
+    
+    now_us = monotonic_us();
+    if (now_us + cost.elapsed_us > deadline_us) {
+        cost.elapsed_us = deadline_us > now_us ? deadline_us - now_us : 0;
+        reading->valid = false;
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "Failed to read DHT11 before the read deadline");
+    }
+    delay.tv_sec = (time_t)(cost.elapsed_us / 1000000);
+    delay.tv_nsec = (long)(cost.elapsed_us % 1000000) * 1000;
+    while (nanosleep(&delay, &delay) < 0 && g_running) {
+    }
+    return reading->valid ? 0 : -1;
+}
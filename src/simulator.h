@@ -0,0 +1,35 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * DHT11 simulator for developing and tuning without hardware
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+#include "dht11.h"
+
+/* Default probability that a single read attempt fails */
+#define SIM_DEFAULT_FAIL_RATE   0.2
+
+typedef struct {
+    uint64_t rng;           /* xorshift64 state, never zero */
+    double fail_rate;       /* Probability that one attempt fails */
+} simulator_t;
+
+/* Cost of one simulated read_dht11() call */
+typedef struct {
+    uint64_t bus_us;        /* Time the line was driven or sampled */
+    uint64_t elapsed_us;    /* Bus time plus retry backoff */
+    int attempts;
+} sim_cost_t;
+
+void simulator_init(simulator_t *sim, uint64_t seed, double fail_rate);
+double simulator_uniform(simulator_t *sim);
+int simulator_attempt(simulator_t *sim, int gpio_pin, uint8_t raw[5]);
+void simulator_read(simulator_t *sim, int gpio_pin, sensor_reading_t *reading, sim_cost_t *cost);
+int read_simulated(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us);
+
+#endif /* SIMULATOR_H */
@@ -0,0 +1,129 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Snapshot sink for watch and serve.
+ *
+ * Each sweep is written to a temporary file in the snapshot's directory and
+ * renamed over the snapshot. rename() replaces the name atomically, so a
+ * reader opening the snapshot gets either the previous sweep or this one,
+ * whole, and one that already has it open keeps reading the old contents.
+ * The contents are exactly what a one-shot run prints, newline included.
+ * Nothing is fsynced: the snapshot is meant for a tmpfs such as /run, where
+ * that would cost a syscall and buy nothing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dht11.h"
+#include "snapshot_sink.h"
+
+struct snapshot_sink {
+    char *path;
+    char *tmp_path;             /* Same directory, so rename() stays on one filesystem */
+    bool failing;               /* Last write failed; log again only once it recovers */
+};
+
+/*
+ * Write json and a newline to a new file at path.
+ * Returns 0 on success, -1 with errno set on error.
+ */
+static int write_file(const char *path, const char *json) {
+    size_t len = strlen(json);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int saved;
+    
+    if (fd < 0) {
+        return -1;
+    }
+    while (len > 0) {
+        ssize_t n = write(fd, json, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        json += n;
+        len -= (size_t)n;
+    }
+    if (write(fd, "\n", 1) != 1) {
+        saved = errno;
+        close(fd);
+        errno = saved ? saved : EIO;
+        return -1;
+    }
+    return close(fd);
+}
+
+/*
+ * Prepare to keep a snapshot at path. Checks that its directory is
+ * writable, so a bad path fails at start-up rather than on the first sweep.
+ * Returns NULL on error.
+ */
+snapshot_sink_t *snapshot_sink_open(const char *path) {
+    snapshot_sink_t *sink = calloc(1, sizeof(snapshot_sink_t));
+    size_t len = strlen(path) + 32;
+    int fd;
+    
+    if (!sink) {
+        return NULL;
+    }
+    sink->path = strdup(path);
+    sink->tmp_path = malloc(len);
+    if (!sink->path || !sink->tmp_path) {
+        snapshot_sink_close(sink);
+        return NULL;
+    }
+    snprintf(sink->tmp_path, len, "%s.%ld.tmp", path, (long)getpid());
+    
+    fd = open(sink->tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_error("Cannot write snapshot %s: %s", path, strerror(errno));
+        snapshot_sink_close(sink);
+        return NULL;
+    }
+    close(fd);
+    unlink(sink->tmp_path);
+    return sink;
+}
+
+/*
+ * Replace the snapshot with json.
+ * Returns 0 on success, -1 on error; the previous snapshot is left in place.
+ */
+int snapshot_sink_write(snapshot_sink_t *sink, const char *json) {
+    if (write_file(sink->tmp_path, json) < 0 || rename(sink->tmp_path, sink->path) < 0) {
+        if (!sink->failing) {
+            log_error("Cannot write snapshot %s: %s", sink->path, strerror(errno));
+        }
+        sink->failing = true;
+        unlink(sink->tmp_path);
+        return -1;
+    }
+    sink->failing = false;
+    return 0;
+}
+
+/*
+ * Stop updating the snapshot. The file is left with the last sweep, whose
+ * timestamps show how old it is.
+ */
+void snapshot_sink_close(snapshot_sink_t *sink) {
+    if (!sink) {
+        return;
+    }
+    free(sink->path);
+    free(sink->tmp_path);
+    free(sink);
+}
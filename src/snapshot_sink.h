@@ -0,0 +1,18 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Snapshot sink: keeps the latest sweep's JSON in a file for readers that
+ * can only cat a file
+ */
+
+#ifndef SNAPSHOT_SINK_H
+#define SNAPSHOT_SINK_H
+
+typedef struct snapshot_sink snapshot_sink_t;
+
+snapshot_sink_t *snapshot_sink_open(const char *path);
+int snapshot_sink_write(snapshot_sink_t *sink, const char *json);
+void snapshot_sink_close(snapshot_sink_t *sink);
+
+#endif /* SNAPSHOT_SINK_H */
@@ -0,0 +1,396 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * SPI backend.
+ *
+ * MOSI drives the data line through a resistor and MISO reads it back. One
+ * full-duplex transfer sends zeros for the start signal and then ones to
+ * release the line, while the controller clocks in the sensor's response at
+ * a fixed rate. The capture is timed by the SPI hardware, so it does not
+ * depend on CPU scheduling and needs no real-time priority.
+ *
+ * Captures come from a capture_source_t: spidev on hardware, or a recorded
+ * or synthetic buffer so the decoder can be exercised without it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "spi_backend.h"
+#include "sample_decoder.h"
+
+/* Synthetic source: sensor values from the simulator, pulse widths with jitter */
+typedef struct {
+    capture_source_t base;
+    simulator_t sim;
+    int pin;
+    double jitter;
+} synthetic_source_t;
+
+typedef struct {
+    capture_source_t base;
+    int fd;
+    uint8_t *tx;
+    size_t tx_len;
+} spidev_source_t;
+
+typedef struct {
+    capture_source_t base;
+    uint8_t *samples;
+    size_t length;
+} file_source_t;
+
+/*
+ * Full-duplex transfer: drive the start signal on MOSI while sampling MISO
+ */
+static ssize_t spidev_capture(capture_source_t *src, uint8_t *buf, size_t len,
+                              char *error_msg, size_t error_size) {
+    spidev_source_t *spi = (spidev_source_t *)src;
+    struct spi_ioc_transfer xfer;
+    size_t start_bytes = us_to_samples(DHT11_START_LOW_US, src->rate_hz) / 8;
+    
+    if (spi->tx_len < len) {
+        uint8_t *tx = realloc(spi->tx, len);
+        if (!tx) {
+            snprintf(error_msg, error_size, "Out of memory");
+            return -1;
+        }
+        spi->tx = tx;
+        spi->tx_len = len;
+    }
+    memset(spi->tx, 0x00, start_bytes < len ? start_bytes : len);
+    if (start_bytes < len) {
+        memset(spi->tx + start_bytes, 0xFF, len - start_bytes);
+    }
+    
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = (unsigned long)spi->tx;
+    xfer.rx_buf = (unsigned long)buf;
+    xfer.len = (uint32_t)len;
+    xfer.speed_hz = src->rate_hz;
+    xfer.bits_per_word = 8;
+    
+    if (ioctl(spi->fd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
+        snprintf(error_msg, error_size, "SPI transfer failed: %s", strerror(errno));
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+static void spidev_close(capture_source_t *src) {
+    spidev_source_t *spi = (spidev_source_t *)src;
+    close(spi->fd);
+    free(spi->tx);
+    free(spi);
+}
+
+/*
+ * Open a spidev device in mode 0 at rate_hz
+ */
+capture_source_t *capture_open_spidev(const char *path, uint32_t rate_hz) {
+    spidev_source_t *spi;
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    int fd;
+    
+    fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        log_error("Cannot open SPI device %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+        ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &rate_hz) < 0) {
+        log_error("Cannot configure SPI device %s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    
+    spi = calloc(1, sizeof(*spi));
+    if (!spi) {
+        close(fd);
+        return NULL;
+    }
+    spi->base.rate_hz = rate_hz;
+    spi->base.capture = spidev_capture;
+    spi->base.close = spidev_close;
+    spi->fd = fd;
+    return &spi->base;
+}
+
+/*
+ * Replay a recorded capture, padded with the idle-high line if short
+ */
+static ssize_t file_capture(capture_source_t *src, uint8_t *buf, size_t len,
+                            char *error_msg, size_t error_size) {
+    file_source_t *file = (file_source_t *)src;
+    size_t n = file->length < len ? file->length : len;
+    
+    (void)error_msg;
+    (void)error_size;
+    memcpy(buf, file->samples, n);
+    memset(buf + n, 0xFF, len - n);
+    return (ssize_t)len;
+}
+
+static void file_close(capture_source_t *src) {
+    file_source_t *file = (file_source_t *)src;
+    free(file->samples);
+    free(file);
+}
+
+/*
+ * Open a capture recorded with capture_write_file()
+ */
+capture_source_t *capture_open_file(const char *path) {
+    capture_file_header_t header;
+    file_source_t *file;
+    FILE *fp;
+    
+    fp = fopen(path, "rb");
+    if (!fp) {
+        log_error("Cannot open capture file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.rate_hz == 0) {
+        log_error("%s is not a DHT11 capture file", path);
+        fclose(fp);
+        return NULL;
+    }
+    
+    file = calloc(1, sizeof(*file));
+    if (file) {
+        file->samples = malloc(header.length ? header.length : 1);
+    }
+    if (!file || !file->samples || fread(file->samples, 1, header.length, fp) != header.length) {
+        log_error("Cannot read capture file %s", path);
+        if (file) {
+            free(file->samples);
+        }
+        free(file);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    
+    file->base.rate_hz = header.rate_hz;
+    file->base.capture = file_capture;
+    file->base.close = file_close;
+    file->length = header.length;
+    return &file->base;
+}
+
+/*
+ * Write a capture for later replay with capture_open_file().
+ * Returns 0 on success, -1 on error.
+ */
+int capture_write_file(const char *path, uint32_t rate_hz, const uint8_t *buf, size_t len) {
+    capture_file_header_t header;
+    FILE *fp = fopen(path, "wb");
+    int ok;
+    
+    if (!fp) {
+        log_error("Cannot create capture file %s: %s", path, strerror(errno));
+        return -1;
+    }
+    memcpy(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic));
+    header.rate_hz = rate_hz;
+    header.length = (uint32_t)len;
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(buf, 1, len, fp) == len;
+    if (fclose(fp) != 0 || !ok) {
+        log_error("Cannot write capture file %s", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Set the samples covering [from_us, to_us) to level
+ */
+static void fill_level(uint8_t *buf, size_t len, uint32_t rate_hz,
+                       double from_us, double to_us, int level) {
+    size_t total = len * 8;
+    size_t i = (size_t)(from_us * rate_hz / 1e6 + 0.999999);
+    size_t end = (size_t)(to_us * rate_hz / 1e6 + 0.999999);
+    
+    for (; i < end && i < total; i++) {
+        if (level) {
+            buf[i >> 3] |= (uint8_t)(0x80 >> (i & 7));
+        } else {
+            buf[i >> 3] &= (uint8_t)~(0x80 >> (i & 7));
+        }
+    }
+}
+
+/*
+ * Render the line waveform for a frame as a sample buffer.
+ * Each pulse width is scaled by a random factor within +/- jitter.
+ * Returns the number of bytes that hold the frame.
+ */
+size_t synthesize_samples(const uint8_t frame[5], uint32_t rate_hz, double jitter,
+                          simulator_t *sim, uint8_t *buf, size_t len) {
+    double t = 0.0;
+    double width;
+    int b;
+
+/* Append one pulse of nominal width us at level */
+#define PULSE(us, level) do { \
+        width = (us) * (1.0 + jitter * (2.0 * simulator_uniform(sim) - 1.0)); \
+        fill_level(buf, len, rate_hz, t, t + width, (level)); \
+        t += width; \
+    } while (0)
+    
+    /* Idle high everywhere the waveform does not reach */
+    memset(buf, 0xFF, len);
+    
+    fill_level(buf, len, rate_hz, 0.0, DHT11_START_LOW_US, 0);
+    t = DHT11_START_LOW_US;
+    PULSE(30.0, 1);     /* Host releases, sensor waits 20-40us */
+    PULSE(80.0, 0);     /* Response */
+    PULSE(80.0, 1);
+    for (b = 0; b < 40; b++) {
+        PULSE(50.0, 0);
+        PULSE((frame[b / 8] >> (7 - b % 8)) & 1 ? 70.0 : 27.0, 1);
+    }
+    PULSE(50.0, 0);     /* End of frame, then the line idles high */
+
+#undef PULSE
+    
+    b = (int)(t * rate_hz / 1e6 / 8.0) + 1;
+    return (size_t)b < len ? (size_t)b : len;
+}
+
+static ssize_t synthetic_capture(capture_source_t *src, uint8_t *buf, size_t len,
+                                 char *error_msg, size_t error_size) {
+    synthetic_source_t *syn = (synthetic_source_t *)src;
+    sensor_reading_t reading;
+    sim_cost_t cost;
+    
+    (void)error_msg;
+    (void)error_size;
+    simulator_read(&syn->sim, syn->pin, &reading, &cost);
+    synthesize_samples(reading.raw, src->rate_hz, syn->jitter, &syn->sim, buf, len);
+    return (ssize_t)len;
+}
+
+static void synthetic_close(capture_source_t *src) {
+    free(src);
+}
+
+/*
+ * Generate waveforms for simulator readings, with pulse width jitter
+ */
+capture_source_t *capture_open_synthetic(int pin, uint32_t rate_hz, double jitter, uint64_t seed) {
+    synthetic_source_t *syn = calloc(1, sizeof(*syn));
+    
+    if (!syn) {
+        return NULL;
+    }
+    /* Never fail at the simulator level; only the decoder decides */
+    simulator_init(&syn->sim, seed, 0.0);
+    syn->pin = pin;
+    syn->jitter = jitter;
+    syn->base.rate_hz = rate_hz;
+    syn->base.capture = synthetic_capture;
+    syn->base.close = synthetic_close;
+    return &syn->base;
+}
+
+/*
+ * Open the capture source named by a sensor's device setting
+ */
+capture_source_t *capture_open(const char *device, int pin, uint32_t rate_hz) {
+    if (strncmp(device, CAPTURE_FILE_PREFIX, strlen(CAPTURE_FILE_PREFIX)) == 0) {
+        return capture_open_file(device + strlen(CAPTURE_FILE_PREFIX));
+    }
+    if (strcmp(device, CAPTURE_SYNTHETIC) == 0) {
+        return capture_open_synthetic(pin, rate_hz, 0.1, (uint64_t)time(NULL));
+    }
+    return capture_open_spidev(device, rate_hz);
+}
+
+void capture_close(capture_source_t *src) {
+    if (src) {
+        src->close(src);
+    }
+}
+
+/*
+ * Read a DHT11 through a capture source with the read_dht11() retry schedule,
+ * giving up once the next backoff would pass deadline_us (CLOCK_MONOTONIC).
+ * Returns 0 on success, -1 on error with reading->error_msg set.
+ */
+int read_spi(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us) {
+    capture_source_t *src;
+    uint8_t data[5];
+    uint8_t *buf;
+    char detail[96] = "";
+    size_t len;
+    int attempt;
+    
+    reading->valid = false;
+    reading->error_msg[0] = '\0';
+    
+    if (!config->device) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg), "No SPI device configured");
+        return -1;
+    }
+    src = capture_open(config->device, config->pin, SPI_DEFAULT_RATE_HZ);
+    if (!src) {
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "Cannot open SPI capture source %s", config->device);
+        return -1;
+    }
+    len = sample_capture_bytes(DHT11_START_LOW_US, src->rate_hz);
+    buf = malloc(len);
+    if (!buf) {
+        capture_close(src);
+        snprintf(reading->error_msg, sizeof(reading->error_msg), "Out of memory");
+        return -1;
+    }
+    
+    for (attempt = 0; attempt <= num_retries; attempt++) {
+        /* Capture errors are not transient; decode errors are */
+        if (src->capture(src, buf, len, reading->error_msg, sizeof(reading->error_msg)) < 0) {
+            break;
+        }
+        if (decode_samples(buf, len, src->rate_hz, data, detail, sizeof(detail)) == 0) {
+            memcpy(reading->raw, data, sizeof(reading->raw));
+            reading->humidity = (float)data[0] + (float)data[1] / 10.0f;
+            reading->temperature = dht11_temperature(data);
+            reading->valid = true;
+            break;
+        }
+        if (!g_running) {
+            break;
+        }
+        if (attempt < num_retries) {
+            if (monotonic_us() + retry_delays_us[attempt] >= deadline_us) {
+                break;
+            }
+            usleep(retry_delays_us[attempt]);
+        }
+    }
+    
+    if (!reading->valid && reading->error_msg[0] == '\0') {
+        snprintf(reading->error_msg, sizeof(reading->error_msg),
+                 "Failed to read DHT11 after %d attempts (%s)",
+                 attempt > num_retries ? attempt : attempt + 1, detail);
+    }
+    free(buf);
+    capture_close(src);
+    return reading->valid ? 0 : -1;
+}
@@ -0,0 +1,54 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * SPI backend: capture the DHT11 line as hardware-timed SPI samples
+ */
+
+#ifndef SPI_BACKEND_H
+#define SPI_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "dht11.h"
+#include "simulator.h"
+
+/* SPI clock, one sample per clock: 500kHz gives 2us resolution */
+#define SPI_DEFAULT_RATE_HZ     500000
+
+/* Device prefixes selecting a capture source other than spidev */
+#define CAPTURE_FILE_PREFIX     "file:"
+#define CAPTURE_SYNTHETIC       "synthetic"
+
+/* Recorded capture file: this header, then length bytes of samples (host byte order) */
+#define CAPTURE_FILE_MAGIC      "DHT11SPI"
+typedef struct {
+    char magic[8];
+    uint32_t rate_hz;
+    uint32_t length;
+} capture_file_header_t;
+
+/* A source of sample buffers, each starting with the host start signal */
+typedef struct capture_source capture_source_t;
+struct capture_source {
+    uint32_t rate_hz;
+    /* Fill buf; returns the number of bytes captured, or -1 with error_msg set */
+    ssize_t (*capture)(capture_source_t *src, uint8_t *buf, size_t len,
+                       char *error_msg, size_t error_size);
+    void (*close)(capture_source_t *src);
+};
+
+capture_source_t *capture_open_spidev(const char *path, uint32_t rate_hz);
+capture_source_t *capture_open_file(const char *path);
+capture_source_t *capture_open_synthetic(int pin, uint32_t rate_hz, double jitter, uint64_t seed);
+capture_source_t *capture_open(const char *device, int pin, uint32_t rate_hz);
+void capture_close(capture_source_t *src);
+int capture_write_file(const char *path, uint32_t rate_hz, const uint8_t *buf, size_t len);
+size_t synthesize_samples(const uint8_t frame[5], uint32_t rate_hz, double jitter,
+                          simulator_t *sim, uint8_t *buf, size_t len);
+
+int read_spi(const sensor_config_t *config, sensor_reading_t *reading, uint64_t deadline_us);
+
+#endif /* SPI_BACKEND_H */
@@ -0,0 +1,211 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * SQLite sink for watch mode.
+ *
+ * The database is opened in WAL mode with synchronous=NORMAL, so a commit
+ * appends to the write-ahead log without an fsync and the log is only
+ * synced at checkpoints. Rows are inserted through a single prepared
+ * statement and grouped into one transaction per commit interval, which
+ * keeps SD-card writes to a few pages per interval instead of a journal
+ * round-trip per row.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "sqlite_sink.h"
+
+struct sqlite_sink {
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    int commit_interval_sec;
+    bool in_transaction;
+    time_t transaction_start;   /* Monotonic seconds when BEGIN was issued */
+};
+
+static const char *SCHEMA_SQL =
+    "CREATE TABLE IF NOT EXISTS readings ("
+    " timestamp INTEGER NOT NULL,"
+    " sensor_id TEXT NOT NULL,"
+    " measurement TEXT NOT NULL,"
+    " value REAL,"
+    " error TEXT);"
+    "CREATE INDEX IF NOT EXISTS readings_timestamp ON readings(timestamp);";
+
+static const char *INSERT_SQL =
+    "INSERT INTO readings (timestamp, sensor_id, measurement, value, error)"
+    " VALUES (?1, ?2, ?3, ?4, ?5)";
+
+/*
+ * Get monotonic time in seconds
+ */
+static time_t monotonic_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/*
+ * Run a statement that returns no rows, logging any error
+ */
+static int exec_sql(sqlite3 *db, const char *sql) {
+    char *err = NULL;
+    
+    if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+        log_error("SQLite error: %s", err ? err : sqlite3_errmsg(db));
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Open (creating if needed) the readings database.
+ * Returns NULL on error.
+ */
+sqlite_sink_t *sqlite_sink_open(const char *path, int commit_interval_sec) {
+    sqlite_sink_t *sink = calloc(1, sizeof(sqlite_sink_t));
+    if (!sink) {
+        return NULL;
+    }
+    sink->commit_interval_sec = commit_interval_sec;
+    
+    if (sqlite3_open(path, &sink->db) != SQLITE_OK) {
+        log_error("Cannot open SQLite database %s: %s", path, sqlite3_errmsg(sink->db));
+        sqlite3_close(sink->db);
+        free(sink);
+        return NULL;
+    }
+    
+    /* Other tools may be querying the database; wait for them rather than failing */
+    sqlite3_busy_timeout(sink->db, 5000);
+    
+    if (exec_sql(sink->db, "PRAGMA journal_mode=WAL") < 0 ||
+        exec_sql(sink->db, "PRAGMA synchronous=NORMAL") < 0 ||
+        exec_sql(sink->db, SCHEMA_SQL) < 0) {
+        sqlite3_close(sink->db);
+        free(sink);
+        return NULL;
+    }
+    
+    if (sqlite3_prepare_v2(sink->db, INSERT_SQL, -1, &sink->insert, NULL) != SQLITE_OK) {
+        log_error("SQLite error: %s", sqlite3_errmsg(sink->db));
+        sqlite3_close(sink->db);
+        free(sink);
+        return NULL;
+    }
+    
+    return sink;
+}
+
+/*
+ * Insert one row using the prepared statement
+ */
+static int insert_row(sqlite_sink_t *sink, time_t timestamp, const char *sensor_id,
+                      const char *measurement, float value, const char *error_msg) {
+    sqlite3_stmt *stmt = sink->insert;
+    int rc;
+    
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)timestamp);
+    sqlite3_bind_text(stmt, 2, sensor_id ? sensor_id : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, measurement, -1, SQLITE_STATIC);
+    if (error_msg) {
+        sqlite3_bind_null(stmt, 4);
+        sqlite3_bind_text(stmt, 5, error_msg, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_bind_double(stmt, 4, value);
+        sqlite3_bind_null(stmt, 5);
+    }
+    
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    
+    if (rc != SQLITE_DONE) {
+        log_error("SQLite insert failed: %s", sqlite3_errmsg(sink->db));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Store one sweep of readings.
+ * Rows are added to the open transaction, which is committed once
+ * commit_interval_sec has elapsed since it began.
+ */
+int sqlite_sink_write(sqlite_sink_t *sink, const sensor_config_t *configs,
+                      const sensor_reading_t *readings, int count,
+                      const char *filter, ws_location_filter_t location_filter) {
+    int i;
+    int result = 0;
+    
+    if (!sink->in_transaction) {
+        if (exec_sql(sink->db, "BEGIN") < 0) {
+            return -1;
+        }
+        sink->in_transaction = true;
+        sink->transaction_start = monotonic_sec();
+    }
+    
+    for (i = 0; i < count; i++) {
+        const sensor_reading_t *reading = &readings[i];
+        const char *error_msg = reading->valid ? NULL : reading->error_msg;
+        
+        if (!sensor_selected(&configs[i], location_filter)) {
+            continue;
+        }
+        
+        if (measurement_selected(filter, "temperature") &&
+            insert_row(sink, reading->timestamp, configs[i].sensor_id, "temperature",
+                       reading->temperature, error_msg) < 0) {
+            result = -1;
+        }
+        if (measurement_selected(filter, "humidity") &&
+            insert_row(sink, reading->timestamp, configs[i].sensor_id, "humidity",
+                       reading->humidity, error_msg) < 0) {
+            result = -1;
+        }
+    }
+    
+    if (monotonic_sec() - sink->transaction_start >= sink->commit_interval_sec) {
+        if (sqlite_sink_commit(sink) < 0) {
+            result = -1;
+        }
+    }
+    
+    return result;
+}
+
+/*
+ * Commit the open transaction, if any
+ */
+int sqlite_sink_commit(sqlite_sink_t *sink) {
+    if (!sink->in_transaction) {
+        return 0;
+    }
+    int result = exec_sql(sink->db, "COMMIT");
+    
+    /* A busy COMMIT leaves the transaction open to be retried next sweep */
+    sink->in_transaction = !sqlite3_get_autocommit(sink->db);
+    return result;
+}
+
+/*
+ * Commit pending rows and close the database
+ */
+void sqlite_sink_close(sqlite_sink_t *sink) {
+    if (!sink) {
+        return;
+    }
+    sqlite_sink_commit(sink);
+    sqlite3_finalize(sink->insert);
+    sqlite3_close(sink->db);
+    free(sink);
+}
@@ -0,0 +1,25 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * SQLite sink for watch mode: stores readings on the node itself
+ */
+
+#ifndef SQLITE_SINK_H
+#define SQLITE_SINK_H
+
+#include "dht11.h"
+
+/* Default seconds between transaction commits */
+#define SQLITE_DEFAULT_COMMIT_INTERVAL_SEC  300
+
+typedef struct sqlite_sink sqlite_sink_t;
+
+sqlite_sink_t *sqlite_sink_open(const char *path, int commit_interval_sec);
+int sqlite_sink_write(sqlite_sink_t *sink, const sensor_config_t *configs,
+                      const sensor_reading_t *readings, int count,
+                      const char *filter, ws_location_filter_t location_filter);
+int sqlite_sink_commit(sqlite_sink_t *sink);
+void sqlite_sink_close(sqlite_sink_t *sink);
+
+#endif /* SQLITE_SINK_H */
@@ -0,0 +1,399 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Workload trace recording and replay.
+ *
+ * When SENSOR_DHT11_TRACE names a file, every command that reads sensors
+ * appends a 40-byte record of when it ran, what it asked for and who asked.
+ * The replayer feeds the client requests from a trace through a model of
+ * serve backed by the simulator, in virtual time: each sensor is read every
+ * interval on its own schedule, a request that arrives during a sweep waits
+ * for it, and every request is answered from the latest readings. A day of
+ * traffic replays in well under a second for each interval.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "trace.h"
+#include "simulator.h"
+
+#define US_PER_SEC  1000000ULL
+
+/* Per-interval replay results */
+typedef struct {
+    uint64_t lookups;       /* Sensor lookups across all requests */
+    uint64_t no_data;       /* The sensor's latest read failed, or it has not been read */
+    uint64_t waited;        /* Requests that arrived during a sweep */
+    uint64_t reads;         /* Simulated reads */
+    uint64_t bus_us;
+    uint64_t age_total_us;
+    uint64_t age_max_us;
+    uint64_t aged;          /* Lookups that returned data */
+    uint64_t latency_total_us;
+} replay_stats_t;
+
+/* Simulated serve state for one sensor */
+typedef struct {
+    uint64_t next_due_us;   /* When the sensor is next read */
+    uint64_t read_at_us;    /* When its latest read started, as serve stamps readings */
+    bool valid;             /* Its latest read succeeded */
+} replay_sensor_t;
+
+/*
+ * Get wall-clock time in microseconds
+ */
+uint64_t trace_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * US_PER_SEC + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/*
+ * Open the trace file named by SENSOR_DHT11_TRACE for appending.
+ * Returns -1 if tracing is not enabled or the file cannot be opened.
+ */
+int trace_open(void) {
+    const char *path = getenv(TRACE_ENV);
+    int fd;
+    
+    if (!path || !*path) {
+        return -1;
+    }
+    fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_error("Cannot open trace file %s: %s", path, strerror(errno));
+    }
+    return fd;
+}
+
+/*
+ * Read a process name from /proc
+ */
+static void process_name(pid_t pid, char name[16]) {
+    char path[64];
+    FILE *fp;
+    size_t len;
+    char buf[32];
+    
+    memset(name, 0, 16);
+    snprintf(path, sizeof(path), "/proc/%d/comm", (int)pid);
+    fp = fopen(path, "r");
+    if (!fp) {
+        return;
+    }
+    if (fgets(buf, sizeof(buf), fp)) {
+        len = strcspn(buf, "\n");
+        memcpy(name, buf, len < 16 ? len : 16);
+    }
+    fclose(fp);
+}
+
+/*
+ * Fill in the fields common to every record for a command that started at start_us
+ */
+static void fill_record(trace_record_t *rec, trace_command_t command, const char *filter,
+                        ws_location_filter_t location_filter, int sensors, uint64_t start_us) {
+    memset(rec, 0, sizeof(*rec));
+    rec->time_us = start_us;
+    rec->duration_us = (uint32_t)(trace_now_us() - start_us);
+    rec->command = (uint8_t)command;
+    if (filter && strcmp(filter, "temperature") == 0) {
+        rec->filter = 1;
+    } else if (filter && strcmp(filter, "humidity") == 0) {
+        rec->filter = 2;
+    }
+    rec->location = (uint8_t)location_filter;
+    rec->sensors = (uint8_t)(sensors > 255 ? 255 : sensors);
+}
+
+static void append_record(int fd, const trace_record_t *rec) {
+    /* A single write of a small record is atomic with O_APPEND */
+    if (write(fd, rec, sizeof(*rec)) != (ssize_t)sizeof(*rec)) {
+        log_error("Trace write failed: %s", strerror(errno));
+    }
+}
+
+/*
+ * Append one record for a command run on behalf of process caller_pid
+ */
+void trace_record(int fd, trace_command_t command, const char *filter,
+                  ws_location_filter_t location_filter, int sensors,
+                  uint64_t start_us, pid_t caller_pid) {
+    trace_record_t rec;
+    
+    if (fd < 0) {
+        return;
+    }
+    fill_record(&rec, command, filter, location_filter, sensors, start_us);
+    rec.caller_pid = (uint32_t)caller_pid;
+    process_name(caller_pid, rec.caller);
+    append_record(fd, &rec);
+}
+
+/*
+ * Append one record for a daemon request from the client at peer
+ */
+void trace_record_client(int fd, trace_command_t command, const char *filter,
+                         ws_location_filter_t location_filter, int sensors,
+                         uint64_t start_us, const struct sockaddr_in *peer) {
+    trace_record_t rec;
+    char addr[INET_ADDRSTRLEN];
+    
+    if (fd < 0) {
+        return;
+    }
+    fill_record(&rec, command, filter, location_filter, sensors, start_us);
+    if (peer && peer->sin_family == AF_INET &&
+        inet_ntop(AF_INET, &peer->sin_addr, addr, sizeof(addr))) {
+        memcpy(rec.caller, addr, strlen(addr));
+        rec.caller_port = ntohs(peer->sin_port);
+    }
+    append_record(fd, &rec);
+}
+
+void trace_close(int fd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static int compare_time(const void *a, const void *b) {
+    const trace_record_t *ra = a, *rb = b;
+    return ra->time_us < rb->time_us ? -1 : ra->time_us > rb->time_us;
+}
+
+/*
+ * Load client requests from a trace file, in start order; sweeps are dropped because the
+ * replayed daemon schedules its own.
+ * Returns dynamically allocated array, caller must free.
+ */
+static trace_record_t *load_requests(const char *path, size_t *count) {
+    FILE *fp = fopen(path, "rb");
+    trace_record_t *records = NULL;
+    trace_record_t rec;
+    size_t cap = 0;
+    
+    *count = 0;
+    if (!fp) {
+        log_error("Cannot open trace file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        if (rec.command != TRACE_CMD_READ && rec.command != TRACE_CMD_REQUEST) {
+            continue;
+        }
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            trace_record_t *grown = realloc(records, cap * sizeof(rec));
+            if (!grown) {
+                free(records);
+                fclose(fp);
+                *count = 0;
+                return NULL;
+            }
+            records = grown;
+        }
+        records[(*count)++] = rec;
+    }
+    fclose(fp);
+    
+    /* Records are appended on completion, so concurrent commands can be out of order */
+    qsort(records, *count, sizeof(rec), compare_time);
+    return records;
+}
+
+/*
+ * Simulate one read of a sensor starting at start_us, cut off at the sweep's
+ * deadline_us as serve cuts it off.
+ * Returns the completion time.
+ */
+static uint64_t replay_read(simulator_t *sim, const sensor_config_t *config, replay_sensor_t *state,
+                            uint64_t start_us, uint64_t deadline_us, replay_stats_t *stats) {
+    sensor_reading_t reading;
+    sim_cost_t cost;
+    uint64_t end;
+    
+    simulator_read(sim, config->pin, &reading, &cost);
+    end = start_us + cost.elapsed_us;
+    stats->reads++;
+    stats->bus_us += cost.bus_us;
+    
+    state->read_at_us = start_us;
+    state->valid = reading.valid && end <= deadline_us;
+    return end < deadline_us ? end : deadline_us;
+}
+
+/*
+ * One pass of serve_read_due() at start_us: the other backends one after
+ * another, then the GPIO sensors together, their retries overlapping so
+ * the batch lasts as long as its slowest read. Each sensor then moves on
+ * one interval, skipping ticks missed while busy.
+ * Returns when the sweep ends.
+ */
+static uint64_t replay_sweep(simulator_t *sim, const sensor_config_t *configs,
+                             replay_sensor_t *sensors, int count, uint64_t interval_us,
+                             uint64_t start_us, replay_stats_t *stats) {
+    uint64_t deadline_us = start_us + DHT11_READ_DEADLINE_US;
+    uint64_t t = start_us;
+    uint64_t batch_end;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        if (sensors[i].next_due_us <= start_us && configs[i].backend != BACKEND_GPIO) {
+            t = replay_read(sim, &configs[i], &sensors[i], t, deadline_us, stats);
+        }
+    }
+    batch_end = t;
+    for (i = 0; i < count; i++) {
+        if (sensors[i].next_due_us <= start_us && configs[i].backend == BACKEND_GPIO) {
+            uint64_t end = replay_read(sim, &configs[i], &sensors[i], t, deadline_us, stats);
+            if (end > batch_end) {
+                batch_end = end;
+            }
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (sensors[i].next_due_us <= start_us) {
+            sensors[i].next_due_us += interval_us;
+            if (sensors[i].next_due_us <= start_us) {
+                sensors[i].next_due_us = start_us + interval_us;
+            }
+        }
+    }
+    return batch_end;
+}
+
+/*
+ * Replay requests against serve reading every interval seconds. The daemon
+ * has been up for one interval when the first request arrives.
+ */
+static void replay_interval(const trace_record_t *requests, size_t n_requests,
+                            const sensor_config_t *configs, int count, int interval,
+                            const trace_replay_opts_t *opts, replay_stats_t *stats,
+                            uint64_t *span_us) {
+    replay_sensor_t *sensors = calloc(count, sizeof(replay_sensor_t));
+    simulator_t sim;
+    uint64_t interval_us = (uint64_t)interval * US_PER_SEC;
+    uint64_t t0 = requests[0].time_us - interval_us;
+    uint64_t busy_until = 0;    /* End of the latest sweep */
+    size_t r;
+    int i;
+    
+    memset(stats, 0, sizeof(*stats));
+    if (!sensors) {
+        return;
+    }
+    simulator_init(&sim, opts->seed, opts->fail_rate);
+    
+    for (r = 0; r < n_requests; r++) {
+        uint64_t t = requests[r].time_us - t0;
+        uint64_t answered;
+        
+        /* Sweeps that start by the time of this request: the loop reads as
+         * soon as a sensor is due and the previous sweep is over */
+        for (;;) {
+            uint64_t due = UINT64_MAX;
+            
+            for (i = 0; i < count; i++) {
+                if (sensors[i].next_due_us < due) {
+                    due = sensors[i].next_due_us;
+                }
+            }
+            if (due < busy_until) {
+                due = busy_until;
+            }
+            if (count == 0 || due > t) {
+                break;
+            }
+            busy_until = replay_sweep(&sim, configs, sensors, count, interval_us, due, stats);
+        }
+        
+        /* The loop answers no one while it reads */
+        answered = t > busy_until ? t : busy_until;
+        stats->waited += answered > t;
+        stats->latency_total_us += answered - t;
+        
+        for (i = 0; i < count; i++) {
+            replay_sensor_t *state = &sensors[i];
+            uint64_t age;
+            
+            if (!sensor_selected(&configs[i], (ws_location_filter_t)requests[r].location)) {
+                continue;
+            }
+            stats->lookups++;
+            if (!state->valid) {
+                stats->no_data++;
+                continue;
+            }
+            
+            /* Age of the reading as the client gets it */
+            age = answered - state->read_at_us;
+            stats->aged++;
+            stats->age_total_us += age;
+            if (age > stats->age_max_us) {
+                stats->age_max_us = age;
+            }
+        }
+    }
+    
+    *span_us = requests[n_requests - 1].time_us - t0;
+    free(sensors);
+}
+
+/*
+ * Replay a trace against every interval in opts and print a table
+ */
+int trace_replay(const char *path, const sensor_config_t *configs, int count,
+                 const trace_replay_opts_t *opts) {
+    size_t n_requests;
+    trace_record_t *requests = load_requests(path, &n_requests);
+    replay_stats_t stats;
+    uint64_t span_us = 0;
+    int n;
+    
+    if (!requests || n_requests == 0) {
+        fprintf(stderr, "No client requests in trace %s\n", path);
+        free(requests);
+        return -1;
+    }
+    
+    printf("Trace: %zu requests over %.1f s, %d sensors, %.0f%% attempt failure rate\n",
+           n_requests, (requests[n_requests - 1].time_us - requests[0].time_us) / 1e6,
+           count, opts->fail_rate * 100.0);
+    printf("%8s %8s %7s %7s %10s %10s %10s %9s %7s\n",
+           "interval", "lookups", "nodata%", "waited%", "age_mean_s", "age_max_s", "latency_ms",
+           "reads/h", "bus%");
+    
+    for (n = 0; n < opts->n_intervals; n++) {
+        replay_interval(requests, n_requests, configs, count, opts->intervals[n], opts,
+                        &stats, &span_us);
+        if (stats.lookups == 0) {
+            continue;
+        }
+        printf("%8d %8llu %7.1f %7.1f %10.1f %10.1f %10.1f %9.0f %7.3f\n",
+               opts->intervals[n], (unsigned long long)stats.lookups,
+               100.0 * stats.no_data / stats.lookups,
+               100.0 * stats.waited / n_requests,
+               stats.aged ? stats.age_total_us / 1e6 / stats.aged : 0.0,
+               stats.age_max_us / 1e6,
+               stats.latency_total_us / 1e3 / n_requests,
+               stats.reads * 3600e6 / span_us,
+               100.0 * stats.bus_us / span_us);
+    }
+    
+    free(requests);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * sensor-dht11 - Read DHT11 sensors on Raspberry Pi
+ * Copyright (C) 2024 Wildlife Systems
+ *
+ * Workload trace recording and replay for cache/daemon tuning
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include "dht11.h"
+
+/* Environment variable naming the trace file to append to */
+#define TRACE_ENV   "SENSOR_DHT11_TRACE"
+
+/* Maximum intervals per replay */
+#define TRACE_MAX_SETTINGS  16
+
+typedef enum {
+    TRACE_CMD_READ = 1,     /* One-shot invocation that read sensors */
+    TRACE_CMD_SWEEP = 2,    /* Watch mode sweep */
+    TRACE_CMD_REQUEST = 3   /* Daemon client request */
+} trace_command_t;
+
+/*
+ * One trace record. Records are fixed size and appended with O_APPEND, so
+ * concurrent invocations can share a trace file without locking.
+ */
+typedef struct {
+    uint64_t time_us;       /* CLOCK_REALTIME when the command started */
+    uint32_t duration_us;   /* Time taken to serve it */
+    uint32_t caller_pid;    /* Parent process; 0 for daemon clients */
+    uint8_t command;        /* trace_command_t */
+    uint8_t filter;         /* 0 = all, 1 = temperature, 2 = humidity */
+    uint8_t location;       /* ws_location_filter_t */
+    uint8_t sensors;        /* Number of sensors read */
+    char caller[16];        /* Caller process name, or a daemon client's IPv4 address;
+                               not NUL terminated if 16 long */
+    uint16_t caller_port;   /* Daemon client's TCP port, 0 otherwise */
+    uint8_t reserved[2];
+} trace_record_t;
+
+/* Replay settings: the trace is replayed once per interval */
+typedef struct {
+    int intervals[TRACE_MAX_SETTINGS];  /* serve --interval, seconds */
+    int n_intervals;
+    double fail_rate;
+    uint64_t seed;
+} trace_replay_opts_t;
+
+uint64_t trace_now_us(void);
+int trace_open(void);
+void trace_record(int fd, trace_command_t command, const char *filter,
+                  ws_location_filter_t location_filter, int sensors,
+                  uint64_t start_us, pid_t caller_pid);
+void trace_record_client(int fd, trace_command_t command, const char *filter,
+                         ws_location_filter_t location_filter, int sensors,
+                         uint64_t start_us, const struct sockaddr_in *peer);
+void trace_close(int fd);
+int trace_replay(const char *path, const sensor_config_t *configs, int count,
+                 const trace_replay_opts_t *opts);
+
+#endif /* TRACE_H */